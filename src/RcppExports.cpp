@@ -34,9 +34,135 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// wsBufferedAmount
+double wsBufferedAmount(SEXP conn);
+RcppExport SEXP _httpuv_wsBufferedAmount(SEXP connSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type conn(connSEXP);
+    rcpp_result_gen = Rcpp::wrap(wsBufferedAmount(conn));
+    return rcpp_result_gen;
+END_RCPP
+}
+// wsRoundTripTime
+double wsRoundTripTime(SEXP conn);
+RcppExport SEXP _httpuv_wsRoundTripTime(SEXP connSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type conn(connSEXP);
+    rcpp_result_gen = Rcpp::wrap(wsRoundTripTime(conn));
+    return rcpp_result_gen;
+END_RCPP
+}
+// makeResponseStream
+Rcpp::RObject makeResponseStream(double highWaterMark, Rcpp::Function onDrain);
+RcppExport SEXP _httpuv_makeResponseStream(SEXP highWaterMarkSEXP, SEXP onDrainSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type highWaterMark(highWaterMarkSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type onDrain(onDrainSEXP);
+    rcpp_result_gen = Rcpp::wrap(makeResponseStream(highWaterMark, onDrain));
+    return rcpp_result_gen;
+END_RCPP
+}
+// writeResponseStream
+bool writeResponseStream(SEXP stream, Rcpp::RawVector data);
+RcppExport SEXP _httpuv_writeResponseStream(SEXP streamSEXP, SEXP dataSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type data(dataSEXP);
+    rcpp_result_gen = Rcpp::wrap(writeResponseStream(stream, data));
+    return rcpp_result_gen;
+END_RCPP
+}
+// closeResponseStream
+void closeResponseStream(SEXP stream);
+RcppExport SEXP _httpuv_closeResponseStream(SEXP streamSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    closeResponseStream(stream);
+    return R_NilValue;
+END_RCPP
+}
+// responseStreamBufferedAmount
+double responseStreamBufferedAmount(SEXP stream);
+RcppExport SEXP _httpuv_responseStreamBufferedAmount(SEXP streamSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    rcpp_result_gen = Rcpp::wrap(responseStreamBufferedAmount(stream));
+    return rcpp_result_gen;
+END_RCPP
+}
+// responseStreamIsOpen
+bool responseStreamIsOpen(SEXP stream);
+RcppExport SEXP _httpuv_responseStreamIsOpen(SEXP streamSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    rcpp_result_gen = Rcpp::wrap(responseStreamIsOpen(stream));
+    return rcpp_result_gen;
+END_RCPP
+}
+// makeSSEChannel
+Rcpp::RObject makeSSEChannel(double historySize, double keepalive, double maxBufferedAmount);
+RcppExport SEXP _httpuv_makeSSEChannel(SEXP historySizeSEXP, SEXP keepaliveSEXP, SEXP maxBufferedAmountSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type historySize(historySizeSEXP);
+    Rcpp::traits::input_parameter< double >::type keepalive(keepaliveSEXP);
+    Rcpp::traits::input_parameter< double >::type maxBufferedAmount(maxBufferedAmountSEXP);
+    rcpp_result_gen = Rcpp::wrap(makeSSEChannel(historySize, keepalive, maxBufferedAmount));
+    return rcpp_result_gen;
+END_RCPP
+}
+// publishSSE
+std::string publishSSE(SEXP channel, std::string data, std::string event, std::string id);
+RcppExport SEXP _httpuv_publishSSE(SEXP channelSEXP, SEXP dataSEXP, SEXP eventSEXP, SEXP idSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type channel(channelSEXP);
+    Rcpp::traits::input_parameter< std::string >::type data(dataSEXP);
+    Rcpp::traits::input_parameter< std::string >::type event(eventSEXP);
+    Rcpp::traits::input_parameter< std::string >::type id(idSEXP);
+    rcpp_result_gen = Rcpp::wrap(publishSSE(channel, data, event, id));
+    return rcpp_result_gen;
+END_RCPP
+}
+// closeSSEChannel
+void closeSSEChannel(SEXP channel);
+RcppExport SEXP _httpuv_closeSSEChannel(SEXP channelSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type channel(channelSEXP);
+    closeSSEChannel(channel);
+    return R_NilValue;
+END_RCPP
+}
+// sseSubscriberCount
+double sseSubscriberCount(SEXP channel);
+RcppExport SEXP _httpuv_sseSubscriberCount(SEXP channelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type channel(channelSEXP);
+    rcpp_result_gen = Rcpp::wrap(sseSubscriberCount(channel));
+    return rcpp_result_gen;
+END_RCPP
+}
 // makeTcpServer
-Rcpp::RObject makeTcpServer(const std::string& host, int port, Rcpp::Function onHeaders, Rcpp::Function onBodyData, Rcpp::Function onRequest, Rcpp::Function onWSOpen, Rcpp::Function onWSMessage, Rcpp::Function onWSClose, Rcpp::List staticPaths, Rcpp::List staticPathOptions, bool quiet);
-RcppExport SEXP _httpuv_makeTcpServer(SEXP hostSEXP, SEXP portSEXP, SEXP onHeadersSEXP, SEXP onBodyDataSEXP, SEXP onRequestSEXP, SEXP onWSOpenSEXP, SEXP onWSMessageSEXP, SEXP onWSCloseSEXP, SEXP staticPathsSEXP, SEXP staticPathOptionsSEXP, SEXP quietSEXP) {
+Rcpp::RObject makeTcpServer(const std::string& host, int port, Rcpp::Function onHeaders, Rcpp::Function onBodyData, Rcpp::Function onRequest, Rcpp::Function onWSOpen, Rcpp::Function onWSMessage, Rcpp::Function onWSMessageBatch, Rcpp::Function onWSMessageStream, Rcpp::Function onWSClose, Rcpp::List staticPaths, Rcpp::List staticPathOptions, Rcpp::List serverOptions, bool quiet);
+RcppExport SEXP _httpuv_makeTcpServer(SEXP hostSEXP, SEXP portSEXP, SEXP onHeadersSEXP, SEXP onBodyDataSEXP, SEXP onRequestSEXP, SEXP onWSOpenSEXP, SEXP onWSMessageSEXP, SEXP onWSMessageBatchSEXP, SEXP onWSMessageStreamSEXP, SEXP onWSCloseSEXP, SEXP staticPathsSEXP, SEXP staticPathOptionsSEXP, SEXP serverOptionsSEXP, SEXP quietSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -47,17 +173,20 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Rcpp::Function >::type onRequest(onRequestSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSOpen(onWSOpenSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessage(onWSMessageSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessageBatch(onWSMessageBatchSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessageStream(onWSMessageStreamSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSClose(onWSCloseSEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type staticPaths(staticPathsSEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type staticPathOptions(staticPathOptionsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type serverOptions(serverOptionsSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    rcpp_result_gen = Rcpp::wrap(makeTcpServer(host, port, onHeaders, onBodyData, onRequest, onWSOpen, onWSMessage, onWSClose, staticPaths, staticPathOptions, quiet));
+    rcpp_result_gen = Rcpp::wrap(makeTcpServer(host, port, onHeaders, onBodyData, onRequest, onWSOpen, onWSMessage, onWSMessageBatch, onWSMessageStream, onWSClose, staticPaths, staticPathOptions, serverOptions, quiet));
     return rcpp_result_gen;
 END_RCPP
 }
 // makePipeServer
-Rcpp::RObject makePipeServer(const std::string& name, int mask, Rcpp::Function onHeaders, Rcpp::Function onBodyData, Rcpp::Function onRequest, Rcpp::Function onWSOpen, Rcpp::Function onWSMessage, Rcpp::Function onWSClose, Rcpp::List staticPaths, Rcpp::List staticPathOptions, bool quiet);
-RcppExport SEXP _httpuv_makePipeServer(SEXP nameSEXP, SEXP maskSEXP, SEXP onHeadersSEXP, SEXP onBodyDataSEXP, SEXP onRequestSEXP, SEXP onWSOpenSEXP, SEXP onWSMessageSEXP, SEXP onWSCloseSEXP, SEXP staticPathsSEXP, SEXP staticPathOptionsSEXP, SEXP quietSEXP) {
+Rcpp::RObject makePipeServer(const std::string& name, int mask, Rcpp::Function onHeaders, Rcpp::Function onBodyData, Rcpp::Function onRequest, Rcpp::Function onWSOpen, Rcpp::Function onWSMessage, Rcpp::Function onWSMessageBatch, Rcpp::Function onWSMessageStream, Rcpp::Function onWSClose, Rcpp::List staticPaths, Rcpp::List staticPathOptions, Rcpp::List serverOptions, bool quiet);
+RcppExport SEXP _httpuv_makePipeServer(SEXP nameSEXP, SEXP maskSEXP, SEXP onHeadersSEXP, SEXP onBodyDataSEXP, SEXP onRequestSEXP, SEXP onWSOpenSEXP, SEXP onWSMessageSEXP, SEXP onWSMessageBatchSEXP, SEXP onWSMessageStreamSEXP, SEXP onWSCloseSEXP, SEXP staticPathsSEXP, SEXP staticPathOptionsSEXP, SEXP serverOptionsSEXP, SEXP quietSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -68,11 +197,14 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Rcpp::Function >::type onRequest(onRequestSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSOpen(onWSOpenSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessage(onWSMessageSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessageBatch(onWSMessageBatchSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type onWSMessageStream(onWSMessageStreamSEXP);
     Rcpp::traits::input_parameter< Rcpp::Function >::type onWSClose(onWSCloseSEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type staticPaths(staticPathsSEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type staticPathOptions(staticPathOptionsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type serverOptions(serverOptionsSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    rcpp_result_gen = Rcpp::wrap(makePipeServer(name, mask, onHeaders, onBodyData, onRequest, onWSOpen, onWSMessage, onWSClose, staticPaths, staticPathOptions, quiet));
+    rcpp_result_gen = Rcpp::wrap(makePipeServer(name, mask, onHeaders, onBodyData, onRequest, onWSOpen, onWSMessage, onWSMessageBatch, onWSMessageStream, onWSClose, staticPaths, staticPathOptions, serverOptions, quiet));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -86,6 +218,28 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// getConnectionStats_
+Rcpp::List getConnectionStats_(std::string handle);
+RcppExport SEXP _httpuv_getConnectionStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getConnectionStats_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// getServerStats_
+Rcpp::List getServerStats_(std::string handle);
+RcppExport SEXP _httpuv_getServerStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getServerStats_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
 // getStaticPaths_
 Rcpp::List getStaticPaths_(std::string handle);
 RcppExport SEXP _httpuv_getStaticPaths_(SEXP handleSEXP) {
@@ -144,6 +298,131 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// getFixedResponses_
+Rcpp::List getFixedResponses_(std::string handle);
+RcppExport SEXP _httpuv_getFixedResponses_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getFixedResponses_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// setFixedResponse_
+Rcpp::List setFixedResponse_(std::string handle, std::string method, std::string path, int status, Rcpp::List headers, Rcpp::RawVector body);
+RcppExport SEXP _httpuv_setFixedResponse_(SEXP handleSEXP, SEXP methodSEXP, SEXP pathSEXP, SEXP statusSEXP, SEXP headersSEXP, SEXP bodySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type method(methodSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< int >::type status(statusSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type headers(headersSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type body(bodySEXP);
+    rcpp_result_gen = Rcpp::wrap(setFixedResponse_(handle, method, path, status, headers, body));
+    return rcpp_result_gen;
+END_RCPP
+}
+// removeFixedResponse_
+Rcpp::List removeFixedResponse_(std::string handle, std::string method, std::string path);
+RcppExport SEXP _httpuv_removeFixedResponse_(SEXP handleSEXP, SEXP methodSEXP, SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type method(methodSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(removeFixedResponse_(handle, method, path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// getResponseCacheStats_
+Rcpp::List getResponseCacheStats_(std::string handle);
+RcppExport SEXP _httpuv_getResponseCacheStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getResponseCacheStats_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// purgeResponseCache_
+double purgeResponseCache_(std::string handle, Rcpp::CharacterVector paths);
+RcppExport SEXP _httpuv_purgeResponseCache_(SEXP handleSEXP, SEXP pathsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type paths(pathsSEXP);
+    rcpp_result_gen = Rcpp::wrap(purgeResponseCache_(handle, paths));
+    return rcpp_result_gen;
+END_RCPP
+}
+// getLoadSheddingStats_
+Rcpp::List getLoadSheddingStats_(std::string handle);
+RcppExport SEXP _httpuv_getLoadSheddingStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getLoadSheddingStats_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// getLatencyStats_
+Rcpp::List getLatencyStats_(std::string handle);
+RcppExport SEXP _httpuv_getLatencyStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(getLatencyStats_(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// resetLatencyStats_
+void resetLatencyStats_(std::string handle);
+RcppExport SEXP _httpuv_resetLatencyStats_(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type handle(handleSEXP);
+    resetLatencyStats_(handle);
+    return R_NilValue;
+END_RCPP
+}
+// startTracing_
+void startTracing_(double capacity);
+RcppExport SEXP _httpuv_startTracing_(SEXP capacitySEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type capacity(capacitySEXP);
+    startTracing_(capacity);
+    return R_NilValue;
+END_RCPP
+}
+// stopTracing_
+void stopTracing_();
+RcppExport SEXP _httpuv_stopTracing_() {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    stopTracing_();
+    return R_NilValue;
+END_RCPP
+}
+// writeTrace_
+double writeTrace_(std::string path);
+RcppExport SEXP _httpuv_writeTrace_(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(writeTrace_(path));
+    return rcpp_result_gen;
+END_RCPP
+}
 // base64encode
 std::string base64encode(const Rcpp::RawVector& x);
 RcppExport SEXP _httpuv_base64encode(SEXP xSEXP) {
@@ -230,25 +509,24 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
-// wsconn_address
-std::string wsconn_address(SEXP external_ptr);
-RcppExport SEXP _httpuv_wsconn_address(SEXP external_ptrSEXP) {
+// log_level
+std::string log_level(const std::string& level);
+RcppExport SEXP _httpuv_log_level(SEXP levelSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< SEXP >::type external_ptr(external_ptrSEXP);
-    rcpp_result_gen = Rcpp::wrap(wsconn_address(external_ptr));
+    Rcpp::traits::input_parameter< const std::string& >::type level(levelSEXP);
+    rcpp_result_gen = Rcpp::wrap(log_level(level));
     return rcpp_result_gen;
 END_RCPP
 }
-// log_level
-std::string log_level(const std::string& level);
-RcppExport SEXP _httpuv_log_level(SEXP levelSEXP) {
+// getLogEvents_
+Rcpp::List getLogEvents_();
+RcppExport SEXP _httpuv_getLogEvents_() {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< const std::string& >::type level(levelSEXP);
-    rcpp_result_gen = Rcpp::wrap(log_level(level));
+    rcpp_result_gen = Rcpp::wrap(getLogEvents_());
     return rcpp_result_gen;
 END_RCPP
 }
@@ -256,14 +534,38 @@ END_RCPP
 static const R_CallMethodDef CallEntries[] = {
     {"_httpuv_sendWSMessage", (DL_FUNC) &_httpuv_sendWSMessage, 3},
     {"_httpuv_closeWS", (DL_FUNC) &_httpuv_closeWS, 3},
-    {"_httpuv_makeTcpServer", (DL_FUNC) &_httpuv_makeTcpServer, 11},
-    {"_httpuv_makePipeServer", (DL_FUNC) &_httpuv_makePipeServer, 11},
+    {"_httpuv_wsBufferedAmount", (DL_FUNC) &_httpuv_wsBufferedAmount, 1},
+    {"_httpuv_wsRoundTripTime", (DL_FUNC) &_httpuv_wsRoundTripTime, 1},
+    {"_httpuv_makeResponseStream", (DL_FUNC) &_httpuv_makeResponseStream, 2},
+    {"_httpuv_writeResponseStream", (DL_FUNC) &_httpuv_writeResponseStream, 2},
+    {"_httpuv_closeResponseStream", (DL_FUNC) &_httpuv_closeResponseStream, 1},
+    {"_httpuv_responseStreamBufferedAmount", (DL_FUNC) &_httpuv_responseStreamBufferedAmount, 1},
+    {"_httpuv_responseStreamIsOpen", (DL_FUNC) &_httpuv_responseStreamIsOpen, 1},
+    {"_httpuv_makeSSEChannel", (DL_FUNC) &_httpuv_makeSSEChannel, 3},
+    {"_httpuv_publishSSE", (DL_FUNC) &_httpuv_publishSSE, 4},
+    {"_httpuv_closeSSEChannel", (DL_FUNC) &_httpuv_closeSSEChannel, 1},
+    {"_httpuv_sseSubscriberCount", (DL_FUNC) &_httpuv_sseSubscriberCount, 1},
+    {"_httpuv_makeTcpServer", (DL_FUNC) &_httpuv_makeTcpServer, 14},
+    {"_httpuv_makePipeServer", (DL_FUNC) &_httpuv_makePipeServer, 14},
     {"_httpuv_stopServer_", (DL_FUNC) &_httpuv_stopServer_, 1},
+    {"_httpuv_getConnectionStats_", (DL_FUNC) &_httpuv_getConnectionStats_, 1},
+    {"_httpuv_getServerStats_", (DL_FUNC) &_httpuv_getServerStats_, 1},
     {"_httpuv_getStaticPaths_", (DL_FUNC) &_httpuv_getStaticPaths_, 1},
     {"_httpuv_setStaticPaths_", (DL_FUNC) &_httpuv_setStaticPaths_, 2},
     {"_httpuv_removeStaticPaths_", (DL_FUNC) &_httpuv_removeStaticPaths_, 2},
     {"_httpuv_getStaticPathOptions_", (DL_FUNC) &_httpuv_getStaticPathOptions_, 1},
     {"_httpuv_setStaticPathOptions_", (DL_FUNC) &_httpuv_setStaticPathOptions_, 2},
+    {"_httpuv_getFixedResponses_", (DL_FUNC) &_httpuv_getFixedResponses_, 1},
+    {"_httpuv_setFixedResponse_", (DL_FUNC) &_httpuv_setFixedResponse_, 6},
+    {"_httpuv_removeFixedResponse_", (DL_FUNC) &_httpuv_removeFixedResponse_, 3},
+    {"_httpuv_getResponseCacheStats_", (DL_FUNC) &_httpuv_getResponseCacheStats_, 1},
+    {"_httpuv_purgeResponseCache_", (DL_FUNC) &_httpuv_purgeResponseCache_, 2},
+    {"_httpuv_getLoadSheddingStats_", (DL_FUNC) &_httpuv_getLoadSheddingStats_, 1},
+    {"_httpuv_getLatencyStats_", (DL_FUNC) &_httpuv_getLatencyStats_, 1},
+    {"_httpuv_resetLatencyStats_", (DL_FUNC) &_httpuv_resetLatencyStats_, 1},
+    {"_httpuv_startTracing_", (DL_FUNC) &_httpuv_startTracing_, 1},
+    {"_httpuv_stopTracing_", (DL_FUNC) &_httpuv_stopTracing_, 0},
+    {"_httpuv_writeTrace_", (DL_FUNC) &_httpuv_writeTrace_, 1},
     {"_httpuv_base64encode", (DL_FUNC) &_httpuv_base64encode, 1},
     {"_httpuv_encodeURI", (DL_FUNC) &_httpuv_encodeURI, 1},
     {"_httpuv_encodeURIComponent", (DL_FUNC) &_httpuv_encodeURIComponent, 1},
@@ -272,8 +574,8 @@ static const R_CallMethodDef CallEntries[] = {
     {"_httpuv_ipFamily", (DL_FUNC) &_httpuv_ipFamily, 1},
     {"_httpuv_invokeCppCallback", (DL_FUNC) &_httpuv_invokeCppCallback, 2},
     {"_httpuv_getRNGState", (DL_FUNC) &_httpuv_getRNGState, 0},
-    {"_httpuv_wsconn_address", (DL_FUNC) &_httpuv_wsconn_address, 1},
     {"_httpuv_log_level", (DL_FUNC) &_httpuv_log_level, 1},
+    {"_httpuv_getLogEvents_", (DL_FUNC) &_httpuv_getLogEvents_, 0},
     {NULL, NULL, 0}
 };
 
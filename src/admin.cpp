@@ -0,0 +1,159 @@
+#include "admin.h"
+#include "httprequest.h"
+#include "httpuv.h"
+#include "scheduler.h"
+#include "socket.h"
+#include "thread.h"
+#include "auto_deleter.h"
+#include "callbackqueue.h"
+#include <iomanip>
+#include <sstream>
+
+static void metric_header(std::ostream& out, const char* name,
+                          const char* type, const char* help)
+{
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string admin_metrics(Socket& socket, WebApplication& app) {
+  ASSERT_BACKGROUND_THREAD()
+  ServerCounters c = app.getServerStats().counters();
+  uint64_t connections = socket.connectionCount;
+  uint64_t http = connections > c.wsConnections ? connections - c.wsConnections : 0;
+
+  std::ostringstream out;
+  out << std::setprecision(9);
+
+  metric_header(out, "httpuv_connections", "gauge", "Open connections.");
+  out << "httpuv_connections{protocol=\"http\"} " << http << "\n";
+  out << "httpuv_connections{protocol=\"websocket\"} " << c.wsConnections << "\n";
+
+  metric_header(out, "httpuv_connections_accepted_total", "counter",
+    "Connections accepted.");
+  out << "httpuv_connections_accepted_total " << (uint64_t)socket.acceptedCount << "\n";
+  metric_header(out, "httpuv_accept_errors_total", "counter",
+    "Connections that couldn't be accepted because of an error.");
+  out << "httpuv_accept_errors_total " << (uint64_t)socket.acceptErrorCount << "\n";
+
+  metric_header(out, "httpuv_responses_total", "counter",
+    "HTTP responses, by class of status code.");
+  for (int i = 0; i < 5; i++) {
+    out << "httpuv_responses_total{code=\"" << (i + 1) << "xx\"} " << c.responses[i] << "\n";
+  }
+
+  metric_header(out, "httpuv_received_bytes_total", "counter", "Bytes read from clients.");
+  out << "httpuv_received_bytes_total " << c.bytesIn << "\n";
+  metric_header(out, "httpuv_sent_bytes_total", "counter", "Bytes written to clients.");
+  out << "httpuv_sent_bytes_total " << c.bytesOut << "\n";
+  metric_header(out, "httpuv_gzip_saved_bytes_total", "counter",
+    "Bytes of response bodies saved by gzip compression.");
+  out << "httpuv_gzip_saved_bytes_total " << c.gzipBytesSaved() << "\n";
+
+  metric_header(out, "httpuv_static_files_total", "counter",
+    "Requests for static paths, by result.");
+  out << "httpuv_static_files_total{result=\"hit\"} " << c.staticFiles[STATIC_HIT] << "\n";
+  out << "httpuv_static_files_total{result=\"miss\"} " << c.staticFiles[STATIC_MISS] << "\n";
+  out << "httpuv_static_files_total{result=\"fallthrough\"} " << c.staticFiles[STATIC_FALLTHROUGH] << "\n";
+
+  metric_header(out, "httpuv_websocket_frames_total", "counter",
+    "WebSocket frames, by direction.");
+  out << "httpuv_websocket_frames_total{direction=\"in\"} " << c.wsFramesIn << "\n";
+  out << "httpuv_websocket_frames_total{direction=\"out\"} " << c.wsFramesOut << "\n";
+
+  metric_header(out, "httpuv_requests_shed_total", "counter",
+    "Requests turned away because the main R thread was too far behind.");
+  out << "httpuv_requests_shed_total " << app.getLoadShedder().shedCount() << "\n";
+
+  // The queues and the event loop are shared by all servers.
+  metric_header(out, "httpuv_background_queue_length", "gauge",
+    "Tasks waiting for the background thread.");
+  out << "httpuv_background_queue_length " << background_queue->size() << "\n";
+  metric_header(out, "httpuv_main_queue_length", "gauge",
+    "Tasks waiting for the main R thread.");
+  out << "httpuv_main_queue_length " << main_thread_scheduler()->size() << "\n";
+  metric_header(out, "httpuv_main_queue_delay_seconds", "gauge",
+    "How long tasks have been waiting for the main R thread.");
+  out << "httpuv_main_queue_delay_seconds "
+      << main_thread_scheduler()->queueDelayMs() / 1000.0 << "\n";
+  metric_header(out, "httpuv_event_loop_lag_seconds", "gauge",
+    "How late the background thread's event loop was when last checked.");
+  out << "httpuv_event_loop_lag_seconds " << io_loop_lag() << "\n";
+
+  const RequestTimings& timings = app.getRequestTimings();
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  metric_header(out, "httpuv_request_phase_seconds", "summary",
+    "Time spent in each phase of handling requests.");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    const char* name = RequestTimings::phaseName((LatencyPhase)i);
+    const LatencyHistogram& h = timings.phase((LatencyPhase)i);
+    for (size_t j = 0; j < sizeof(quantiles) / sizeof(quantiles[0]); j++) {
+      out << "httpuv_request_phase_seconds{phase=\"" << name
+          << "\",quantile=\"" << quantiles[j] << "\"} "
+          << h.quantile(quantiles[j]) / 1e6 << "\n";
+    }
+    out << "httpuv_request_phase_seconds_sum{phase=\"" << name << "\"} "
+        << h.sum() / 1e6 << "\n";
+    out << "httpuv_request_phase_seconds_count{phase=\"" << name << "\"} "
+        << h.count() << "\n";
+  }
+
+  return out.str();
+}
+
+
+static void json_string(std::ostream& out, const std::string& value) {
+  out << '"';
+  for (size_t i = 0; i < value.size(); i++) {
+    unsigned char c = value[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c
+          << std::dec << std::setfill(' ');
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+std::string admin_connections(Socket& socket) {
+  ASSERT_BACKGROUND_THREAD()
+  uint64_t now = uv_hrtime();
+
+  std::ostringstream out;
+  out << std::setprecision(9) << "[";
+  for (size_t i = 0; i < socket.connections.size(); i++) {
+    HttpRequest& req = *socket.connections[i];
+    if (i > 0) {
+      out << ",";
+    }
+
+    out << "\n{\"remote\":";
+    Address address = req.clientAddress();
+    if (address.host.empty()) {
+      out << "null";
+    } else {
+      json_string(out, address.host + ":" + toString(address.port));
+    }
+    out << ",\"protocol\":" << (req.isWebSocket() ? "\"websocket\"" : "\"http\"");
+    out << ",\"age\":" << (now - req.connectedAt()) / 1e9;
+
+    if (req.isWebSocket()) {
+      out << ",\"buffered\":" << req.wsBufferedAmount();
+    } else if (req.isHandlingRequest()) {
+      // The query string is left out; it can hold things like tokens.
+      std::string url = req.url();
+      out << ",\"method\":";
+      json_string(out, req.method());
+      out << ",\"path\":";
+      json_string(out, url.substr(0, url.find('?')));
+      out << ",\"elapsed\":" << (now - req.timestamps().start) / 1e9;
+    }
+    out << "}";
+  }
+  out << "\n]\n";
+
+  return out.str();
+}
@@ -0,0 +1,18 @@
+#ifndef ADMIN_HPP
+#define ADMIN_HPP
+
+#include <string>
+
+class Socket;
+class WebApplication;
+
+// The pages under a server's admin path. They are made on the background
+// thread, from counters that it keeps, so they can be read while R is busy.
+
+// Metrics in the Prometheus text exposition format, version 0.0.4.
+std::string admin_metrics(Socket& socket, WebApplication& app);
+
+// A JSON array with an object for each of the server's open connections.
+std::string admin_connections(Socket& socket);
+
+#endif // ADMIN_HPP
@@ -31,6 +31,4 @@ public:
 
 };
 
-void invoke_later(std::function<void(void)> f, double secs = 0);
-
 #endif
@@ -2,6 +2,7 @@
 #include "callbackqueue.h"
 #include "tqueue.h"
 #include "thread.h"
+#include "trace.h"
 #include <uv.h>
 
 
@@ -21,12 +22,20 @@ CallbackQueue::CallbackQueue(uv_loop_t* loop) {
 
 
 void CallbackQueue::push(std::function<void (void)> cb) {
+  if (trace_enabled()) {
+    cb = trace_handoff(TRACE_BACKGROUND_QUEUE, cb);
+  }
   q.push(cb);
   uv_async_send(&flush_handle);
 }
 
+size_t CallbackQueue::size() {
+  return q.size();
+}
+
 void CallbackQueue::flush() {
   ASSERT_BACKGROUND_THREAD()
+  TraceSlice slice(TRACE_QUEUE_FLUSH);
   std::function<void (void)> cb;
 
   while (1) {
@@ -9,6 +9,8 @@ class CallbackQueue {
 public:
   CallbackQueue(uv_loop_t* loop);
   void push(std::function<void (void)> cb);
+  // The number of callbacks waiting to run. May be called from any thread.
+  size_t size();
   // Needs to be a friend to call .flush()
   friend void flush_callback_queue(uv_async_t *handle);
 
@@ -0,0 +1,77 @@
+#include "coalescer.h"
+#include "thread.h"
+
+RequestCoalescer::RequestCoalescer(const std::vector<std::string>& headers)
+  : _headers(headers), _coalesced(0)
+{
+}
+
+// Whether the configured headers include `name`.
+static bool hasHeaderName(const std::vector<std::string>& names, const char* name) {
+  for (size_t i = 0; i < names.size(); i++) {
+    if (strcasecmp(names[i].c_str(), name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RequestCoalescer::canCoalesce(const RequestHeaders& headers) const {
+  ASSERT_BACKGROUND_THREAD()
+  static const char* credentials[] = { "Authorization", "Cookie" };
+  for (size_t i = 0; i < sizeof(credentials) / sizeof(credentials[0]); i++) {
+    if (headers.find(credentials[i]) != headers.end() &&
+        !hasHeaderName(_headers, credentials[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string RequestCoalescer::key(const std::string& method,
+                                  const std::string& url,
+                                  const RequestHeaders& headers) const
+{
+  ASSERT_BACKGROUND_THREAD()
+  // The method and URL can't contain newlines, and the http-parser rejects
+  // header values that do, so they can be used as separators.
+  std::string result = method + "\n" + url;
+  for (size_t i = 0; i < _headers.size(); i++) {
+    RequestHeaders::const_iterator it = headers.find(_headers[i]);
+    result += "\n";
+    // Tell a missing header apart from an empty one.
+    if (it != headers.end()) {
+      result += "=";
+      result += it->second;
+    }
+  }
+  return result;
+}
+
+bool RequestCoalescer::join(const std::string& key,
+                            std::shared_ptr<HttpRequest> pRequest)
+{
+  ASSERT_BACKGROUND_THREAD()
+  std::map<std::string, std::vector<std::weak_ptr<HttpRequest> > >::iterator it =
+    _inFlight.find(key);
+  if (it == _inFlight.end()) {
+    _inFlight[key];
+    return false;
+  }
+  it->second.push_back(pRequest);
+  _coalesced++;
+  return true;
+}
+
+std::vector<std::weak_ptr<HttpRequest> > RequestCoalescer::finish(const std::string& key) {
+  ASSERT_BACKGROUND_THREAD()
+  std::vector<std::weak_ptr<HttpRequest> > waiters;
+  std::map<std::string, std::vector<std::weak_ptr<HttpRequest> > >::iterator it =
+    _inFlight.find(key);
+  if (it != _inFlight.end()) {
+    waiters.swap(it->second);
+    _inFlight.erase(it);
+  }
+  return waiters;
+}
@@ -0,0 +1,59 @@
+#ifndef COALESCER_HPP
+#define COALESCER_HPP
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+class HttpRequest;
+
+// Tracks the requests that are waiting on R, so that identical concurrent
+// requests can share one call into R (sometimes called "single-flight").
+// The first request with a given key is the leader: it goes to R as usual.
+// Requests with the same key that arrive before the leader's response is
+// ready join as waiters, and are answered with the leader's response.
+//
+// Everything except coalescedCount() happens on the background thread.
+class RequestCoalescer : NoCopy {
+  // The waiters for each key that is in flight. The waiters are weak
+  // pointers so that a waiting connection can close without leaking.
+  std::map<std::string, std::vector<std::weak_ptr<HttpRequest> > > _inFlight;
+  const std::vector<std::string> _headers;
+  // Number of requests that were answered by joining another request.
+  std::atomic<uint64_t> _coalesced;
+
+public:
+  explicit RequestCoalescer(const std::vector<std::string>& headers);
+
+  // Whether a request may be coalesced at all. Requests with credentials
+  // (Authorization or Cookie) are only coalesced if those headers are part
+  // of the key, so one client never gets a response made for another.
+  bool canCoalesce(const RequestHeaders& headers) const;
+
+  // The key for a request: its method and URL, and the values of the
+  // configured headers.
+  std::string key(const std::string& method,
+                  const std::string& url,
+                  const RequestHeaders& headers) const;
+
+  // If a request with the same key is in flight, add pRequest as one of its
+  // waiters and return true. Otherwise pRequest becomes the leader for the
+  // key and this returns false.
+  bool join(const std::string& key, std::shared_ptr<HttpRequest> pRequest);
+
+  // Called when the leader's response is ready. Returns the waiters, and
+  // forgets the key.
+  std::vector<std::weak_ptr<HttpRequest> > finish(const std::string& key);
+
+  size_t inFlightCount() const {
+    return _inFlight.size();
+  }
+  uint64_t coalescedCount() const {
+    return _coalesced;
+  }
+};
+
+#endif // COALESCER_HPP
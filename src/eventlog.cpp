@@ -0,0 +1,225 @@
+#include "eventlog.h"
+#include "thread.h"
+#include "http-parser/http_parser.h"
+#include <atomic>
+#include <uv.h>
+
+// How the integer arguments of an event are shown in its message.
+enum LogArg {
+  ARG_NONE,
+  ARG_INT,
+  // A libuv error code
+  ARG_UV_ERROR,
+  // An http_errno from http-parser
+  ARG_HTTP_ERRNO
+};
+
+struct LogEventInfo {
+  const char* name;
+  // {a} and {b} are replaced by the event's arguments.
+  const char* message;
+  LogArg a;
+  LogArg b;
+};
+
+static const LogEventInfo log_event_info[EV_COUNT] = {
+  { "request_created", "HttpRequest::HttpRequest", ARG_NONE, ARG_NONE },
+  { "request_destroyed", "HttpRequest::~HttpRequest", ARG_NONE, ARG_NONE },
+  { "message_begin", "HttpRequest::_on_message_begin", ARG_NONE, ARG_NONE },
+  { "url", "HttpRequest::_on_url", ARG_NONE, ARG_NONE },
+  { "status", "HttpRequest::_on_status", ARG_NONE, ARG_NONE },
+  { "header_field", "HttpRequest::_on_header_field", ARG_NONE, ARG_NONE },
+  { "header_value", "HttpRequest::_on_header_value", ARG_NONE, ARG_NONE },
+  { "headers_complete", "HttpRequest::_on_headers_complete", ARG_NONE, ARG_NONE },
+  { "schedule_headers_complete_complete",
+    "HttpRequest::_schedule_on_headers_complete_complete", ARG_NONE, ARG_NONE },
+  { "headers_complete_complete",
+    "HttpRequest::_on_headers_complete_complete", ARG_NONE, ARG_NONE },
+  { "body", "HttpRequest::_on_body: {a} bytes", ARG_INT, ARG_NONE },
+  { "schedule_body_error", "HttpRequest::_schedule_on_body_error", ARG_NONE, ARG_NONE },
+  { "body_error", "HttpRequest::_on_body_error", ARG_NONE, ARG_NONE },
+  { "message_complete", "HttpRequest::_on_message_complete", ARG_NONE, ARG_NONE },
+  { "message_complete_complete",
+    "HttpRequest::_on_message_complete_complete", ARG_NONE, ARG_NONE },
+  { "response_scheduled", "HttpRequest::responseScheduled", ARG_NONE, ARG_NONE },
+  { "request_completed", "HttpRequest::requestCompleted", ARG_NONE, ARG_NONE },
+  { "write_response", "HttpResponse::writeResponse: status {a}", ARG_INT, ARG_NONE },
+  { "response_written", "HttpResponse::onResponseWritten", ARG_NONE, ARG_NONE },
+  { "response_destroyed", "HttpResponse::~HttpResponse", ARG_NONE, ARG_NONE },
+  { "idle_timeout", "HttpRequest: idle timeout", ARG_NONE, ARG_NONE },
+  { "header_timeout", "HttpRequest: header timeout", ARG_NONE, ARG_NONE },
+  { "body_timeout", "HttpRequest: body timeout", ARG_NONE, ARG_NONE },
+  { "write_timeout", "HttpRequest: write timeout", ARG_NONE, ARG_NONE },
+  { "parse_error", "HttpRequest::_parse_http_data error: {a}", ARG_HTTP_ERRNO, ARG_NONE },
+  { "read_error", "HttpRequest::on_request_read error: {a}", ARG_UV_ERROR, ARG_NONE },
+  { "read_start_error",
+    "HttpRequest::handleRequest error: [uv_read_start] {a}", ARG_UV_ERROR, ARG_NONE },
+  { "write_error", "uv_write() error: {a}", ARG_UV_ERROR, ARG_NONE },
+  { "call_r_on_ws_open", "HttpRequest::_call_r_on_ws_open", ARG_NONE, ARG_NONE },
+  { "ws_message", "HttpRequest::onWSMessage: {a} bytes", ARG_INT, ARG_NONE },
+  { "ws_message_chunk", "HttpRequest::onWSMessageChunk: {a} bytes", ARG_INT, ARG_NONE },
+  { "ws_message_file", "HttpRequest::onWSMessageFile", ARG_NONE, ARG_NONE },
+  { "ws_close", "HttpRequest::onWSClose", ARG_NONE, ARG_NONE },
+  { "ws_send_frame", "HttpRequest::sendWSFrame: {a} bytes", ARG_INT, ARG_NONE },
+  { "ws_frames_sent", "on_ws_message_sent: {a} bytes", ARG_INT, ARG_NONE },
+  { "ws_write_error", "Error writing WebSocket frames: {a}", ARG_UV_ERROR, ARG_NONE },
+  { "ws_batch_flush", "WSMessageBatcher::flush: {a} messages", ARG_INT, ARG_NONE },
+  { "close_ws_socket", "HttpRequest::closeWSSocket", ARG_NONE, ARG_NONE },
+  { "schedule_close", "HttpRequest::schedule_close", ARG_NONE, ARG_NONE },
+  { "close", "HttpRequest::close", ARG_NONE, ARG_NONE },
+  { "close_twice", "close() called twice on HttpRequest object", ARG_NONE, ARG_NONE },
+  { "closed", "HttpRequest::_on_closed", ARG_NONE, ARG_NONE }
+};
+
+
+// The log is a ring buffer of slots that any thread can write to. A writer
+// claims the next slot by incrementing `log_head`, and marks the slot with
+// its position once it has been written, so that the reader can tell a
+// complete event from one that is still being written or has been
+// overwritten. When the buffer is full, the oldest events are overwritten.
+#define LOG_CAPACITY 4096
+
+struct LogSlot {
+  // The position of the event in the slot, plus one; 0 while it is being
+  // written. The other fields are atomic only so that reading a slot while
+  // it is being overwritten isn't undefined behavior.
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> time;
+  std::atomic<uint64_t> conn;
+  std::atomic<int64_t> a;
+  std::atomic<int64_t> b;
+  std::atomic<uint32_t> event;
+  std::atomic<uint32_t> level;
+};
+
+static LogSlot log_slots[LOG_CAPACITY];
+static std::atomic<uint64_t> log_head(0);
+// Only used by the main thread.
+static uint64_t log_tail = 0;
+static uint64_t log_dropped = 0;
+
+static std::string format_message(const LogEventInfo& info, int64_t a, int64_t b);
+
+void log_event_record(LogLevel level, LogEvent event, uint64_t conn,
+                      int64_t a, int64_t b)
+{
+  // Errors and timeouts are rare, so they are still printed as they happen.
+  // Only the DEBUG trace of each request is kept just in the log.
+  if (level != LOG_DEBUG) {
+    err_printf("%s\n", format_message(log_event_info[event], a, b).c_str());
+  }
+
+  uint64_t pos = log_head.fetch_add(1, std::memory_order_relaxed);
+  LogSlot& slot = log_slots[pos % LOG_CAPACITY];
+
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.time.store(uv_hrtime(), std::memory_order_relaxed);
+  slot.conn.store(conn, std::memory_order_relaxed);
+  slot.a.store(a, std::memory_order_relaxed);
+  slot.b.store(b, std::memory_order_relaxed);
+  slot.event.store(event, std::memory_order_relaxed);
+  slot.level.store(level, std::memory_order_relaxed);
+  slot.seq.store(pos + 1, std::memory_order_release);
+}
+
+
+static std::string format_arg(LogArg kind, int64_t value) {
+  switch (kind) {
+  case ARG_UV_ERROR:
+    return uv_strerror((int)value);
+  case ARG_HTTP_ERRNO:
+    return http_errno_description((enum http_errno)value);
+  default:
+    return toString(value);
+  }
+}
+
+static std::string format_message(const LogEventInfo& info, int64_t a, int64_t b) {
+  std::string message(info.message);
+  size_t i = message.find("{a}");
+  if (i != std::string::npos) {
+    message.replace(i, 3, format_arg(info.a, a));
+  }
+  i = message.find("{b}");
+  if (i != std::string::npos) {
+    message.replace(i, 3, format_arg(info.b, b));
+  }
+  return message;
+}
+
+static const char* level_name(uint32_t level) {
+  switch (level) {
+    case LOG_ERROR: return "ERROR";
+    case LOG_WARN:  return "WARN";
+    case LOG_INFO:  return "INFO";
+    case LOG_DEBUG: return "DEBUG";
+    default:        return "";
+  }
+}
+
+Rcpp::List log_events_drain() {
+  ASSERT_MAIN_THREAD()
+  using namespace Rcpp;
+
+  uint64_t head = log_head.load(std::memory_order_acquire);
+  if (head - log_tail > LOG_CAPACITY) {
+    log_dropped += head - LOG_CAPACITY - log_tail;
+    log_tail = head - LOG_CAPACITY;
+  }
+
+  // The times are recorded with uv_hrtime(), which isn't tied to the wall
+  // clock, so they are returned relative to now.
+  uint64_t now = uv_hrtime();
+
+  std::vector<double> age;
+  std::vector<std::string> level, event, message;
+  std::vector<double> conn;
+
+  uint64_t pos = log_tail;
+  for (; pos < head; pos++) {
+    LogSlot& slot = log_slots[pos % LOG_CAPACITY];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq < pos + 1) {
+      // Still being written; leave it and the events after it for next time.
+      break;
+    }
+    if (seq > pos + 1) {
+      log_dropped++;
+      continue;
+    }
+
+    uint64_t t = slot.time.load(std::memory_order_relaxed);
+    uint64_t c = slot.conn.load(std::memory_order_relaxed);
+    int64_t a = slot.a.load(std::memory_order_relaxed);
+    int64_t b = slot.b.load(std::memory_order_relaxed);
+    uint32_t ev = slot.event.load(std::memory_order_relaxed);
+    uint32_t lv = slot.level.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq || ev >= EV_COUNT) {
+      // Overwritten while it was being read.
+      log_dropped++;
+      continue;
+    }
+
+    const LogEventInfo& info = log_event_info[ev];
+    age.push_back(now > t ? (now - t) / 1e9 : 0);
+    level.push_back(level_name(lv));
+    event.push_back(info.name);
+    conn.push_back((double)c);
+    message.push_back(format_message(info, a, b));
+  }
+  log_tail = pos;
+
+  List result = List::create(
+    _["age"] = age,
+    _["level"] = level,
+    _["event"] = event,
+    _["connection"] = conn,
+    _["message"] = message,
+    // The number of events that were overwritten before they could be read.
+    _["dropped"] = (double)log_dropped
+  );
+  log_dropped = 0;
+  return result;
+}
@@ -0,0 +1,82 @@
+#ifndef EVENTLOG_HPP
+#define EVENTLOG_HPP
+
+#include "utils.h"
+#include <Rcpp.h>
+#include <stdint.h>
+
+// A log of structured events, for the messages that are logged on the
+// background thread's hot path. Instead of building a message string, each
+// event is recorded as an id, the id of its connection, and up to two
+// integers, in a ring buffer that doesn't take locks. Messages for DEBUG
+// events are only made when the log is read from R; events at other levels
+// are also printed, like debug_log() does. Like debug_log(), an event at a
+// level that is turned off costs one branch.
+//
+// To add an event, add it at the end of this enum and add its entry to
+// log_event_info in eventlog.cpp.
+enum LogEvent {
+  EV_REQUEST_CREATED,
+  EV_REQUEST_DESTROYED,
+  EV_MESSAGE_BEGIN,
+  EV_URL,
+  EV_STATUS,
+  EV_HEADER_FIELD,
+  EV_HEADER_VALUE,
+  EV_HEADERS_COMPLETE,
+  EV_SCHEDULE_HEADERS_COMPLETE_COMPLETE,
+  EV_HEADERS_COMPLETE_COMPLETE,
+  EV_BODY,
+  EV_SCHEDULE_BODY_ERROR,
+  EV_BODY_ERROR,
+  EV_MESSAGE_COMPLETE,
+  EV_MESSAGE_COMPLETE_COMPLETE,
+  EV_RESPONSE_SCHEDULED,
+  EV_REQUEST_COMPLETED,
+  EV_WRITE_RESPONSE,
+  EV_RESPONSE_WRITTEN,
+  EV_RESPONSE_DESTROYED,
+  EV_IDLE_TIMEOUT,
+  EV_HEADER_TIMEOUT,
+  EV_BODY_TIMEOUT,
+  EV_WRITE_TIMEOUT,
+  EV_PARSE_ERROR,
+  EV_READ_ERROR,
+  EV_READ_START_ERROR,
+  EV_WRITE_ERROR,
+  EV_CALL_R_ON_WS_OPEN,
+  EV_WS_MESSAGE,
+  EV_WS_MESSAGE_CHUNK,
+  EV_WS_MESSAGE_FILE,
+  EV_WS_CLOSE,
+  EV_WS_SEND_FRAME,
+  EV_WS_FRAMES_SENT,
+  EV_WS_WRITE_ERROR,
+  EV_WS_BATCH_FLUSH,
+  EV_CLOSE_WS_SOCKET,
+  EV_SCHEDULE_CLOSE,
+  EV_CLOSE,
+  EV_CLOSE_TWICE,
+  EV_CLOSED,
+  EV_COUNT
+};
+
+void log_event_record(LogLevel level, LogEvent event, uint64_t conn,
+                      int64_t a, int64_t b);
+
+// Record an event for connection `conn` (0 if it isn't for a connection).
+// What `a` and `b` mean depends on the event.
+inline void log_event(LogLevel level, LogEvent event, uint64_t conn = 0,
+                      int64_t a = 0, int64_t b = 0)
+{
+  if (log_enabled(level)) {
+    log_event_record(level, event, conn, a, b);
+  }
+}
+
+// Main thread. Removes the events from the log and returns them, with their
+// messages, as a list of columns. `age` is how many seconds ago each event
+// happened.
+Rcpp::List log_events_drain();
+
+#endif // EVENTLOG_HPP
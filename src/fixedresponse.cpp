@@ -0,0 +1,95 @@
+#include "fixedresponse.h"
+#include "utils.h"
+
+FixedResponse::FixedResponse(int status,
+                             const Rcpp::List& headers,
+                             const Rcpp::RawVector& body)
+  : status(status)
+{
+  ASSERT_MAIN_THREAD()
+  if (headers.size() > 0) {
+    Rcpp::CharacterVector names = headers.names();
+    for (R_len_t i = 0; i < headers.size(); i++) {
+      this->headers.push_back(std::make_pair(
+        Rcpp::as<std::string>(names[i]),
+        Rcpp::as<std::string>(headers[i])
+      ));
+    }
+  }
+  this->body = std::make_shared<const std::vector<uint8_t> >(body.begin(), body.end());
+}
+
+FixedResponseManager::FixedResponseManager() {
+  uv_mutex_init(&_mutex);
+}
+
+FixedResponseManager::~FixedResponseManager() {
+  uv_mutex_destroy(&_mutex);
+}
+
+std::shared_ptr<const FixedResponse> FixedResponseManager::get(
+  const std::string& method,
+  const std::string& path) const
+{
+  guard guard(_mutex);
+  if (_responses.empty()) {
+    return std::shared_ptr<const FixedResponse>();
+  }
+
+  std::map<Key, std::shared_ptr<const FixedResponse> >::const_iterator it =
+    _responses.find(Key(method, path));
+  if (it == _responses.end() && method == "HEAD") {
+    it = _responses.find(Key("GET", path));
+  }
+  if (it == _responses.end()) {
+    return std::shared_ptr<const FixedResponse>();
+  }
+  return it->second;
+}
+
+void FixedResponseManager::set(const std::string& method,
+                               const std::string& path,
+                               std::shared_ptr<const FixedResponse> pResponse)
+{
+  guard guard(_mutex);
+  _responses[Key(method, path)] = pResponse;
+}
+
+void FixedResponseManager::remove(const std::string& method, const std::string& path) {
+  guard guard(_mutex);
+  _responses.erase(Key(method, path));
+}
+
+Rcpp::List FixedResponseManager::asRObject() const {
+  ASSERT_MAIN_THREAD()
+  // Copy the pointers, so that the R objects aren't created while the lock
+  // is held.
+  std::map<Key, std::shared_ptr<const FixedResponse> > responses;
+  {
+    guard guard(_mutex);
+    responses = _responses;
+  }
+
+  using namespace Rcpp;
+  List obj(responses.size());
+  std::map<Key, std::shared_ptr<const FixedResponse> >::const_iterator it;
+  R_len_t i = 0;
+  for (it = responses.begin(); it != responses.end(); it++, i++) {
+    const FixedResponse& response = *it->second;
+    List headers;
+    ResponseHeaders::const_iterator h;
+    for (h = response.headers.begin(); h != response.headers.end(); h++) {
+      headers[h->first] = h->second;
+    }
+
+    obj[i] = List::create(
+      _["method"]  = it->first.first,
+      _["path"]    = it->first.second,
+      _["status"]  = response.status,
+      _["headers"] = headers,
+      _["body"]    = RawVector(response.body->begin(), response.body->end())
+    );
+  }
+
+  return obj;
+}
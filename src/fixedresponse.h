@@ -0,0 +1,56 @@
+#ifndef FIXEDRESPONSE_HPP
+#define FIXEDRESPONSE_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <uv.h>
+#include <Rcpp.h>
+#include "constants.h"
+#include "thread.h"
+
+// A response that doesn't depend on the request, like the one for a health
+// check or a robots.txt file. It's answered on the background thread without
+// calling into R. The body is shared by all of the responses that send it.
+class FixedResponse {
+public:
+  int status;
+  ResponseHeaders headers;
+  std::shared_ptr<const std::vector<uint8_t> > body;
+
+  FixedResponse(int status,
+                const Rcpp::List& headers,
+                const Rcpp::RawVector& body);
+};
+
+
+// The fixed responses for a server, keyed by method and path. They are set
+// and removed from the main thread, and looked up from the background thread.
+// Replacing a response swaps a pointer, so a request gets either the old
+// response or the new one, never a mix of the two.
+class FixedResponseManager {
+  typedef std::pair<std::string, std::string> Key;
+
+  std::map<Key, std::shared_ptr<const FixedResponse> > _responses;
+  // Mutex is used whenever _responses is accessed.
+  mutable uv_mutex_t _mutex;
+
+public:
+  FixedResponseManager();
+  ~FixedResponseManager();
+
+  // Returns an empty pointer if there's no response for the method and path.
+  // A HEAD request gets the response for GET.
+  std::shared_ptr<const FixedResponse> get(const std::string& method,
+                                           const std::string& path) const;
+
+  void set(const std::string& method,
+           const std::string& path,
+           std::shared_ptr<const FixedResponse> pResponse);
+  void remove(const std::string& method, const std::string& path);
+
+  Rcpp::List asRObject() const;
+};
+
+#endif // FIXEDRESPONSE_HPP
@@ -1,11 +1,16 @@
 #include "fs.h"
 #include "utils.h"
 
+#include <fcntl.h>
+
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#include <sys/stat.h>
 #include "winutils.h"
 #else
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include <iostream>
@@ -61,3 +66,34 @@ bool is_directory(const std::string &filename) {
 
 #endif
 }
+
+
+// Create a new file for writing that only the current user can read, and
+// open it in binary mode. Fails (returning NULL) if anything, including a
+// symlink, already exists at `path`, so that a file can't be written
+// somewhere else by planting a link where it will be created. `path` is
+// assumed to be UTF-8.
+FILE* create_private_file(const std::string &path) {
+#ifdef _WIN32
+  int fd = _wopen(utf8ToWide(path).c_str(),
+    _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+  if (fd == -1) {
+    return NULL;
+  }
+  FILE* file = _fdopen(fd, "wb");
+  if (!file) {
+    _close(fd);
+  }
+  return file;
+#else
+  int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+  if (fd == -1) {
+    return NULL;
+  }
+  FILE* file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+  }
+  return file;
+#endif
+}
@@ -1,6 +1,7 @@
 #ifndef FS_H
 #define FS_H
 
+#include <stdio.h>
 #include <string>
 
 std::string basename(const std::string &path);
@@ -9,4 +10,6 @@ std::string find_extension(const std::string &filename);
 
 bool is_directory(const std::string &filename);
 
+FILE* create_private_file(const std::string &path);
+
 #endif
@@ -23,6 +23,14 @@ public:
   void freeData(uv_buf_t buffer);
   void close();
 
+  // The number of bytes compressed so far, and what they compressed to.
+  uint64_t bytesIn() const {
+    return _zstrm.total_in;
+  }
+  uint64_t bytesOut() const {
+    return _zstrm.total_out;
+  }
+
 private:
   void deflateNext();
   bool freeInputBuffer(bool force = false);
@@ -0,0 +1,48 @@
+#include "headercollector.h"
+
+void HeaderCollector::onField(const char* pAt, size_t length) {
+  if (_state != FIELD) {
+    _state = FIELD;
+    _lastField.clear();
+  }
+
+  _lastField.append(pAt, length);
+}
+
+void HeaderCollector::onValue(RequestHeaders& headers, const char* pAt, size_t length) {
+  std::string value(pAt, length);
+
+  if (_state != VALUE) {
+    _state = VALUE;
+
+    if (headers.find(_lastField) != headers.end()) {
+      // If the field already exists. This can happen if there are multiple
+      // headers with the same name, as in:
+      //   foo: 1
+      //   foo: 2
+
+      if (headers[_lastField].size() > 0) {
+        // ...and is already non-empty...
+
+        if (value.size() > 0) {
+          // ...and this value is also non-empty, then combine using comma...
+          value = headers[_lastField] + "," + value;
+        } else {
+          // ...but if this value is empty, then use previous value (no-op).
+          value = headers[_lastField];
+        }
+      }
+    }
+
+    headers[_lastField] = value;
+
+  } else {
+    // This is a subsequent call to this function when the http parser receives
+    // another chunk of data for the same field. This can happen when there are
+    // very large headers, as in:
+    //   foo: 1234............5678
+    // where the "...." is so long that it gets split across TCP messages.
+
+    headers[_lastField].append(value);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef HEADERCOLLECTOR_HPP
+#define HEADERCOLLECTOR_HPP
+
+#include <string>
+#include "constants.h"
+
+// Collects the header fields and values that http-parser reports into a
+// RequestHeaders map. This needs to keep track of state because sometimes
+// the header fields and values can be split across multiple TCP messages,
+// resulting in multiple calls to onField() or onValue() for one header.
+class HeaderCollector {
+  enum LastHeaderState
+  {
+    START,
+    FIELD,
+    VALUE
+  };
+  LastHeaderState _state;
+  std::string _lastField;
+
+public:
+  HeaderCollector() : _state(START) {
+  }
+
+  // Called at the start of each request.
+  void reset() {
+    _state = START;
+  }
+  // Frees the memory used for the last field.
+  void release() {
+    std::string().swap(_lastField);
+  }
+
+  void onField(const char* pAt, size_t length);
+  void onValue(RequestHeaders& headers, const char* pAt, size_t length);
+};
+
+#endif // HEADERCOLLECTOR_HPP
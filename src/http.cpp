@@ -14,34 +14,13 @@
 #include <memory>
 
 
-// TODO: Streaming response body (with chunked transfer encoding)
 // TODO: Fast/easy use of files as response body
 
 void on_request(uv_stream_t* handle, int status) {
   ASSERT_BACKGROUND_THREAD()
-  if (status) {
-    err_printf("connection error: %s\n", uv_strerror(status));
-    return;
-  }
-
   // Copy the shared_ptr
   std::shared_ptr<Socket> pSocket(*(std::shared_ptr<Socket>*)handle->data);
-  CallbackQueue* bg_queue = pSocket->background_queue;
-
-  // Freed by HttpRequest itself when close() is called, which
-  // can occur on EOF, error, or when the Socket is destroyed
-  std::shared_ptr<HttpRequest> req = createHttpRequest(
-    handle->loop, pSocket->pWebApplication, pSocket, bg_queue
-  );
-
-  int r = uv_accept(handle, req->handle());
-  if (r) {
-    err_printf("accept: %s\n", uv_strerror(r));
-    return;
-  }
-
-  req->handleRequest();
-
+  pSocket->onConnection(status);
 }
 
 uv_stream_t* createPipeServer(
@@ -83,7 +62,8 @@ uv_stream_t* createPipeServer(
     pSocket->close();
     return NULL;
   }
-  r = uv_listen((uv_stream_t*)&pSocket->handle.stream, 128, &on_request);
+  r = uv_listen((uv_stream_t*)&pSocket->handle.stream,
+                pWebApplication->getServerOptions().listen_backlog, &on_request);
   if (r) {
     if (!quiet)
       err_printf("createPipeServer: %s\n", uv_strerror(r));
@@ -175,7 +155,8 @@ uv_stream_t* createTcpServer(
     pSocket->close();
     return NULL;
   }
-  r = uv_listen((uv_stream_t*)&pSocket->handle.stream, 128, &on_request);
+  r = uv_listen((uv_stream_t*)&pSocket->handle.stream,
+                pWebApplication->getServerOptions().listen_backlog, &on_request);
   if (r) {
     if (!quiet)
       err_printf("createTcpServer: %s\n", uv_strerror(r));
@@ -2,10 +2,11 @@
 #include <memory>
 #include "httprequest.h"
 #include <later_api.h>
-#include "callback.h"
+#include "scheduler.h"
 #include "utils.h"
 #include "thread.h"
 #include "auto_deleter.h"
+#include "trace.h"
 
 
 http_parser_settings& request_settings() {
@@ -29,6 +30,12 @@ void on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
   *buf = uv_buf_init((char*)result, suggested_size);
 }
 
+uint64_t HttpRequest::nextId() {
+  ASSERT_BACKGROUND_THREAD()
+  static uint64_t lastId = 0;
+  return ++lastId;
+}
+
 // Does a header field `name` exist?
 bool HttpRequest::hasHeader(const std::string& name) const {
   return _headers.find(name) != _headers.end();
@@ -123,6 +130,34 @@ Address HttpRequest::clientAddress() {
   return address;
 }
 
+bool HttpRequest::isLocal() {
+  // Connections to a pipe server always come from this machine.
+  if (!_pSocket->handle.isTcp) {
+    return true;
+  }
+
+  struct sockaddr_storage addr;
+  memset(&addr, 0, sizeof(addr));
+  int len = sizeof(addr);
+  if (uv_tcp_getpeername(&_handle.tcp, (struct sockaddr*)&addr, &len)) {
+    return false;
+  }
+
+  if (addr.ss_family == AF_INET) {
+    const struct sockaddr_in* pAddr = (const struct sockaddr_in*)&addr;
+    return (ntohl(pAddr->sin_addr.s_addr) >> 24) == 127;
+  }
+  if (addr.ss_family == AF_INET6) {
+    const unsigned char* bytes = ((const struct sockaddr_in6*)&addr)->sin6_addr.s6_addr;
+    static const unsigned char loopback[16] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1};
+    // An IPv4 loopback address mapped to IPv6, as in ::ffff:127.0.0.1
+    static const unsigned char v4mapped[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+    return memcmp(bytes, loopback, 16) == 0 ||
+      (memcmp(bytes, v4mapped, 12) == 0 && bytes[12] == 127);
+  }
+  return false;
+}
+
 // Each HttpRequest object represents a connection. Multiple actual HTTP
 // requests can happen in sequence on this connection. Each time a new message
 // starts, we need to reset some parts of the HttpRequest object.
@@ -137,13 +172,9 @@ void HttpRequest::_newRequest() {
   _handling_request = true;
   _headers.clear();
   _response_scheduled = false;
-  _last_header_state = START;
-
-  // Schedule on main thread:
-  //   this->_initializeEnv();
-  invoke_later(
-    std::bind(&HttpRequest::_initializeEnv, shared_from_this())
-  );
+  _headerCollector.reset();
+  _timestamps = RequestTimestamps();
+  _timestamps.start = uv_hrtime();
 }
 
 void HttpRequest::_initializeEnv() {
@@ -163,6 +194,14 @@ void HttpRequest::_initializeEnv() {
   );
 }
 
+void HttpRequest::_releaseHttpState() {
+  ASSERT_BACKGROUND_THREAD()
+  RequestHeaders().swap(_headers);
+  std::string().swap(_url);
+  _headerCollector.release();
+  std::vector<char>().swap(_requestBuffer);
+}
+
 Rcpp::Environment& HttpRequest::env() {
   ASSERT_MAIN_THREAD()
   return *_env;
@@ -182,7 +221,7 @@ const RequestHeaders& HttpRequest::headers() const {
 
 void HttpRequest::responseScheduled() {
   ASSERT_MAIN_THREAD()
-  debug_log("HttpRequest::responseScheduled", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_RESPONSE_SCHEDULED, _id);
   _response_scheduled = true;
 }
 
@@ -191,10 +230,117 @@ bool HttpRequest::isResponseScheduled() {
   return _response_scheduled;
 }
 
+void HttpRequest::recordTimings(const RequestTimestamps& timestamps) {
+  ASSERT_BACKGROUND_THREAD()
+  _pWebApplication->getRequestTimings().record(timestamps);
+}
+
+ServerStats& HttpRequest::serverStats() {
+  return _pWebApplication->getServerStats();
+}
+
 void HttpRequest::requestCompleted() {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::requestCompleted", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_REQUEST_COMPLETED, _id);
   _handling_request = false;
+
+  if (!isUpgrade()) {
+    _setReadTimeout(READ_TIMEOUT_IDLE);
+  }
+}
+
+
+// ============================================================================
+// Timeouts
+// ============================================================================
+
+void HttpRequest::_setReadTimeout(ReadTimeout readTimeout) {
+  ASSERT_BACKGROUND_THREAD()
+  const ServerOptions& options = _pWebApplication->getServerOptions();
+
+  uint64_t timeoutMs = 0;
+  switch (readTimeout) {
+  case READ_TIMEOUT_IDLE:
+    timeoutMs = options.idle_timeout_ms;
+    break;
+  case READ_TIMEOUT_HEADERS:
+    timeoutMs = options.header_timeout_ms;
+    break;
+  case READ_TIMEOUT_BODY:
+    timeoutMs = options.body_timeout_ms;
+    break;
+  case READ_TIMEOUT_NONE:
+    break;
+  }
+
+  _readTimeout = readTimeout;
+  if (timeoutMs == 0 || _is_closing) {
+    _readTimer.cancel();
+  } else {
+    TimerWheel::forLoop(_pLoop)->start(&_readTimer, timeoutMs);
+  }
+}
+
+void HttpRequest::_on_read_timeout() {
+  ASSERT_BACKGROUND_THREAD()
+
+  if (_readTimeout == READ_TIMEOUT_IDLE && (_activeWrites > 0 || _pWritingBody)) {
+    // The previous response is still being sent, so the connection isn't
+    // idle yet. If the write is stuck, the write timeout will catch it.
+    _setReadTimeout(READ_TIMEOUT_IDLE);
+    return;
+  }
+
+  LogEvent event = EV_IDLE_TIMEOUT;
+  if (_readTimeout == READ_TIMEOUT_HEADERS) {
+    event = EV_HEADER_TIMEOUT;
+  } else if (_readTimeout == READ_TIMEOUT_BODY) {
+    event = EV_BODY_TIMEOUT;
+  }
+  log_event(LOG_INFO, event, _id);
+  close();
+}
+
+void HttpRequest::writeStarted() {
+  ASSERT_BACKGROUND_THREAD()
+  uint64_t timeoutMs = _pWebApplication->getServerOptions().write_timeout_ms;
+  // Once closeWSSocket() has set a deadline, it's left alone.
+  if (_activeWrites++ == 0 && timeoutMs != 0 && !_is_closing &&
+      !_wsCloseWhenWritten) {
+    TimerWheel::forLoop(_pLoop)->start(&_writeTimer, timeoutMs);
+  }
+}
+
+void HttpRequest::writeFinished() {
+  ASSERT_BACKGROUND_THREAD()
+  uint64_t timeoutMs = _pWebApplication->getServerOptions().write_timeout_ms;
+  _activeWrites--;
+  if (_wsCloseWhenWritten) {
+    // closeWSSocket() has set a deadline for the rest of the writes.
+    return;
+  }
+  if (_activeWrites > 0 && timeoutMs != 0 && !_is_closing) {
+    // Progress has been made; give the rest of the data a full timeout.
+    TimerWheel::forLoop(_pLoop)->start(&_writeTimer, timeoutMs);
+  } else {
+    _writeTimer.cancel();
+  }
+}
+
+void HttpRequest::bodyWriteStarted(std::shared_ptr<DataSource> pBody) {
+  ASSERT_BACKGROUND_THREAD()
+  _pWritingBody = pBody;
+}
+
+void HttpRequest::bodyWriteFinished() {
+  ASSERT_BACKGROUND_THREAD()
+  _pWritingBody.reset();
+}
+
+void HttpRequest::_on_write_timeout() {
+  ASSERT_BACKGROUND_THREAD()
+  log_event(LOG_INFO, EV_WRITE_TIMEOUT, _id);
+  close();
 }
 
 
@@ -204,76 +350,37 @@ void HttpRequest::requestCompleted() {
 
 int HttpRequest::_on_message_begin(http_parser* pParser) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_message_begin", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_MESSAGE_BEGIN, _id);
+  _setReadTimeout(READ_TIMEOUT_HEADERS);
   _newRequest();
   return 0;
 }
 
 int HttpRequest::_on_url(http_parser* pParser, const char* pAt, size_t length) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_url", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_URL, _id);
   _url = std::string(pAt, length);
   return 0;
 }
 
 int HttpRequest::_on_status(http_parser* pParser, const char* pAt, size_t length) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_status", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_STATUS, _id);
   return 0;
 }
 int HttpRequest::_on_header_field(http_parser* pParser, const char* pAt, size_t length) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_header_field", LOG_DEBUG);
-
-  if (_last_header_state != FIELD) {
-    _last_header_state = FIELD;
-    _lastHeaderField.clear();
-  }
+  log_event(LOG_DEBUG, EV_HEADER_FIELD, _id);
 
-  std::copy(pAt, pAt + length, std::back_inserter(_lastHeaderField));
+  _headerCollector.onField(pAt, length);
   return 0;
 }
 
 int HttpRequest::_on_header_value(http_parser* pParser, const char* pAt, size_t length) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_header_value", LOG_DEBUG);
-
-  std::string value(pAt, length);
-
-  if (_last_header_state != VALUE) {
-    _last_header_state = VALUE;
-
-    if (_headers.find(_lastHeaderField) != _headers.end()) {
-      // If the field already exists. This can happen if there are multiple
-      // headers with the same name, as in:
-      //   foo: 1
-      //   foo: 2
-
-      if (_headers[_lastHeaderField].size() > 0) {
-        // ...and is already non-empty...
-
-        if (value.size() > 0) {
-          // ...and this value is also non-empty, then combine using comma...
-          value = _headers[_lastHeaderField] + "," + value;
-        } else {
-          // ...but if this value is empty, then use previous value (no-op).
-          value = _headers[_lastHeaderField];
-        }
-      }
-    }
-
-    _headers[_lastHeaderField] = value;
-
-  } else {
-    // This is a subsequent call to this function when the http parser receives
-    // another chunk of data for the same field. This can happen when there are
-    // very large headers, as in:
-    //   foo: 1234............5678
-    // where the "...." is so long that it gets split across TCP messages.
-
-    _headers[_lastHeaderField].append(value);
-  }
+  log_event(LOG_DEBUG, EV_HEADER_VALUE, _id);
 
+  _headerCollector.onValue(_headers, pAt, length);
   return 0;
 }
 
@@ -317,16 +424,33 @@ bool HttpRequest::isUpgrade() const {
 // http_parser_execute() again.
 int HttpRequest::_on_headers_complete(http_parser* pParser) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_headers_complete", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_HEADERS_COMPLETE, _id);
+  _timestamps.headersComplete = uv_hrtime();
   updateUpgradeStatus();
+  // No timeout while the application decides what to do with the request.
+  _setReadTimeout(READ_TIMEOUT_NONE);
 
-  // Attempt static serving here. If the request is for a static path, this
-  // will be a response object; if not, it will be an empty shared_ptr.
+  // Pages under the admin path are made here, so that they don't wait for R.
   std::shared_ptr<HttpResponse> pResponse =
-    _pWebApplication->staticFileResponse(shared_from_this());
+    _pWebApplication->adminResponse(shared_from_this());
+  if (!pResponse) {
+    // Attempt static serving here. If the request is for a fixed response or
+    // a static path, this will be a response object; if not, it will be an
+    // empty shared_ptr.
+    pResponse = _pWebApplication->staticFileResponse(shared_from_this());
+  }
+  if (!pResponse) {
+    // A response from R that it said could be reused.
+    pResponse = _pWebApplication->cachedResponse(shared_from_this());
+  }
+  if (!pResponse) {
+    // A 503 if R is too far behind to take on more work.
+    pResponse = _pWebApplication->shedResponse(shared_from_this());
+  }
 
   if (pResponse) {
-    // The request was for a static path. Skip over the webapplication code
+    // The request was for an admin page, a static path or a cached
+    // response, or it was turned away. Skip over the webapplication code
     // (which calls back into R on the main thread). Just add a call to
     // _on_headers_complete_complete to the queue on the background thread.
     std::function<void (void)> cb(
@@ -337,6 +461,15 @@ int HttpRequest::_on_headers_complete(http_parser* pParser) {
   }
 
 
+  // The request is going to R, so it needs an environment. This is only
+  // scheduled now, so that requests answered above never cost the main
+  // thread anything. The connection's items run in order, so the environment
+  // is ready before onHeaders() runs.
+  //   this->_initializeEnv();
+  invoke_main(this, PRIORITY_NORMAL,
+    std::bind(&HttpRequest::_initializeEnv, shared_from_this())
+  );
+
   std::function<void(std::shared_ptr<HttpResponse>)> schedule_bg_callback(
     std::bind(&HttpRequest::_schedule_on_headers_complete_complete, shared_from_this(), std::placeholders::_1)
   );
@@ -344,7 +477,7 @@ int HttpRequest::_on_headers_complete(http_parser* pParser) {
   // Use later to schedule _pWebApplication->onHeaders(this, schedule_bg_callback)
   // to run on the main thread. That function in turn calls
   // this->_schedule_on_headers_complete_complete.
-  invoke_later(
+  invoke_main(this, PRIORITY_NORMAL,
     std::bind(
       &WebApplication::onHeaders,
       _pWebApplication,
@@ -361,7 +494,7 @@ int HttpRequest::_on_headers_complete(http_parser* pParser) {
 // something there.
 void HttpRequest::_schedule_on_headers_complete_complete(std::shared_ptr<HttpResponse> pResponse) {
   ASSERT_MAIN_THREAD()
-  debug_log("HttpRequest::_schedule_on_headers_complete_complete", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_SCHEDULE_HEADERS_COMPLETE_COMPLETE, _id);
 
   if (pResponse)
     responseScheduled();
@@ -377,7 +510,7 @@ void HttpRequest::_schedule_on_headers_complete_complete(std::shared_ptr<HttpRes
 // http-parser and then re-executes the parser. Runs on the background thread.
 void HttpRequest::_on_headers_complete_complete(std::shared_ptr<HttpResponse> pResponse) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_headers_complete_complete", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_HEADERS_COMPLETE_COMPLETE, _id);
 
   int result = 0;
 
@@ -422,6 +555,12 @@ void HttpRequest::_on_headers_complete_complete(std::shared_ptr<HttpResponse> pR
     }
   }
 
+  // Wait for the body, if there is one. If there isn't, the read timeout is
+  // cleared again by _on_message_complete() as the buffer is parsed.
+  if (result == 0 && !isUpgrade()) {
+    _setReadTimeout(READ_TIMEOUT_BODY);
+  }
+
   // Tell the parser what the result was and that it can move on.
   http_parser_headers_completed(&(this->_parser), result);
 
@@ -436,7 +575,8 @@ void HttpRequest::_on_headers_complete_complete(std::shared_ptr<HttpResponse> pR
 
 int HttpRequest::_on_body(http_parser* pParser, const char* pAt, size_t length) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_body", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_BODY, _id, length);
+  _setReadTimeout(READ_TIMEOUT_BODY);
 
   // Copy pAt because the source data is deleted right after calling this
   // function.
@@ -448,7 +588,7 @@ int HttpRequest::_on_body(http_parser* pParser, const char* pAt, size_t length)
 
   // Schedule on main thread:
   // _pWebApplication->onBodyData(this, pAt, length, schedule_bg_callback);
-  invoke_later(
+  invoke_main(this, PRIORITY_BULK,
     std::bind(
       &WebApplication::onBodyData,
       _pWebApplication,
@@ -463,7 +603,7 @@ int HttpRequest::_on_body(http_parser* pParser, const char* pAt, size_t length)
 
 void HttpRequest::_schedule_on_body_error(std::shared_ptr<HttpResponse> pResponse) {
   ASSERT_MAIN_THREAD()
-  debug_log("HttpRequest::_schedule_on_body_error", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_SCHEDULE_BODY_ERROR, _id);
 
   responseScheduled();
 
@@ -476,7 +616,7 @@ void HttpRequest::_schedule_on_body_error(std::shared_ptr<HttpResponse> pRespons
 
 void HttpRequest::_on_body_error(std::shared_ptr<HttpResponse> pResponse) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_body_error", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_BODY_ERROR, _id);
 
   http_parser_pause(&_parser, 1);
 
@@ -494,11 +634,34 @@ void HttpRequest::_on_body_error(std::shared_ptr<HttpResponse> pResponse) {
 
 int HttpRequest::_on_message_complete(http_parser* pParser) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_message_complete", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_MESSAGE_COMPLETE, _id);
+  _setReadTimeout(READ_TIMEOUT_NONE);
 
   if (isUpgrade())
     return 0;
 
+  // If an identical request is already waiting on R, wait for its response
+  // instead of calling R again.
+  if (_pWebApplication->getServerOptions().coalesce &&
+      method() == "GET" &&
+      !hasHeader("Content-Length") && !hasHeader("Transfer-Encoding") &&
+      _pWebApplication->getRequestCoalescer().canCoalesce(headers()))
+  {
+    RequestCoalescer& coalescer = _pWebApplication->getRequestCoalescer();
+    std::string key = coalescer.key(method(), url(), headers());
+    if (coalescer.join(key, shared_from_this())) {
+      return 0;
+    }
+    _coalesceKey = key;
+  }
+
+  _scheduleGetResponse();
+  return 0;
+}
+
+void HttpRequest::_scheduleGetResponse() {
+  ASSERT_BACKGROUND_THREAD()
+
   std::function<void(std::shared_ptr<HttpResponse>)> schedule_bg_callback(
     std::bind(&HttpRequest::_schedule_on_message_complete_complete, shared_from_this(), std::placeholders::_1)
   );
@@ -506,7 +669,8 @@ int HttpRequest::_on_message_complete(http_parser* pParser) {
   // Use later to schedule _pWebApplication->getResponse(this, schedule_bg_callback)
   // to run on the main thread. That function in turn calls
   // this->_schedule_on_message_complete_complete.
-  invoke_later(
+  _timestamps.queued = uv_hrtime();
+  invoke_main(this, PRIORITY_NORMAL,
     std::bind(
       &WebApplication::getResponse,
       _pWebApplication,
@@ -514,8 +678,6 @@ int HttpRequest::_on_message_complete(http_parser* pParser) {
       schedule_bg_callback
     )
   );
-
-  return 0;
 }
 
 // This is called by the user's application code during or after the end of
@@ -533,7 +695,12 @@ void HttpRequest::_schedule_on_message_complete_complete(std::shared_ptr<HttpRes
 
 void HttpRequest::_on_message_complete_complete(std::shared_ptr<HttpResponse> pResponse) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_message_complete_complete", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_MESSAGE_COMPLETE_COMPLETE, _id);
+  _timestamps.resumed = uv_hrtime();
+
+  if (!_coalesceKey.empty()) {
+    _answerCoalescedRequests(pResponse);
+  }
 
   // This can happen if an error occured in WebApplication::onBodyData.
   if (pResponse == NULL) {
@@ -556,19 +723,104 @@ void HttpRequest::_on_message_complete_complete(std::shared_ptr<HttpResponse> pR
   pResponse->writeResponse();
 }
 
+// Whether a response header marks the response as meant for one client only,
+// so it mustn't be given to other clients.
+static bool isPrivateHeader(const std::pair<std::string, std::string>& header) {
+  if (strcasecmp(header.first.c_str(), "Set-Cookie") == 0) {
+    return true;
+  }
+  if (strcasecmp(header.first.c_str(), "Cache-Control") == 0) {
+    std::string value = to_lower(header.second);
+    return value.find("private") != std::string::npos ||
+      value.find("no-store") != std::string::npos;
+  }
+  return false;
+}
+
+// Whether two requests have the same values for the named headers.
+static bool sameHeaderValues(const RequestHeaders& a, const RequestHeaders& b,
+                             const std::vector<std::string>& names) {
+  for (size_t i = 0; i < names.size(); i++) {
+    RequestHeaders::const_iterator itA = a.find(names[i]);
+    RequestHeaders::const_iterator itB = b.find(names[i]);
+    bool hasA = itA != a.end();
+    bool hasB = itB != b.end();
+    if (hasA != hasB || (hasA && itA->second != itB->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Send this request's response to the requests that were waiting for it. This
+// is only possible if the body is in memory and can be shared, and the
+// response isn't private to one client. Otherwise (for example, if R returned
+// a file or set a cookie, or failed), each waiting request goes to R. So does
+// a waiting request whose headers differ from this one's in a header that
+// the response's Vary header names.
+void HttpRequest::_answerCoalescedRequests(std::shared_ptr<HttpResponse> pResponse) {
+  ASSERT_BACKGROUND_THREAD()
+
+  std::vector<std::weak_ptr<HttpRequest> > waiters =
+    _pWebApplication->getRequestCoalescer().finish(_coalesceKey);
+  _coalesceKey.clear();
+
+  std::shared_ptr<SharedBufferDataSource> pBody;
+  ResponseHeaders headers;
+  std::vector<std::string> varyNames;
+  if (pResponse) {
+    pBody = std::dynamic_pointer_cast<SharedBufferDataSource>(pResponse->body());
+    // Each response gets its own Date header.
+    const ResponseHeaders& responseHeaders = pResponse->headers();
+    for (ResponseHeaders::const_iterator it = responseHeaders.begin();
+         it != responseHeaders.end();
+         it++)
+    {
+      if (isPrivateHeader(*it)) {
+        pBody.reset();
+        break;
+      }
+      if (strcasecmp(it->first.c_str(), "Vary") == 0 &&
+          !parse_vary(it->second, &varyNames))
+      {
+        // "Vary: *" means that no other request can be given this response.
+        pBody.reset();
+        break;
+      }
+      if (strcasecmp(it->first.c_str(), "Date") != 0) {
+        headers.push_back(*it);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < waiters.size(); i++) {
+    std::shared_ptr<HttpRequest> pWaiter = waiters[i].lock();
+    if (!pWaiter || pWaiter->_is_closing) {
+      continue;
+    }
+    if (pBody && sameHeaderValues(pWaiter->headers(), this->headers(), varyNames)) {
+      pWaiter->_on_message_complete_complete(shared_body_response(
+        pWaiter, pResponse->statusCode(), headers, pBody->buffer()
+      ));
+    } else {
+      pWaiter->_scheduleGetResponse();
+    }
+  }
+}
 
 // ============================================================================
 // Incoming websocket messages
 // ============================================================================
 
 // Called from WebSocketConnection::onFrameComplete
-void HttpRequest::onWSMessage(bool binary, const char* data, size_t len) {
+void HttpRequest::onWSMessage(bool binary, std::vector<char>& data) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::onWSMessage", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_WS_MESSAGE, _id, data.size());
 
-  // Copy data because the source data is deleted right after calling this
-  // function.
-  std::shared_ptr<std::vector<char> > buf = std::make_shared<std::vector<char> >(data, data + len);
+  // Take the data instead of copying it; the WebSocketConnection clears its
+  // buffer right after calling this function anyway.
+  std::shared_ptr<std::vector<char> > buf = std::make_shared<std::vector<char> >();
+  buf->swap(data);
 
   std::function<void (void)> error_callback(
     std::bind(&HttpRequest::schedule_close, shared_from_this())
@@ -582,9 +834,14 @@ void HttpRequest::onWSMessage(bool binary, const char* data, size_t len) {
     return;
   }
 
+  if (_pWebApplication->getServerOptions().ws_batch != WS_BATCH_NONE) {
+    _wsBatcher()->add(p_wsc, binary, buf, error_callback);
+    return;
+  }
+
   // Schedule:
   // _pWebApplication->onWSMessage(p_wsc, binary, data, len);
-  invoke_later(
+  invoke_main(_wsOwner(), PRIORITY_NORMAL,
     std::bind(
       &WebApplication::onWSMessage,
       _pWebApplication,
@@ -596,8 +853,113 @@ void HttpRequest::onWSMessage(bool binary, const char* data, size_t len) {
   );
 }
 
+// Called from WebSocketConnection as parts of a large message arrive, when
+// the ws_large_message option is "stream".
+void HttpRequest::onWSMessageChunk(bool binary, std::vector<char>& data, bool last) {
+  ASSERT_BACKGROUND_THREAD()
+  log_event(LOG_DEBUG, EV_WS_MESSAGE_CHUNK, _id, data.size());
+
+  std::shared_ptr<WebSocketConnection> p_wsc = _pWebSocketConnection;
+  if (!p_wsc) {
+    return;
+  }
+
+  std::shared_ptr<std::vector<char> > buf = std::make_shared<std::vector<char> >();
+  buf->swap(data);
+
+  // Earlier messages from this connection may be waiting in a batch.
+  if (_pWSBatcher) {
+    _pWSBatcher->flush();
+  }
+
+  // Schedule:
+  // _pWebApplication->onWSMessageChunk(p_wsc, binary, buf, last, error_callback);
+  invoke_main(_wsOwner(), PRIORITY_BULK,
+    std::bind(
+      &WebApplication::onWSMessageChunk,
+      _pWebApplication,
+      p_wsc,
+      binary,
+      buf,
+      last,
+      std::function<void(void)>(
+        std::bind(&HttpRequest::schedule_close, shared_from_this())
+      )
+    )
+  );
+}
+
+// Called from WebSocketConnection when a large message has been written to a
+// file, when the ws_large_message option is "spool".
+void HttpRequest::onWSMessageFile(bool binary, const std::string& path) {
+  ASSERT_BACKGROUND_THREAD()
+  log_event(LOG_DEBUG, EV_WS_MESSAGE_FILE, _id);
+
+  std::shared_ptr<WebSocketConnection> p_wsc = _pWebSocketConnection;
+  if (!p_wsc) {
+    remove(path.c_str());
+    return;
+  }
+
+  if (_pWSBatcher) {
+    _pWSBatcher->flush();
+  }
+
+  // Schedule:
+  // _pWebApplication->onWSMessageFile(p_wsc, binary, path, error_callback);
+  invoke_main(_wsOwner(), PRIORITY_BULK,
+    std::bind(
+      &WebApplication::onWSMessageFile,
+      _pWebApplication,
+      p_wsc,
+      binary,
+      path,
+      std::function<void(void)>(
+        std::bind(&HttpRequest::schedule_close, shared_from_this())
+      )
+    )
+  );
+}
+
+std::shared_ptr<WSMessageBatcher> HttpRequest::_wsBatcher() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_pWSBatcher) {
+    return _pWSBatcher;
+  }
+
+  const ServerOptions& options = _pWebApplication->getServerOptions();
+  bool global = options.ws_batch == WS_BATCH_GLOBAL;
+
+  if (global && _pSocket->wsBatcher) {
+    _pWSBatcher = _pSocket->wsBatcher;
+    return _pWSBatcher;
+  }
+
+  _pWSBatcher = std::shared_ptr<WSMessageBatcher>(
+    new WSMessageBatcher(_pLoop, _pWebApplication,
+                         options.ws_batch_size, options.ws_batch_latency_ms),
+    auto_deleter_background<WSMessageBatcher>
+  );
+  if (global) {
+    _pSocket->wsBatcher = _pWSBatcher;
+  }
+  return _pWSBatcher;
+}
+
+// The owner of this connection's WebSocket work in the main thread's queue.
+// When messages are batched, the batcher sends them to R, so the open and
+// close events have to be queued behind the batcher's work to stay in order
+// with the messages. A global batcher is shared by all of a server's
+// connections, so they then share a place in the queue.
+const void* HttpRequest::_wsOwner() const {
+  if (_pWSBatcher) {
+    return _pWSBatcher.get();
+  }
+  return this;
+}
+
 void HttpRequest::onWSClose(int code) {
-  debug_log("HttpRequest::onWSClose", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_WS_CLOSE, _id);
   // TODO: Call close() here?
 }
 
@@ -605,48 +967,163 @@ void HttpRequest::onWSClose(int code) {
 // Outgoing websocket messages
 // ============================================================================
 
-typedef struct {
+// The maximum number of WebSocket frames passed to a single uv_write() call.
+#define MAX_WS_FRAMES_PER_WRITE 64
+// How long closeWSSocket() waits for the Close frame to be written, if
+// write_timeout isn't shorter.
+#define WS_CLOSE_LINGER_MS 5000
+
+// A batch of WebSocket frames that is being written.
+struct ws_send_t {
   uv_write_t writeReq;
-  std::vector<char>* pHeader;
-  std::vector<char>* pData;
-  std::vector<char>* pFooter;
-} ws_send_t;
+  std::vector<WSOutgoingFrame> frames;
+  size_t bytes;
+};
 
 void on_ws_message_sent(uv_write_t* handle, int status) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("on_ws_message_sent", LOG_DEBUG);
-  // TODO: Handle error if status != 0
-  ws_send_t* pSend = (ws_send_t*)handle;
-  delete pSend->pHeader;
-  delete pSend->pData;
-  delete pSend->pFooter;
-  free(pSend);
+  ws_send_t* pSend = (ws_send_t*)handle->data;
+  trace_event(TRACE_WRITE, TRACE_ASYNC_END, trace_id(pSend));
+  HttpRequest* pRequest = (HttpRequest*)handle->handle->data;
+  size_t bytes = pSend->bytes;
+  log_event(LOG_DEBUG, EV_WS_FRAMES_SENT, pRequest->id(), bytes);
+  delete pSend;
+
+  pRequest->_on_ws_frames_written(bytes, status);
 }
 
 void HttpRequest::sendWSFrame(const char* pHeader, size_t headerSize,
                               const char* pData, size_t dataSize,
-                              const char* pFooter, size_t footerSize) {
+                              const char* pFooter, size_t footerSize,
+                              bool droppable) {
+  ASSERT_BACKGROUND_THREAD()
+  log_event(LOG_DEBUG, EV_WS_SEND_FRAME, _id, headerSize + dataSize + footerSize);
+  if (_is_closing) {
+    return;
+  }
+
+  _wsFrameQueue.push_back(WSOutgoingFrame());
+  WSOutgoingFrame& frame = _wsFrameQueue.back();
+  frame.droppable = droppable;
+  frame.data.reserve(headerSize + dataSize + footerSize);
+  frame.data.insert(frame.data.end(), pHeader, pHeader + headerSize);
+  frame.data.insert(frame.data.end(), pData, pData + dataSize);
+  frame.data.insert(frame.data.end(), pFooter, pFooter + footerSize);
+
+  _wsBufferedAmount += frame.data.size();
+
+  _write_ws_frames();
+}
+
+// Pass the queued WebSocket frames to libuv, unless a write is already in
+// progress; in that case, this is called again when it finishes.
+void HttpRequest::_write_ws_frames() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_wsWriteInProgress || _wsFrameQueue.empty() || _is_closing) {
+    return;
+  }
+
+  ws_send_t* pSend = new ws_send_t();
+  pSend->writeReq.data = pSend;
+  pSend->bytes = 0;
+
+  while (!_wsFrameQueue.empty() &&
+         pSend->frames.size() < MAX_WS_FRAMES_PER_WRITE)
+  {
+    pSend->frames.push_back(std::move(_wsFrameQueue.front()));
+    _wsFrameQueue.pop_front();
+  }
+
+  std::vector<uv_buf_t> buffers(pSend->frames.size());
+  for (size_t i = 0; i < pSend->frames.size(); i++) {
+    std::vector<char>& data = pSend->frames[i].data;
+    buffers[i] = uv_buf_init(safe_vec_addr(data), data.size());
+    pSend->bytes += data.size();
+  }
+
+  int r = uv_write(&pSend->writeReq, handle(), safe_vec_addr(buffers),
+                   buffers.size(), &on_ws_message_sent);
+  if (r) {
+    log_event(LOG_INFO, EV_WRITE_ERROR, _id, r);
+    _wsBufferedAmount -= pSend->bytes;
+    delete pSend;
+    return;
+  }
+
+  _wsWriteInProgress = true;
+  trace_event(TRACE_WRITE, TRACE_ASYNC_BEGIN, trace_id(pSend), pSend->bytes);
+  _pWebApplication->getServerStats().onBytesOut(pSend->bytes);
+  writeStarted();
+}
+
+void HttpRequest::_on_ws_frames_written(size_t bytes, int status) {
+  ASSERT_BACKGROUND_THREAD()
+  _wsBufferedAmount -= bytes;
+  _wsWriteInProgress = false;
+  writeFinished();
+
+  if (status != 0) {
+    // This happens when the connection is closed with writes pending.
+    log_event(LOG_INFO, EV_WS_WRITE_ERROR, _id, status);
+    return;
+  }
+
+  _write_ws_frames();
+  if (_wsCloseWhenWritten && !_wsWriteInProgress) {
+    close();
+  }
+}
+
+size_t HttpRequest::wsBufferedAmount() const {
+  return _wsBufferedAmount;
+}
+
+size_t HttpRequest::dropWSFrames(size_t bytes) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::sendWSFrame", LOG_DEBUG);
-  ws_send_t* pSend = (ws_send_t*)malloc(sizeof(ws_send_t));
-  memset(pSend, 0, sizeof(ws_send_t));
-  pSend->pHeader = new std::vector<char>(pHeader, pHeader + headerSize);
-  pSend->pData = new std::vector<char>(pData, pData + dataSize);
-  pSend->pFooter = new std::vector<char>(pFooter, pFooter + footerSize);
+  size_t freed = 0;
+
+  std::list<WSOutgoingFrame>::iterator it = _wsFrameQueue.begin();
+  while (it != _wsFrameQueue.end() && freed < bytes) {
+    if (it->droppable) {
+      freed += it->data.size();
+      it = _wsFrameQueue.erase(it);
+    } else {
+      it++;
+    }
+  }
 
-  uv_buf_t buffers[3];
-  buffers[0] = uv_buf_init(safe_vec_addr(*pSend->pHeader), pSend->pHeader->size());
-  buffers[1] = uv_buf_init(safe_vec_addr(*pSend->pData), pSend->pData->size());
-  buffers[2] = uv_buf_init(safe_vec_addr(*pSend->pFooter), pSend->pFooter->size());
+  _wsBufferedAmount -= freed;
+  return freed;
+}
 
-  // TODO: Handle return code
-  uv_write(&pSend->writeReq, (uv_stream_t*)handle(), buffers, 3,
-           &on_ws_message_sent);
+void HttpRequest::discardWSFrames() {
+  ASSERT_BACKGROUND_THREAD()
+  size_t freed = 0;
+  for (std::list<WSOutgoingFrame>::iterator it = _wsFrameQueue.begin();
+       it != _wsFrameQueue.end(); it++) {
+    freed += it->data.size();
+  }
+  _wsFrameQueue.clear();
+  _wsBufferedAmount -= freed;
 }
 
 void HttpRequest::closeWSSocket() {
-  debug_log("HttpRequest::closeWSSocket", LOG_DEBUG);
-  close();
+  ASSERT_BACKGROUND_THREAD()
+  log_event(LOG_DEBUG, EV_CLOSE_WS_SOCKET, _id);
+  if (!_wsWriteInProgress || _is_closing) {
+    close();
+    return;
+  }
+
+  // The Close frame is queued behind a write that hasn't finished, which
+  // happens when the client is slow to read. Give it a chance to get there,
+  // but not for long: the client may never read again.
+  _wsCloseWhenWritten = true;
+  uint64_t timeoutMs = _pWebApplication->getServerOptions().write_timeout_ms;
+  if (timeoutMs == 0 || timeoutMs > WS_CLOSE_LINGER_MS) {
+    timeoutMs = WS_CLOSE_LINGER_MS;
+  }
+  TimerWheel::forLoop(_pLoop)->start(&_writeTimer, timeoutMs);
 }
 
 
@@ -656,7 +1133,7 @@ void HttpRequest::closeWSSocket() {
 
 void HttpRequest::_on_closed(uv_handle_t* handle) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::_on_closed", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_CLOSED, _id);
 
   std::shared_ptr<WebSocketConnection> p_wsc = _pWebSocketConnection;
   // It's possible for _pWebSocketConnection to have had its refcount drop to
@@ -679,24 +1156,43 @@ void HttpRequest::_on_closed(uv_handle_t* handle) {
 
 void HttpRequest::close() {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpRequest::close", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_CLOSE, _id);
   // std::cerr << "Closing handle " << &_handle << std::endl;
 
   if (_is_closing) {
-    debug_log("close() called twice on HttpRequest object", LOG_INFO);
+    log_event(LOG_INFO, EV_CLOSE_TWICE, _id);
     // We can get here in unusual cases when close() is called once directly,
     // and another time via a scheduled callback. When this happens, don't do
     // the closing machinery twice.
     return;
   }
   _is_closing = true;
+  _readTimer.cancel();
+  _writeTimer.cancel();
+
+  // A body that is waiting for data, like a stream that R hasn't written to
+  // lately, would otherwise not notice that the connection is gone until R
+  // writes to it again. Wake it up, so that the response ends now.
+  if (_pWritingBody) {
+    _pWritingBody->stopWaiting();
+  }
+
+  if (_protocol == WebSockets) {
+    _pWebApplication->getServerStats().onWSClose();
+  }
 
   std::shared_ptr<WebSocketConnection> p_wsc = _pWebSocketConnection;
 
   if (p_wsc && _protocol == WebSockets) {
+    // Messages that are waiting in a batch must reach R before the close
+    // event does.
+    if (_pWSBatcher) {
+      _pWSBatcher->flush();
+    }
+
     // Schedule:
     // _pWebApplication->onWSClose(p_wsc)
-    invoke_later(
+    invoke_main(_wsOwner(), PRIORITY_CONTROL,
       std::bind(
         &WebApplication::onWSClose,
         _pWebApplication,
@@ -714,7 +1210,7 @@ void HttpRequest::close() {
 // tell the background thread to close the request. The main thread should not
 // close() directly.
 void HttpRequest::schedule_close() {
-  debug_log("HttpRequest::schedule_close", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_SCHEDULE_CLOSE, _id);
   // Schedule on background thread:
   //  pRequest->close()
   _background_queue->push(
@@ -729,7 +1225,7 @@ void HttpRequest::schedule_close() {
 
 void HttpRequest::_call_r_on_ws_open() {
   ASSERT_MAIN_THREAD()
-  debug_log("HttpRequest::_call_r_on_ws_open", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_CALL_R_ON_WS_OPEN, _id);
 
   std::function<void (void)> error_callback(
     std::bind(&HttpRequest::schedule_close, shared_from_this())
@@ -737,6 +1233,10 @@ void HttpRequest::_call_r_on_ws_open() {
 
   this->_pWebApplication->onWSOpen(shared_from_this(), error_callback);
 
+  // The R WebSocket object keeps its own reference to the request
+  // environment, if it needs it.
+  _env.reset();
+
   std::shared_ptr<WebSocketConnection> p_wsc = _pWebSocketConnection;
   // It's possible for _pWebSocketConnection to have had its refcount drop to
   // zero from another thread or earlier callback in this thread. If that
@@ -763,6 +1263,12 @@ void HttpRequest::_call_r_on_ws_open() {
   );
 
   _background_queue->push(cb);
+
+  // Schedule on background thread:
+  // this->_releaseHttpState()
+  _background_queue->push(
+    std::bind(&HttpRequest::_releaseHttpState, shared_from_this())
+  );
 }
 
 
@@ -772,6 +1278,7 @@ void HttpRequest::_call_r_on_ws_open() {
 
 void HttpRequest::_parse_http_data(char* buffer, const ssize_t n) {
   ASSERT_BACKGROUND_THREAD()
+  TraceSlice slice(TRACE_PARSE, trace_id(this));
   int parsed = http_parser_execute(&_parser, &request_settings(), buffer, n);
 
   if (http_parser_waiting_for_headers_completed(&_parser)) {
@@ -810,12 +1317,19 @@ void HttpRequest::_parse_http_data(char* buffer, const ssize_t n) {
       pResp->writeResponse();
 
       _protocol = WebSockets;
+      _pWebApplication->getServerStats().onWSOpen();
 
       _requestBuffer.insert(_requestBuffer.end(), pData, pData + pDataLen);
 
+      // Messages that are batched are sent to R by the batcher, so it
+      // needs to exist before the open event is scheduled; see _wsOwner().
+      if (_pWebApplication->getServerOptions().ws_batch != WS_BATCH_NONE) {
+        _wsBatcher();
+      }
+
       // Schedule on main thread:
       // this->_call_r_on_ws_open()
-      invoke_later(
+      invoke_main(_wsOwner(), PRIORITY_CONTROL,
         std::bind(&HttpRequest::_call_r_on_ws_open, shared_from_this())
       );
     }
@@ -826,11 +1340,7 @@ void HttpRequest::_parse_http_data(char* buffer, const ssize_t n) {
     }
   } else if (parsed < n) {
     if (!_ignoreNewData) {
-      debug_log(
-        std::string("HttpRequest::_parse_http_data error: ") +
-          http_errno_description(HTTP_PARSER_ERRNO(&_parser)),
-        LOG_INFO
-      );
+      log_event(LOG_INFO, EV_PARSE_ERROR, _id, HTTP_PARSER_ERRNO(&_parser));
       uv_read_stop((uv_stream_t*)handle());
       close();
     }
@@ -851,6 +1361,7 @@ void HttpRequest::_on_request_read(uv_stream_t*, ssize_t nread, const uv_buf_t*
   ASSERT_BACKGROUND_THREAD()
   if (nread > 0) {
     //std::cerr << nread << " bytes read\n";
+    _pWebApplication->getServerStats().onBytesIn(nread);
     if (_ignoreNewData) {
       // Do nothing
     } else if (_protocol == HTTP) {
@@ -868,11 +1379,7 @@ void HttpRequest::_on_request_read(uv_stream_t*, ssize_t nread, const uv_buf_t*
   } else if (nread < 0) {
     if (nread == UV_EOF || nread == UV_ECONNRESET) {
     } else {
-      debug_log(
-        std::string("HttpRequest::on_request_read error: ") +
-          uv_strerror(nread),
-        LOG_INFO
-      );
+      log_event(LOG_INFO, EV_READ_ERROR, _id, nread);
     }
     close();
   } else {
@@ -887,13 +1394,10 @@ void HttpRequest::handleRequest() {
   ASSERT_BACKGROUND_THREAD()
   int r = uv_read_start(handle(), &on_alloc, &HttpRequest_on_request_read);
   if (r) {
-    debug_log(
-      std::string("HttpRequest::handlRequest error: [uv_read_start] ") +
-        uv_strerror(r),
-      LOG_INFO
-    );
+    log_event(LOG_INFO, EV_READ_START_ERROR, _id, r);
     return;
   }
+  _setReadTimeout(READ_TIMEOUT_IDLE);
 }
 
 
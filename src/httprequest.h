@@ -2,6 +2,8 @@
 #define HTTPREQUEST_HPP
 
 #include <map>
+#include <list>
+#include <atomic>
 #include <iostream>
 
 #include <functional>
@@ -11,21 +13,37 @@
 #include "socket.h"
 #include "webapplication.h"
 #include "callbackqueue.h"
+#include "headercollector.h"
 #include "httpresponse.h"
 #include "utils.h"
 #include "thread.h"
 #include "auto_deleter.h"
+#include "wsmessagebatch.h"
+#include "timerwheel.h"
+#include "latency.h"
+#include "eventlog.h"
 
 enum Protocol {
   HTTP,
   WebSockets
 };
 
+// An outgoing WebSocket frame: the header, payload, and footer, copied into
+// one buffer.
+struct WSOutgoingFrame {
+  std::vector<char> data;
+  bool droppable;
+};
+
+struct ws_send_t;
+
 // HttpRequest is a bit of a misnomer -- a HttpRequest object represents a
 // single connection, on which multiple actual HTTP requests can be made.
 class HttpRequest : public WebSocketConnectionCallbacks,
                     public std::enable_shared_from_this<HttpRequest>
 {
+  friend class Socket;
+
 private:
   uv_loop_t* _pLoop;
   std::shared_ptr<WebApplication> _pWebApplication;
@@ -35,7 +53,6 @@ private:
   Protocol _protocol;
   std::string _url;
   RequestHeaders _headers;
-  std::string _lastHeaderField;
   std::shared_ptr<WebSocketConnection> _pWebSocketConnection;
 
   // `_env` is an shared_ptr<Environment> instead of an Environment because it
@@ -47,6 +64,9 @@ private:
   std::shared_ptr<Rcpp::Environment> _env;
   void _newRequest();
   void _initializeEnv();
+  // Free the state that is only needed while handling HTTP requests. This
+  // is called once a WebSocket connection has been opened.
+  void _releaseHttpState();
 
   // _ignoreNewData is used in cases where we rejected a request (by sending
   // a response with a non-100 status code) before its body was received. We
@@ -80,17 +100,76 @@ private:
   // to schedule callbacks to run on the background thread.
   CallbackQueue* _background_queue;
 
-  // Used to keep track of state when parsing headers. This is needed because
-  // sometimes the header fields and values can be split across multiple TCP
-  // messages, resulting in multiple calls to _on_header_field or
-  // _on_header_value.
-  enum LastHeaderState
-  {
-    START,
-    FIELD,
-    VALUE
+  // Builds _headers from the header fields and values that the parser
+  // reports.
+  HeaderCollector _headerCollector;
+
+  // Outgoing WebSocket frames that haven't been passed to uv_write() yet.
+  // Frames are written in batches, and the next batch is started when the
+  // previous one finishes; this is what lets dropWSFrames() discard frames
+  // that a slow client hasn't gotten to. This is a list rather than a deque
+  // because an empty std::deque still allocates, and most connections have
+  // nothing queued most of the time.
+  std::list<WSOutgoingFrame> _wsFrameQueue;
+  bool _wsWriteInProgress;
+  // Bytes in _wsFrameQueue plus bytes in the batch that is being written.
+  // This is read from the main thread.
+  std::atomic<size_t> _wsBufferedAmount;
+  // Set by closeWSSocket() when a write was in progress: the connection is
+  // closed once the queued frames (including the Close frame) are written,
+  // or when _writeTimer fires.
+  bool _wsCloseWhenWritten;
+
+  void _write_ws_frames();
+
+  // Timeouts. What the read timer measures depends on where the connection
+  // is in the request cycle; it doesn't run while R is handling a request,
+  // or after the connection has been upgraded to a WebSocket. The write
+  // timer runs while there are writes in progress, and is restarted each
+  // time one finishes.
+  enum ReadTimeout {
+    // Waiting for the first byte of a request
+    READ_TIMEOUT_IDLE,
+    // Waiting for the rest of the request headers
+    READ_TIMEOUT_HEADERS,
+    // Waiting for more of the request body
+    READ_TIMEOUT_BODY,
+    READ_TIMEOUT_NONE
   };
-  LastHeaderState _last_header_state;
+  ReadTimeout _readTimeout;
+  TimerWheelTimer _readTimer;
+  TimerWheelTimer _writeTimer;
+  int _activeWrites;
+  // The response body that is being sent, if any. A streamed body may spend
+  // a long time waiting for R to write more, with no writes in progress.
+  std::shared_ptr<DataSource> _pWritingBody;
+
+  void _setReadTimeout(ReadTimeout readTimeout);
+  void _on_read_timeout();
+  void _on_write_timeout();
+
+  // Used when incoming WebSocket messages are batched. This may be shared
+  // with other connections on the same Socket.
+  std::shared_ptr<WSMessageBatcher> _pWSBatcher;
+  std::shared_ptr<WSMessageBatcher> _wsBatcher();
+  const void* _wsOwner() const;
+
+  // Identifies this connection in the event log.
+  uint64_t _id;
+  static uint64_t nextId();
+
+  // This connection's position in _pSocket->connections.
+  size_t _connectionIndex;
+  uint64_t _connectedAt;
+
+  // When the current request reached each stage of handling.
+  RequestTimestamps _timestamps;
+
+  // When requests are coalesced, the key of the request that this one is
+  // leading. Empty if this request isn't a leader.
+  std::string _coalesceKey;
+  void _scheduleGetResponse();
+  void _answerCoalescedRequests(std::shared_ptr<HttpResponse> pResponse);
 
 public:
   HttpRequest(uv_loop_t* pLoop,
@@ -106,7 +185,15 @@ public:
       _is_upgrade(false),
       _response_scheduled(false),
       _handling_request(false),
-      _background_queue(backgroundQueue)
+      _background_queue(backgroundQueue),
+      _wsWriteInProgress(false),
+      _wsBufferedAmount(0),
+      _wsCloseWhenWritten(false),
+      _readTimeout(READ_TIMEOUT_NONE),
+      _activeWrites(0),
+      _id(nextId()),
+      _connectionIndex((size_t)-1),
+      _connectedAt(uv_hrtime())
   {
     ASSERT_BACKGROUND_THREAD()
     uv_tcp_init(pLoop, &_handle.tcp);
@@ -118,12 +205,14 @@ public:
     // This is used by the macro-defined callbacks like _on_message_begin
     _parser.data = this;
 
-    _last_header_state = START;
+    _readTimer.setCallback(std::bind(&HttpRequest::_on_read_timeout, this));
+    _writeTimer.setCallback(std::bind(&HttpRequest::_on_write_timeout, this));
+    log_event(LOG_DEBUG, EV_REQUEST_CREATED, _id);
   }
 
   virtual ~HttpRequest() {
     ASSERT_BACKGROUND_THREAD()
-    debug_log("HttpRequest::~HttpRequest", LOG_DEBUG);
+    log_event(LOG_DEBUG, EV_REQUEST_DESTROYED, _id);
     _pWebSocketConnection.reset();
   }
 
@@ -133,6 +222,25 @@ public:
   }
   Address clientAddress();
   Address serverAddress();
+  // Is the client on this machine?
+  bool isLocal();
+  std::shared_ptr<Socket> socket() const {
+    return _pSocket;
+  }
+  uint64_t id() const {
+    return _id;
+  }
+  // When the connection was accepted, from uv_hrtime().
+  uint64_t connectedAt() const {
+    return _connectedAt;
+  }
+  bool isWebSocket() const {
+    return _protocol == WebSockets;
+  }
+  // Is a request on this connection being handled?
+  bool isHandlingRequest() const {
+    return _handling_request;
+  }
   Rcpp::Environment& env();
 
   void handleRequest();
@@ -147,11 +255,28 @@ public:
 
   // Is the request an Upgrade (i.e. WebSocket connection)?
   bool isUpgrade() const;
+  // The main thread sets the times at which the app ran.
+  RequestTimestamps& timestamps() {
+    return _timestamps;
+  }
+  // Add a finished response's timestamps to the server's latency histograms.
+  void recordTimings(const RequestTimestamps& timestamps);
+  ServerStats& serverStats();
+
+  // Is this request's response going to be sent to other requests, too?
+  bool isCoalescing() const {
+    return !_coalesceKey.empty();
+  }
 
   void sendWSFrame(const char* pHeader, size_t headerSize,
                    const char* pData, size_t dataSize,
-                   const char* pFooter, size_t footerSize);
+                   const char* pFooter, size_t footerSize,
+                   bool droppable);
   void closeWSSocket();
+  size_t wsBufferedAmount() const;
+  size_t dropWSFrames(size_t bytes);
+  void discardWSFrames();
+  void _on_ws_frames_written(size_t bytes, int status);
 
   // Call this function from the main thread to indicate that a response has
   // been scheduled. This is needed because sometimes by the time the main
@@ -166,6 +291,14 @@ public:
   // pipelined HTTP requests.
   void requestCompleted();
 
+  // These are called when a write to the connection starts and finishes, so
+  // that writes that stop making progress can be timed out.
+  void writeStarted();
+  void writeFinished();
+  // These are called when sending a response body starts and finishes.
+  void bodyWriteStarted(std::shared_ptr<DataSource> pBody);
+  void bodyWriteFinished();
+
   void _call_r_on_ws_open();
   void _schedule_on_headers_complete_complete(std::shared_ptr<HttpResponse> pResponse);
   void _on_headers_complete_complete(std::shared_ptr<HttpResponse> pResponse);
@@ -185,7 +318,9 @@ public:
   virtual int _on_body(http_parser* pParser, const char* pAt, size_t length);
   virtual int _on_message_complete(http_parser* pParser);
 
-  virtual void onWSMessage(bool binary, const char* data, size_t len);
+  virtual void onWSMessage(bool binary, std::vector<char>& data);
+  virtual void onWSMessageChunk(bool binary, std::vector<char>& data, bool last);
+  virtual void onWSMessageFile(bool binary, const std::string& path);
   virtual void onWSClose(int code);
 
   // Update whether or not this HttpRequest is to be upgraded. This is called
@@ -205,7 +340,9 @@ public:
     );
 
     _pWebSocketConnection = std::shared_ptr<WebSocketConnection>(
-      new WebSocketConnection(this->_pLoop, this_base),
+      new WebSocketConnection(this->_pLoop, this_base,
+                              _pWebApplication->getServerOptions(),
+                              _pWebApplication->getServerStats()),
       auto_deleter_background<WebSocketConnection>
     );
 
@@ -4,11 +4,13 @@
 #include "thread.h"
 #include "utils.h"
 #include "gzipdatasource.h"
+#include "trace.h"
 #include <uv.h>
 
 
 void on_response_written(uv_write_t* handle, int status) {
   ASSERT_BACKGROUND_THREAD()
+  trace_event(TRACE_WRITE, TRACE_ASYNC_END, trace_id(handle));
   // Make a local copy of the shared_ptr before deleting the original one.
   std::shared_ptr<HttpResponse> pResponse(*(std::shared_ptr<HttpResponse>*)handle->data);
 
@@ -51,16 +53,39 @@ public:
                             uv_stream_t* pHandle,
                             std::shared_ptr<DataSource> pDataSource,
                             bool chunked) :
-      ExtendedWrite(pHandle, pDataSource, chunked), _pParent(pParent) {}
+      ExtendedWrite(pHandle, pDataSource, chunked), _pParent(pParent)
+  {
+    _pParent->request()->bodyWriteStarted(pDataSource);
+  }
 
   void onWriteComplete(int status) {
+    _pParent->request()->bodyWriteFinished();
+    _pParent->onBodyWritten(status);
+    if (status != 0) {
+      // The client can't tell where the body ends, so the connection can't
+      // be used for another request.
+      _pParent->closeAfterWritten();
+    }
     delete this;
   }
+
+  void onPartWriteStarted(size_t bytes) {
+    _pParent->request()->serverStats().onBytesOut(bytes);
+    _pParent->request()->writeStarted();
+  }
+  void onPartWriteFinished() {
+    _pParent->request()->writeFinished();
+  }
 };
 
 void HttpResponse::writeResponse() {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpResponse::writeResponse", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_WRITE_RESPONSE, _pRequest->id(), _statusCode);
+  _timestamps = _pRequest->timestamps();
+  _timestamps.writeStarted = uv_hrtime();
+  _streamed = _chunked;
+  _pRequest->serverStats().onResponse(_statusCode);
+
   // TODO: Optimize
   std::ostringstream response(std::ios_base::binary);
   response << "HTTP/1.1 " << _statusCode << " " << _status << "\r\n";
@@ -86,6 +111,11 @@ void HttpResponse::writeResponse() {
     gzip = false;
   } else if (_statusCode == 101 || _pBody == nullptr) {
     gzip = false;
+  } else if (_chunked) {
+    // A body that is already chunked is streamed, and each chunk should be
+    // sent as soon as it's available instead of waiting to fill up a
+    // compressed block.
+    gzip = false;
   } else {
     RequestHeaders h = _pRequest->headers();
     auto acceptEncoding = h.find("Accept-Encoding");
@@ -106,7 +136,8 @@ void HttpResponse::writeResponse() {
   if (gzip) {
     response << "Content-Encoding: gzip\r\n";
     _chunked = true;
-    _pBody = std::make_shared<GZipDataSource>(_pBody);
+    _pGZipBody = std::make_shared<GZipDataSource>(_pBody);
+    _pBody = _pGZipBody;
   }
 
   if (_statusCode == 101) {
@@ -153,28 +184,50 @@ void HttpResponse::writeResponse() {
   int r = uv_write(pWriteReq, _pRequest->handle(), &headerBuf, 1,
       &on_response_written);
   if (r) {
-    debug_log(std::string("uv_write() error:") + uv_strerror(r), LOG_INFO);
+    log_event(LOG_INFO, EV_WRITE_ERROR, _pRequest->id(), r);
     delete (std::shared_ptr<HttpResponse>*)pWriteReq->data;
     free(pWriteReq);
   } else {
+    trace_event(TRACE_WRITE, TRACE_ASYNC_BEGIN, trace_id(pWriteReq), headerBuf.len);
+    _pRequest->serverStats().onBytesOut(headerBuf.len);
+    _pRequest->writeStarted();
     _pRequest->requestCompleted();
   }
 }
 
 void HttpResponse::onResponseWritten(int status) {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpResponse::onResponseWritten", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_RESPONSE_WRITTEN, _pRequest->id());
+  _pRequest->writeFinished();
   if (status != 0) {
     err_printf("Error writing response: %d\n", status);
     _closeAfterWritten = true; // Cause the request connection to close.
     return;
   }
 
+  _timestamps.headWritten = uv_hrtime();
   if (_pBody != NULL) {
     HttpResponseExtendedWrite* pResponseWrite = new HttpResponseExtendedWrite(
       shared_from_this(), _pRequest->handle(), _pBody, this->_chunked);
     pResponseWrite->begin();
+  } else {
+    onBodyWritten(0);
+  }
+}
+
+void HttpResponse::onBodyWritten(int status) {
+  ASSERT_BACKGROUND_THREAD()
+  if (_pGZipBody) {
+    _pRequest->serverStats().onGzip(_pGZipBody->bytesIn(), _pGZipBody->bytesOut());
+  }
+  // WebSocket handshakes aren't requests to time.
+  if (status != 0 || _statusCode == 101) {
+    return;
+  }
+  if (!_streamed) {
+    _timestamps.finished = uv_hrtime();
   }
+  _pRequest->recordTimings(_timestamps);
 }
 
 // This sets a flag so that the connection is closed after the response is
@@ -186,7 +239,7 @@ void HttpResponse::closeAfterWritten() {
 
 HttpResponse::~HttpResponse() {
   ASSERT_BACKGROUND_THREAD()
-  debug_log("HttpResponse::~HttpResponse", LOG_DEBUG);
+  log_event(LOG_DEBUG, EV_RESPONSE_DESTROYED, _pRequest->id());
   if (_closeAfterWritten) {
     _pRequest->close();
   }
@@ -6,8 +6,10 @@
 #include "uvutil.h"
 #include "utils.h"
 #include "constants.h"
+#include "latency.h"
 
 class HttpRequest;
+class GZipDataSource;
 
 class HttpResponse : public std::enable_shared_from_this<HttpResponse>  {
 
@@ -19,6 +21,12 @@ class HttpResponse : public std::enable_shared_from_this<HttpResponse>  {
   std::shared_ptr<DataSource> _pBody;
   bool _closeAfterWritten;
   bool _chunked;
+  // Copied from the request when writing starts. Streamed bodies can take
+  // any amount of time, so they aren't timed.
+  RequestTimestamps _timestamps;
+  bool _streamed;
+  // Set if the body is compressed, to count the bytes saved.
+  std::shared_ptr<GZipDataSource> _pGZipBody;
 
 public:
   HttpResponse(std::shared_ptr<HttpRequest> pRequest,
@@ -30,7 +38,8 @@ public:
       _status(status),
       _pBody(pBody),
       _closeAfterWritten(false),
-      _chunked(false)
+      _chunked(false),
+      _streamed(false)
   {
     _headers.push_back(std::make_pair("Date", http_date_string(time(NULL))));
   }
@@ -42,7 +51,22 @@ public:
   void setHeader(const std::string& name, const std::string& value);
   void writeResponse();
   void onResponseWritten(int status);
+  void onBodyWritten(int status);
   void closeAfterWritten();
+  // Send the body with chunked transfer encoding. This is for bodies whose
+  // length isn't known when the headers are sent.
+  void setChunked() {
+    _chunked = true;
+  }
+  std::shared_ptr<HttpRequest> request() const {
+    return _pRequest;
+  }
+  int statusCode() const {
+    return _statusCode;
+  }
+  std::shared_ptr<DataSource> body() const {
+    return _pBody;
+  }
 };
 
 #endif
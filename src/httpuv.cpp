@@ -6,6 +6,8 @@
 #include <signal.h>
 #include <errno.h>
 #include <functional>
+#include <atomic>
+#include <limits>
 #include <memory>
 #include <uv.h>
 #include "base64/base64.hpp"
@@ -16,8 +18,14 @@
 #include "utils.h"
 #include "thread.h"
 #include "httpuv.h"
+#include "uri.h"
 #include "auto_deleter.h"
 #include "socket.h"
+#include "timerwheel.h"
+#include "streamdatasource.h"
+#include "ssechannel.h"
+#include "scheduler.h"
+#include "trace.h"
 #include <Rinternals.h>
 
 
@@ -89,6 +97,25 @@ void close_handle_cb(uv_handle_t* handle, void* arg) {
   }
 }
 
+// How late the background thread's loop is, found by checking how late a
+// repeating timer runs. A loop that is busy with callbacks, or that is
+// blocked, runs the timer late.
+#define LOOP_LAG_INTERVAL_MS 100
+uv_timer_t loop_lag_timer;
+uint64_t loop_lag_due = 0;
+std::atomic<double> loop_lag(0);
+
+void on_loop_lag_timer(uv_timer_t* handle) {
+  ASSERT_BACKGROUND_THREAD()
+  uint64_t now = uv_hrtime();
+  loop_lag = now > loop_lag_due ? (now - loop_lag_due) / 1e9 : 0;
+  loop_lag_due = now + LOOP_LAG_INTERVAL_MS * 1000000ULL;
+}
+
+double io_loop_lag() {
+  return loop_lag;
+}
+
 void stop_io_loop(uv_async_t *handle) {
   ASSERT_BACKGROUND_THREAD()
   debug_log("stop_io_loop", LOG_DEBUG);
@@ -121,9 +148,20 @@ void io_thread(void* data) {
 
   background_queue = new CallbackQueue(io_loop.get());
 
+  // Timers that are used by many connections, like WebSocket keepalive
+  // pings, share this loop's timer wheel.
+  io_loop.get()->data = new TimerWheel(io_loop.get());
+
   // Set up async communication channels
   uv_async_init(io_loop.get(), &async_stop_io_loop, stop_io_loop);
 
+  uv_timer_init(io_loop.get(), &loop_lag_timer);
+  uv_unref(toHandle(&loop_lag_timer));
+  loop_lag_due = uv_hrtime() + LOOP_LAG_INTERVAL_MS * 1000000ULL;
+  loop_lag = 0;
+  uv_timer_start(&loop_lag_timer, on_loop_lag_timer,
+                 LOOP_LAG_INTERVAL_MS, LOOP_LAG_INTERVAL_MS);
+
   // Tell other thread that it can continue.
   blocker->wait();
 
@@ -140,6 +178,10 @@ void io_thread(void* data) {
   // Cleanup stuff
   uv_walk(io_loop.get(), close_handle_cb, NULL);
   uv_run(io_loop.get(), UV_RUN_ONCE);
+  // The timer wheel is deleted only after the handles have closed, because
+  // their close callbacks destroy objects whose timers are still on it.
+  delete TimerWheel::forLoop(io_loop.get());
+  io_loop.get()->data = NULL;
   uv_loop_close(io_loop.get());
   io_loop.reset();
   io_thread_running.set(false);
@@ -241,6 +283,145 @@ void closeWS(SEXP conn,
   );
 }
 
+// Number of bytes of outgoing messages that are queued on the background
+// thread, waiting to be written to the socket.
+// [[Rcpp::export]]
+double wsBufferedAmount(SEXP conn) {
+  ASSERT_MAIN_THREAD()
+  Rcpp::XPtr<std::shared_ptr<WebSocketConnection>,
+             Rcpp::PreserveStorage,
+             auto_deleter_background<std::shared_ptr<WebSocketConnection> >,
+             true> conn_xptr(conn);
+  std::shared_ptr<WebSocketConnection> wsc = internalize_shared_ptr(conn_xptr);
+
+  return static_cast<double>(wsc->bufferedAmount());
+}
+
+// The round-trip time of the most recent keepalive ping, in seconds, or NA if
+// no pong has been received yet.
+// [[Rcpp::export]]
+double wsRoundTripTime(SEXP conn) {
+  ASSERT_MAIN_THREAD()
+  Rcpp::XPtr<std::shared_ptr<WebSocketConnection>,
+             Rcpp::PreserveStorage,
+             auto_deleter_background<std::shared_ptr<WebSocketConnection> >,
+             true> conn_xptr(conn);
+  std::shared_ptr<WebSocketConnection> wsc = internalize_shared_ptr(conn_xptr);
+
+  double rtt = wsc->roundTripTime();
+  if (rtt != rtt) {
+    return NA_REAL;
+  }
+  return rtt;
+}
+
+
+// ============================================================================
+// Streamed response bodies
+// ============================================================================
+
+// [[Rcpp::export]]
+Rcpp::RObject makeResponseStream(double highWaterMark, Rcpp::Function onDrain) {
+  ASSERT_MAIN_THREAD()
+  size_t limit = std::numeric_limits<size_t>::max();
+  if (highWaterMark < (double)limit) {
+    limit = static_cast<size_t>(highWaterMark);
+  }
+  std::shared_ptr<StreamDataSource>* pStream = new std::shared_ptr<StreamDataSource>(
+    std::make_shared<StreamDataSource>(limit, onDrain)
+  );
+  return StreamDataSourceXPtr(pStream, true);
+}
+
+// Returns false if the caller should wait for the drain callback before
+// writing more.
+// [[Rcpp::export]]
+bool writeResponseStream(SEXP stream, Rcpp::RawVector data) {
+  ASSERT_MAIN_THREAD()
+  StreamDataSourceXPtr stream_xptr(stream);
+  return (*stream_xptr.get())->write(data);
+}
+
+// [[Rcpp::export]]
+void closeResponseStream(SEXP stream) {
+  ASSERT_MAIN_THREAD()
+  StreamDataSourceXPtr stream_xptr(stream);
+  (*stream_xptr.get())->end();
+}
+
+// Number of bytes that have been written to the stream but not yet written
+// to the socket.
+// [[Rcpp::export]]
+double responseStreamBufferedAmount(SEXP stream) {
+  ASSERT_MAIN_THREAD()
+  StreamDataSourceXPtr stream_xptr(stream);
+  return static_cast<double>((*stream_xptr.get())->bufferedAmount());
+}
+
+// [[Rcpp::export]]
+bool responseStreamIsOpen(SEXP stream) {
+  ASSERT_MAIN_THREAD()
+  StreamDataSourceXPtr stream_xptr(stream);
+  return (*stream_xptr.get())->isOpen();
+}
+
+
+// ============================================================================
+// Server-Sent Events
+// ============================================================================
+
+// [[Rcpp::export]]
+Rcpp::RObject makeSSEChannel(double historySize, double keepalive,
+                             double maxBufferedAmount)
+{
+  ASSERT_MAIN_THREAD()
+  // Events are handed to the background thread as soon as they're published,
+  // even if no server has been started yet.
+  ensure_io_thread();
+
+  size_t limit = std::numeric_limits<size_t>::max();
+  if (maxBufferedAmount < (double)limit) {
+    limit = static_cast<size_t>(maxBufferedAmount);
+  }
+  // The channel has a timer, so it must be deleted on the background thread.
+  std::shared_ptr<SSEChannel>* pChannel = new std::shared_ptr<SSEChannel>(
+    new SSEChannel(
+      static_cast<size_t>(historySize),
+      static_cast<uint64_t>(keepalive * 1000),
+      limit
+    ),
+    auto_deleter_background<SSEChannel>
+  );
+  return SSEChannelXPtr(pChannel, true);
+}
+
+// Returns the ID of the event.
+// [[Rcpp::export]]
+std::string publishSSE(SEXP channel, std::string data, std::string event,
+                       std::string id)
+{
+  ASSERT_MAIN_THREAD()
+  SSEChannelXPtr channel_xptr(channel);
+  return (*channel_xptr.get())->publish(data, event, id);
+}
+
+// [[Rcpp::export]]
+void closeSSEChannel(SEXP channel) {
+  ASSERT_MAIN_THREAD()
+  SSEChannelXPtr channel_xptr(channel);
+  (*channel_xptr.get())->close();
+}
+
+// The number of connections that are subscribed to the channel. This is read
+// without waiting for the background thread, so it may be slightly out of
+// date.
+// [[Rcpp::export]]
+double sseSubscriberCount(SEXP channel) {
+  ASSERT_MAIN_THREAD()
+  SSEChannelXPtr channel_xptr(channel);
+  return static_cast<double>((*channel_xptr.get())->subscriberCount());
+}
+
 
 // ============================================================================
 // Create/stop servers
@@ -253,9 +434,12 @@ Rcpp::RObject makeTcpServer(const std::string& host, int port,
                             Rcpp::Function onRequest,
                             Rcpp::Function onWSOpen,
                             Rcpp::Function onWSMessage,
+                            Rcpp::Function onWSMessageBatch,
+                            Rcpp::Function onWSMessageStream,
                             Rcpp::Function onWSClose,
                             Rcpp::List     staticPaths,
                             Rcpp::List     staticPathOptions,
+                            Rcpp::List     serverOptions,
                             bool           quiet
 ) {
 
@@ -266,8 +450,10 @@ Rcpp::RObject makeTcpServer(const std::string& host, int port,
   // this should be deleted when it goes out of scope.
   std::shared_ptr<RWebApplication> pHandler(
     new RWebApplication(onHeaders, onBodyData, onRequest,
-                        onWSOpen, onWSMessage, onWSClose,
-                        staticPaths, staticPathOptions),
+                        onWSOpen, onWSMessage, onWSMessageBatch,
+                        onWSMessageStream, onWSClose,
+                        staticPaths, staticPathOptions,
+                        serverOptions),
     auto_deleter_main<RWebApplication>
   );
 
@@ -313,9 +499,12 @@ Rcpp::RObject makePipeServer(const std::string& name,
                              Rcpp::Function onRequest,
                              Rcpp::Function onWSOpen,
                              Rcpp::Function onWSMessage,
+                             Rcpp::Function onWSMessageBatch,
+                             Rcpp::Function onWSMessageStream,
                              Rcpp::Function onWSClose,
                              Rcpp::List     staticPaths,
                              Rcpp::List     staticPathOptions,
+                             Rcpp::List     serverOptions,
                              bool           quiet
 ) {
 
@@ -326,8 +515,10 @@ Rcpp::RObject makePipeServer(const std::string& name,
   // this should be deleted when it goes out of scope.
   std::shared_ptr<RWebApplication> pHandler(
     new RWebApplication(onHeaders, onBodyData, onRequest,
-                        onWSOpen, onWSMessage, onWSClose,
-                        staticPaths, staticPathOptions),
+                        onWSOpen, onWSMessage, onWSMessageBatch,
+                        onWSMessageStream, onWSClose,
+                        staticPaths, staticPathOptions,
+                        serverOptions),
     auto_deleter_main<RWebApplication>
   );
 
@@ -391,6 +582,39 @@ void stopServer_(std::string handle) {
   stopServer_(pServer);
 }
 
+// Counters for a server's connections. These are read without waiting for
+// the background thread, so they may be slightly out of date.
+// [[Rcpp::export]]
+Rcpp::List getConnectionStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  uv_stream_t* pServer = internalize_str<uv_stream_t>(handle);
+  std::shared_ptr<Socket> pSocket(*(std::shared_ptr<Socket>*)pServer->data);
+
+  return Rcpp::List::create(
+    Rcpp::_["connections"] = (double)pSocket->connectionCount,
+    Rcpp::_["accepted"] = (double)pSocket->acceptedCount,
+    Rcpp::_["accept_errors"] = (double)pSocket->acceptErrorCount,
+    Rcpp::_["accept_paused"] = (double)pSocket->acceptPausedCount
+  );
+}
+
+// Counters for a server's traffic, and the state of the queues and the event
+// loop that all servers share. Like getConnectionStats_(), this doesn't wait
+// for the background thread.
+// [[Rcpp::export]]
+Rcpp::List getServerStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  uv_stream_t* pServer = internalize_str<uv_stream_t>(handle);
+  std::shared_ptr<Socket> pSocket(*(std::shared_ptr<Socket>*)pServer->data);
+
+  return pSocket->pWebApplication->getServerStats().asRObject(
+    pSocket->connectionCount,
+    background_queue->size(),
+    main_thread_scheduler()->size(),
+    io_loop_lag()
+  );
+}
+
 void stop_loop_timer_cb(uv_timer_t* handle) {
   uv_stop(handle->loop);
 }
@@ -447,72 +671,112 @@ Rcpp::List setStaticPathOptions_(std::string handle, Rcpp::List opts) {
 
 
 // ============================================================================
-// Miscellaneous utility functions
+// Fixed responses
 // ============================================================================
 
 // [[Rcpp::export]]
-std::string base64encode(const Rcpp::RawVector& x) {
-  return b64encode(x.begin(), x.end());
+Rcpp::List getFixedResponses_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  return get_pWebApplication(handle)->getFixedResponseManager().asRObject();
 }
 
-static std::string allowed = ";,/?:@&=+$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890-_.!~*'()";
-
-bool isReservedUrlChar(char c) {
-  switch (c) {
-    case ';':
-    case ',':
-    case '/':
-    case '?':
-    case ':':
-    case '@':
-    case '&':
-    case '=':
-    case '+':
-    case '$':
-      return true;
-    default:
-      return false;
-  }
+// [[Rcpp::export]]
+Rcpp::List setFixedResponse_(std::string handle, std::string method, std::string path,
+                             int status, Rcpp::List headers, Rcpp::RawVector body)
+{
+  ASSERT_MAIN_THREAD()
+  // The response is built before it's swapped in, so the background thread
+  // never sees a partly-built one.
+  std::shared_ptr<const FixedResponse> pResponse =
+    std::make_shared<const FixedResponse>(status, headers, body);
+  get_pWebApplication(handle)->getFixedResponseManager().set(method, path, pResponse);
+  return getFixedResponses_(handle);
 }
 
-bool needsEscape(char c, bool encodeReserved) {
-  if (c >= 'a' && c <= 'z')
-    return false;
-  if (c >= 'A' && c <= 'Z')
-    return false;
-  if (c >= '0' && c <= '9')
-    return false;
-  if (isReservedUrlChar(c))
-    return encodeReserved;
-  switch (c) {
-    case '-':
-    case '_':
-    case '.':
-    case '!':
-    case '~':
-    case '*':
-    case '\'':
-    case '(':
-    case ')':
-      return false;
-  }
-  return true;
+// [[Rcpp::export]]
+Rcpp::List removeFixedResponse_(std::string handle, std::string method, std::string path) {
+  ASSERT_MAIN_THREAD()
+  get_pWebApplication(handle)->getFixedResponseManager().remove(method, path);
+  return getFixedResponses_(handle);
 }
 
-std::string doEncodeURI(std::string value, bool encodeReserved) {
-  std::ostringstream os;
-  os << std::hex << std::uppercase;
-  for (std::string::const_iterator it = value.begin();
-    it != value.end();
-    it++) {
 
-    if (!needsEscape(*it, encodeReserved)) {
-      os << *it;
-    } else {
-      os << '%' << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(static_cast<unsigned char>(*it));
-    }
+// ============================================================================
+// Response cache
+// ============================================================================
+
+// [[Rcpp::export]]
+Rcpp::List getResponseCacheStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  return get_pWebApplication(handle)->getResponseCache().statsAsRObject();
+}
+
+// Remove cached responses for the given paths, or all of them if `paths` is
+// empty. Returns the number of responses removed.
+// [[Rcpp::export]]
+double purgeResponseCache_(std::string handle, Rcpp::CharacterVector paths) {
+  ASSERT_MAIN_THREAD()
+  ResponseCache& cache = get_pWebApplication(handle)->getResponseCache();
+  if (paths.size() == 0) {
+    return cache.purge();
   }
-  return os.str();
+
+  size_t n = 0;
+  for (R_len_t i = 0; i < paths.size(); i++) {
+    n += cache.purge(Rcpp::as<std::string>(paths[i]));
+  }
+  return n;
+}
+
+// [[Rcpp::export]]
+Rcpp::List getLoadSheddingStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  return get_pWebApplication(handle)->getLoadShedder().statsAsRObject();
+}
+
+// [[Rcpp::export]]
+Rcpp::List getLatencyStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  return get_pWebApplication(handle)->getRequestTimings().asRObject();
+}
+
+// [[Rcpp::export]]
+void resetLatencyStats_(std::string handle) {
+  ASSERT_MAIN_THREAD()
+  get_pWebApplication(handle)->getRequestTimings().reset();
+}
+
+
+// ============================================================================
+// Tracing
+// ============================================================================
+
+// [[Rcpp::export]]
+void startTracing_(double capacity) {
+  ASSERT_MAIN_THREAD()
+  trace_start((size_t)capacity);
+}
+
+// [[Rcpp::export]]
+void stopTracing_() {
+  ASSERT_MAIN_THREAD()
+  trace_stop();
+}
+
+// [[Rcpp::export]]
+double writeTrace_(std::string path) {
+  ASSERT_MAIN_THREAD()
+  return trace_write(path);
+}
+
+
+// ============================================================================
+// Miscellaneous utility functions
+// ============================================================================
+
+// [[Rcpp::export]]
+std::string base64encode(const Rcpp::RawVector& x) {
+  return b64encode(x.begin(), x.end());
 }
 
 //' URI encoding/decoding
@@ -572,66 +836,6 @@ Rcpp::CharacterVector encodeURIComponent(Rcpp::CharacterVector value) {
   return out;
 }
 
-int hexToInt(char c) {
-  switch (c) {
-    case '0': return 0;
-    case '1': return 1;
-    case '2': return 2;
-    case '3': return 3;
-    case '4': return 4;
-    case '5': return 5;
-    case '6': return 6;
-    case '7': return 7;
-    case '8': return 8;
-    case '9': return 9;
-    case 'A': case 'a': return 10;
-    case 'B': case 'b': return 11;
-    case 'C': case 'c': return 12;
-    case 'D': case 'd': return 13;
-    case 'E': case 'e': return 14;
-    case 'F': case 'f': return 15;
-    default: return -1;
-  }
-}
-
-std::string doDecodeURI(std::string value, bool component) {
-  std::ostringstream os;
-  for (std::string::const_iterator it = value.begin();
-    it != value.end();
-    it++) {
-
-    // If there aren't enough characters left for this to be a
-    // valid escape code, just use the character and move on
-    if (it > value.end() - 3) {
-      os << *it;
-      continue;
-    }
-
-    if (*it == '%') {
-      char hi = *(++it);
-      char lo = *(++it);
-      int iHi = hexToInt(hi);
-      int iLo = hexToInt(lo);
-      if (iHi < 0 || iLo < 0) {
-        // Invalid escape sequence
-        os << '%' << hi << lo;
-        continue;
-      }
-      char c = (char)(iHi << 4 | iLo);
-      if (!component && isReservedUrlChar(c)) {
-        os << '%' << hi << lo;
-      } else {
-        os << c;
-      }
-    } else {
-      os << *it;
-    }
-  }
-
-  return os.str();
-}
-
-
 //' @rdname encodeURI
 //' @export
 // [[Rcpp::export]]
@@ -732,15 +936,3 @@ void getRNGState() {
   GetRNGstate();
 }
 
-// We are given an external pointer to a
-// std::shared_ptr<WebSocketConnection>. This returns a hexadecimal string
-// representing the address of the WebSocketConnection (not the shared_ptr to
-// it!).
-//
-//[[Rcpp::export]]
-std::string wsconn_address(SEXP external_ptr) {
-  Rcpp::XPtr<std::shared_ptr<WebSocketConnection> > xptr(external_ptr);
-  std::ostringstream os;
-  os << std::hex << reinterpret_cast<uintptr_t>(xptr.get()->get());
-  return os.str();
-}
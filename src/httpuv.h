@@ -7,7 +7,8 @@
 
 void invokeCppCallback(Rcpp::List data, SEXP callback_xptr);
 
-std::string doEncodeURI(std::string value, bool encodeReserved);
-std::string doDecodeURI(std::string value, bool component);
+// How late, in seconds, the background thread's event loop was when it was
+// last checked. May be called from either thread.
+double io_loop_lag();
 
 #endif
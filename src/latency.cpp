@@ -0,0 +1,169 @@
+#include "latency.h"
+#include "thread.h"
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < BUCKETS; i++) {
+    _counts[i] = 0;
+  }
+  _count = 0;
+  _sum = 0;
+  _max = 0;
+}
+
+int LatencyHistogram::_bucketIndex(uint64_t value) {
+  if (value < (uint64_t)SUB_BUCKETS) {
+    return (int)value;
+  }
+  int msb = 63;
+  while (!(value >> msb)) {
+    msb--;
+  }
+  if (msb > MAX_BITS) {
+    return BUCKETS - 1;
+  }
+  int shift = msb - SUB_BUCKET_BITS;
+  int sub = (int)(value >> shift) - SUB_BUCKETS;
+  return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::_bucketLow(int index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+  int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+  return (uint64_t)(SUB_BUCKETS + sub) << shift;
+}
+
+uint64_t LatencyHistogram::_bucketWidth(int index) {
+  if (index < SUB_BUCKETS) {
+    return 1;
+  }
+  return (uint64_t)1 << ((index - SUB_BUCKETS) / SUB_BUCKETS);
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  _counts[_bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+  _count.fetch_add(1, std::memory_order_relaxed);
+  _sum.fetch_add(micros, std::memory_order_relaxed);
+
+  uint64_t max = _max.load(std::memory_order_relaxed);
+  while (micros > max &&
+         !_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+  }
+}
+
+double LatencyHistogram::mean() const {
+  uint64_t count = _count;
+  if (count == 0) {
+    return 0;
+  }
+  return (double)_sum / count;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+  // The counts can change while this runs, so the total is taken from the
+  // buckets themselves.
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    counts[i] = _counts[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)(q * total);
+  if (rank >= total) {
+    rank = total - 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen > rank) {
+      // The middle of the bucket, but never more than the largest value.
+      uint64_t value = _bucketLow(i) + _bucketWidth(i) / 2;
+      return std::min(value, (uint64_t)_max);
+    }
+  }
+  return _max;
+}
+
+
+RequestTimestamps::RequestTimestamps()
+  : start(0), headersComplete(0), queued(0), appStart(0), appEnd(0),
+    converted(0), resumed(0), writeStarted(0), headWritten(0), finished(0)
+{
+}
+
+
+void RequestTimings::_record(LatencyPhase phase, uint64_t from, uint64_t to) {
+  if (from == 0 || to == 0 || to < from) {
+    return;
+  }
+  _phases[phase].record((to - from) / 1000);
+}
+
+void RequestTimings::record(const RequestTimestamps& ts) {
+  ASSERT_BACKGROUND_THREAD()
+  _record(PHASE_HEADERS, ts.start, ts.headersComplete);
+  _record(PHASE_MAIN_QUEUE, ts.queued, ts.appStart);
+  _record(PHASE_APP, ts.appStart, ts.appEnd);
+  _record(PHASE_CONVERT, ts.appEnd, ts.converted);
+  _record(PHASE_BACKGROUND_QUEUE, ts.converted, ts.resumed);
+  _record(PHASE_WRITE_HEAD, ts.writeStarted, ts.headWritten);
+  _record(PHASE_WRITE_BODY, ts.headWritten, ts.finished);
+  _record(PHASE_TOTAL, ts.start, ts.finished);
+}
+
+const char* RequestTimings::phaseName(LatencyPhase phase) {
+  static const char* names[PHASE_COUNT] = {
+    "headers", "main_queue", "app", "convert", "background_queue",
+    "write_head", "write_body", "total"
+  };
+  return names[phase];
+}
+
+Rcpp::List RequestTimings::asRObject() const {
+  ASSERT_MAIN_THREAD()
+  using namespace Rcpp;
+
+  CharacterVector phase(PHASE_COUNT);
+  NumericVector count(PHASE_COUNT), mean(PHASE_COUNT), p50(PHASE_COUNT),
+    p90(PHASE_COUNT), p99(PHASE_COUNT), p999(PHASE_COUNT), max(PHASE_COUNT);
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    const LatencyHistogram& h = _phases[i];
+    phase[i] = phaseName((LatencyPhase)i);
+    count[i] = (double)h.count();
+    mean[i] = h.mean() / 1e6;
+    p50[i] = h.quantile(0.5) / 1e6;
+    p90[i] = h.quantile(0.9) / 1e6;
+    p99[i] = h.quantile(0.99) / 1e6;
+    p999[i] = h.quantile(0.999) / 1e6;
+    max[i] = h.max() / 1e6;
+  }
+
+  return List::create(
+    _["phase"] = phase,
+    _["count"] = count,
+    _["mean"] = mean,
+    _["p50"] = p50,
+    _["p90"] = p90,
+    _["p99"] = p99,
+    _["p999"] = p999,
+    _["max"] = max
+  );
+}
+
+void RequestTimings::reset() {
+  ASSERT_MAIN_THREAD()
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    _phases[i].reset();
+  }
+}
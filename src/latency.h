@@ -0,0 +1,114 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <Rcpp.h>
+#include "constants.h"
+
+// A histogram of durations, in the style of HdrHistogram. Values are
+// recorded in microseconds. Values below 16 get a bucket each; above that,
+// each power of two is split into 16 buckets, so a reported value is within
+// about 6% of the recorded one. Recording is lock-free, so it can be done
+// from either thread, and reading can happen while values are recorded.
+class LatencyHistogram : NoCopy {
+public:
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  // Values up to 2^40 microseconds (about 12 days); longer ones are counted
+  // in the last bucket.
+  static const int MAX_BITS = 40;
+  static const int BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+  std::atomic<uint64_t> _counts[BUCKETS];
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _sum;
+  std::atomic<uint64_t> _max;
+
+  static int _bucketIndex(uint64_t value);
+  // The range of values that fall in a bucket
+  static uint64_t _bucketLow(int index);
+  static uint64_t _bucketWidth(int index);
+
+public:
+  LatencyHistogram();
+
+  void record(uint64_t micros);
+  void reset();
+
+  uint64_t count() const {
+    return _count;
+  }
+  uint64_t max() const {
+    return _max;
+  }
+  uint64_t sum() const {
+    return _sum;
+  }
+  double mean() const;
+  // The value below which the fraction `q` of the recorded values fall.
+  uint64_t quantile(double q) const;
+};
+
+
+// The times, from uv_hrtime(), at which a request was handed from one stage
+// of handling to the next. A time of 0 means the request didn't go through
+// that stage; for example, static files aren't sent to R.
+struct RequestTimestamps {
+  // http-parser saw the first byte of the request
+  uint64_t start;
+  uint64_t headersComplete;
+  // The call to the app was added to the main thread's queue, and the main
+  // thread started and finished running the app. For an app that returns a
+  // promise, it finishes when the promise is resolved.
+  uint64_t queued;
+  uint64_t appStart;
+  uint64_t appEnd;
+  // The response was converted to C++, and added to the background thread's
+  // queue; and the background thread picked it up.
+  uint64_t converted;
+  uint64_t resumed;
+  // Writing the response started, the head was written, and the body was
+  // written.
+  uint64_t writeStarted;
+  uint64_t headWritten;
+  uint64_t finished;
+
+  RequestTimestamps();
+};
+
+enum LatencyPhase {
+  PHASE_HEADERS,
+  PHASE_MAIN_QUEUE,
+  PHASE_APP,
+  PHASE_CONVERT,
+  PHASE_BACKGROUND_QUEUE,
+  PHASE_WRITE_HEAD,
+  PHASE_WRITE_BODY,
+  PHASE_TOTAL,
+  PHASE_COUNT
+};
+
+// A histogram for each phase of handling requests, for one server.
+class RequestTimings : NoCopy {
+  LatencyHistogram _phases[PHASE_COUNT];
+
+  void _record(LatencyPhase phase, uint64_t from, uint64_t to);
+
+public:
+  // Background thread. Called when a response has been sent.
+  void record(const RequestTimestamps& timestamps);
+
+  const LatencyHistogram& phase(LatencyPhase phase) const {
+    return _phases[phase];
+  }
+  static const char* phaseName(LatencyPhase phase);
+
+  // Main thread. Returns a list of columns for a data frame, with a row per
+  // phase. Durations are in seconds.
+  Rcpp::List asRObject() const;
+  void reset();
+};
+
+#endif // LATENCY_HPP
@@ -0,0 +1,58 @@
+#include "loadshedder.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "utils.h"
+#include <cmath>
+
+LoadShedder::LoadShedder(uint64_t maxQueueDelayMs,
+                         double retryAfter,
+                         const std::vector<std::string>& exempt)
+  : _maxQueueDelayMs(maxQueueDelayMs),
+    _retryAfter(toString((uint64_t)std::ceil(retryAfter))),
+    _exempt(exempt),
+    _shed(0),
+    _lastShedDelayMs(0)
+{
+}
+
+static bool path_is_under(const std::string& path, const std::string& prefix) {
+  if (path.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  return path.size() == prefix.size() ||
+    (!prefix.empty() && prefix[prefix.size() - 1] == '/') ||
+    path[prefix.size()] == '/';
+}
+
+bool LoadShedder::shouldShed(const std::string& path) {
+  ASSERT_BACKGROUND_THREAD()
+  if (!enabled()) {
+    return false;
+  }
+
+  uint64_t delay = main_thread_scheduler()->queueDelayMs();
+  if (delay <= _maxQueueDelayMs) {
+    return false;
+  }
+
+  for (size_t i = 0; i < _exempt.size(); i++) {
+    if (path_is_under(path, _exempt[i])) {
+      return false;
+    }
+  }
+
+  _shed++;
+  _lastShedDelayMs = delay;
+  return true;
+}
+
+Rcpp::List LoadShedder::statsAsRObject() const {
+  ASSERT_MAIN_THREAD()
+  using namespace Rcpp;
+  return List::create(
+    _["shed"] = (double)_shed,
+    _["queue_delay"] = main_thread_scheduler()->queueDelayMs() / 1000.0,
+    _["last_shed_queue_delay"] = _lastShedDelayMs / 1000.0,
+    _["max_queue_delay"] = enabled() ? _maxQueueDelayMs / 1000.0 : R_PosInf
+  );
+}
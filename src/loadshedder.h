@@ -0,0 +1,54 @@
+#ifndef LOADSHEDDER_HPP
+#define LOADSHEDDER_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <Rcpp.h>
+#include "constants.h"
+
+// Turns requests away with a 503 when the main thread has fallen too far
+// behind, instead of queueing work for R that won't be done until the client
+// has given up. The decision is made on the background thread, when a
+// request's headers arrive, from the delay reported by the main thread's
+// scheduler. Requests for the exempt paths (for example, health checks) are
+// always let through.
+class LoadShedder : NoCopy {
+  // 0 disables load shedding
+  const uint64_t _maxQueueDelayMs;
+  const std::string _retryAfter;
+  // Paths that are never shed. A path also covers the paths below it.
+  const std::vector<std::string> _exempt;
+
+  std::atomic<uint64_t> _shed;
+  std::atomic<uint64_t> _lastShedDelayMs;
+
+public:
+  LoadShedder(uint64_t maxQueueDelayMs,
+              double retryAfter,
+              const std::vector<std::string>& exempt);
+
+  bool enabled() const {
+    return _maxQueueDelayMs > 0;
+  }
+
+  // Background thread. Returns true if a request for `path` (already
+  // decoded, without the query string) should be turned away.
+  bool shouldShed(const std::string& path);
+
+  // The value for the Retry-After header of the 503 response
+  const std::string& retryAfter() const {
+    return _retryAfter;
+  }
+
+  // The number of requests that have been shed
+  uint64_t shedCount() const {
+    return _shed;
+  }
+
+  // Main thread
+  Rcpp::List statsAsRObject() const;
+};
+
+#endif // LOADSHEDDER_HPP
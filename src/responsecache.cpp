@@ -0,0 +1,172 @@
+#include "responsecache.h"
+#include "utils.h"
+#include "uri.h"
+
+static uint64_t now_ms() {
+  return uv_hrtime() / 1000000;
+}
+
+bool CachedResponse::matches(const RequestHeaders& requestHeaders) const {
+  std::vector<std::pair<std::string, std::string> >::const_iterator it;
+  for (it = vary.begin(); it != vary.end(); it++) {
+    RequestHeaders::const_iterator h = requestHeaders.find(it->first);
+    const std::string& value = (h == requestHeaders.end()) ? std::string() : h->second;
+    if (value != it->second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t CachedResponse::age() const {
+  return (now_ms() - storedMs) / 1000;
+}
+
+
+ResponseCache::ResponseCache(size_t maxBytes)
+  : _bytes(0), _maxBytes(maxBytes),
+    _hits(0), _misses(0), _stores(0), _evictions(0)
+{
+  uv_mutex_init(&_mutex);
+}
+
+ResponseCache::~ResponseCache() {
+  uv_mutex_destroy(&_mutex);
+}
+
+// Must be called with the mutex held.
+void ResponseCache::_erase(EntryList::iterator it) {
+  const CachedResponse& entry = **it;
+  std::map<Key, std::vector<EntryList::iterator> >::iterator idx =
+    _index.find(Key(entry.method, entry.url));
+  if (idx != _index.end()) {
+    std::vector<EntryList::iterator>& variants = idx->second;
+    for (size_t i = 0; i < variants.size(); i++) {
+      if (variants[i] == it) {
+        variants.erase(variants.begin() + i);
+        break;
+      }
+    }
+    if (variants.empty()) {
+      _index.erase(idx);
+    }
+  }
+  _bytes -= entry.size;
+  _lru.erase(it);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::get(
+  const std::string& method,
+  const std::string& url,
+  const RequestHeaders& requestHeaders)
+{
+  guard guard(_mutex);
+  if (_lru.empty()) {
+    _misses++;
+    return std::shared_ptr<const CachedResponse>();
+  }
+
+  const std::string& key_method = (method == "HEAD") ? std::string("GET") : method;
+  std::map<Key, std::vector<EntryList::iterator> >::iterator idx =
+    _index.find(Key(key_method, url));
+  if (idx == _index.end()) {
+    _misses++;
+    return std::shared_ptr<const CachedResponse>();
+  }
+
+  uint64_t now = now_ms();
+  // Copy the list of variants, because expired entries are erased from it.
+  std::vector<EntryList::iterator> variants = idx->second;
+  for (size_t i = 0; i < variants.size(); i++) {
+    EntryList::iterator it = variants[i];
+    if ((*it)->expiresMs <= now) {
+      _erase(it);
+      continue;
+    }
+    if ((*it)->matches(requestHeaders)) {
+      // Move to the front of the LRU list. Iterators remain valid.
+      _lru.splice(_lru.begin(), _lru, it);
+      _hits++;
+      return *it;
+    }
+  }
+
+  _misses++;
+  return std::shared_ptr<const CachedResponse>();
+}
+
+void ResponseCache::put(std::shared_ptr<CachedResponse> pEntry, uint64_t ttlMs) {
+  ASSERT_MAIN_THREAD()
+  if (pEntry->size > _maxBytes || ttlMs == 0) {
+    return;
+  }
+  pEntry->storedMs = now_ms();
+  pEntry->expiresMs = pEntry->storedMs + ttlMs;
+
+  guard guard(_mutex);
+  std::vector<EntryList::iterator>& variants = _index[Key(pEntry->method, pEntry->url)];
+  for (size_t i = 0; i < variants.size(); i++) {
+    if ((*variants[i])->vary == pEntry->vary) {
+      EntryList::iterator old = variants[i];
+      variants.erase(variants.begin() + i);
+      _bytes -= (*old)->size;
+      _lru.erase(old);
+      break;
+    }
+  }
+
+  _lru.push_front(pEntry);
+  variants.push_back(_lru.begin());
+  _bytes += pEntry->size;
+  _stores++;
+
+  while (_bytes > _maxBytes) {
+    EntryList::iterator last = _lru.end();
+    last--;
+    _erase(last);
+    _evictions++;
+  }
+}
+
+size_t ResponseCache::purge() {
+  ASSERT_MAIN_THREAD()
+  guard guard(_mutex);
+  size_t n = _lru.size();
+  _lru.clear();
+  _index.clear();
+  _bytes = 0;
+  return n;
+}
+
+size_t ResponseCache::purge(const std::string& path) {
+  ASSERT_MAIN_THREAD()
+  guard guard(_mutex);
+  size_t n = 0;
+  EntryList::iterator it = _lru.begin();
+  while (it != _lru.end()) {
+    EntryList::iterator next = it;
+    next++;
+    const std::string& url = (*it)->url;
+    if (doDecodeURI(url.substr(0, url.find('?')), true) == path) {
+      _erase(it);
+      n++;
+    }
+    it = next;
+  }
+  return n;
+}
+
+Rcpp::List ResponseCache::statsAsRObject() const {
+  ASSERT_MAIN_THREAD()
+  using namespace Rcpp;
+  guard guard(_mutex);
+  return List::create(
+    _["hits"]      = (double)_hits,
+    _["misses"]    = (double)_misses,
+    _["stores"]    = (double)_stores,
+    _["evictions"] = (double)_evictions,
+    _["entries"]   = (double)_lru.size(),
+    _["bytes"]     = (double)_bytes,
+    _["max_bytes"] = (double)_maxBytes
+  );
+}
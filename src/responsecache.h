@@ -0,0 +1,96 @@
+#ifndef RESPONSECACHE_HPP
+#define RESPONSECACHE_HPP
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <uv.h>
+#include <Rcpp.h>
+#include "constants.h"
+#include "thread.h"
+
+// A response that R allowed to be reused for later requests.
+class CachedResponse {
+public:
+  std::string method;
+  std::string url;
+  // The request headers named by the response's Vary header, with the values
+  // they had in the request that produced the response. Later requests must
+  // have the same values to get this response.
+  std::vector<std::pair<std::string, std::string> > vary;
+
+  int status;
+  ResponseHeaders headers;
+  std::shared_ptr<const std::vector<uint8_t> > body;
+
+  // uv_hrtime() in milliseconds
+  uint64_t storedMs;
+  uint64_t expiresMs;
+  // Approximate number of bytes used by this entry
+  size_t size;
+
+  bool matches(const RequestHeaders& requestHeaders) const;
+  // Seconds since the entry was stored, for the Age header
+  uint64_t age() const;
+};
+
+
+// A cache of responses from R, which the background thread uses to answer
+// matching requests without a round trip through the main thread. Entries
+// are keyed by method and URL (including the query string), and by the
+// values of the request headers named in the response's Vary header. Each
+// entry expires after the TTL that R gave it. The total size of the entries
+// is kept under `maxBytes` by evicting the least recently used ones.
+//
+// Entries are added and purged on the main thread, and looked up on the
+// background thread.
+class ResponseCache : NoCopy {
+  typedef std::list<std::shared_ptr<const CachedResponse> > EntryList;
+  typedef std::pair<std::string, std::string> Key;
+
+  // Most recently used first
+  EntryList _lru;
+  // All of the variants for a method and URL
+  std::map<Key, std::vector<EntryList::iterator> > _index;
+  size_t _bytes;
+  const size_t _maxBytes;
+
+  uint64_t _hits;
+  uint64_t _misses;
+  uint64_t _stores;
+  uint64_t _evictions;
+
+  // Mutex is used whenever any of the above are accessed.
+  mutable uv_mutex_t _mutex;
+
+  void _erase(EntryList::iterator it);
+
+public:
+  explicit ResponseCache(size_t maxBytes);
+  ~ResponseCache();
+
+  bool enabled() const {
+    return _maxBytes > 0;
+  }
+
+  // Background thread. Returns an empty pointer on a miss. A HEAD request
+  // can be answered with the response to a GET.
+  std::shared_ptr<const CachedResponse> get(const std::string& method,
+                                            const std::string& url,
+                                            const RequestHeaders& requestHeaders);
+
+  // Main thread. Stores an entry that expires after `ttlMs`, replacing any
+  // entry with the same key.
+  void put(std::shared_ptr<CachedResponse> pEntry, uint64_t ttlMs);
+
+  // Main thread. Removes all entries, or the ones whose URL has the given
+  // path (ignoring the query string). Returns the number removed.
+  size_t purge();
+  size_t purge(const std::string& path);
+
+  Rcpp::List statsAsRObject() const;
+};
+
+#endif // RESPONSECACHE_HPP
@@ -0,0 +1,187 @@
+#include "scheduler.h"
+#include "thread.h"
+#include "trace.h"
+#include <later_api.h>
+#include <algorithm>
+#include <limits>
+
+static const uint64_t NO_DELAY = std::numeric_limits<uint64_t>::max();
+
+static uint64_t now_ms() {
+  return uv_hrtime() / 1000000;
+}
+
+static void run_scheduler(void* data) {
+  reinterpret_cast<MainThreadScheduler*>(data)->run();
+}
+
+MainThreadScheduler::MainThreadScheduler()
+  : _size(0), _skips(0), _scheduled(false),
+    _minDelayMs(NO_DELAY), _prevMinDelayMs(NO_DELAY),
+    _windowStartMs(now_ms()), _busySinceMs(0), _lastPopMs(0)
+{
+  uv_mutex_init(&_mutex);
+}
+
+MainThreadScheduler::~MainThreadScheduler() {
+  uv_mutex_destroy(&_mutex);
+}
+
+void MainThreadScheduler::push(const void* owner,
+                               MainThreadPriority priority,
+                               std::function<void(void)> fun)
+{
+  uint64_t now = now_ms();
+  guard guard(_mutex);
+  if (_size == 0) {
+    _busySinceMs = now;
+  }
+  std::deque<Item>& queue = _queues[owner];
+  Item item = { priority, fun, now };
+  queue.push_back(item);
+  // If the owner already had items, it's already waiting its turn.
+  if (queue.size() == 1) {
+    _ready[priority].push_back(owner);
+  }
+  _size++;
+
+  if (!_scheduled) {
+    _schedule();
+  }
+}
+
+// Called with the mutex held.
+void MainThreadScheduler::_schedule() {
+  _scheduled = true;
+  later::later(run_scheduler, this, 0);
+}
+
+// Take the next item. Called with the mutex held.
+bool MainThreadScheduler::_pop(std::function<void(void)>* pFun) {
+  int priority = 0;
+  while (priority < PRIORITY_COUNT && _ready[priority].empty()) {
+    priority++;
+  }
+  if (priority == PRIORITY_COUNT) {
+    return false;
+  }
+
+  // If items with a lower priority are waiting, check whether they've been
+  // passed over too many times in a row.
+  int lowest = PRIORITY_COUNT - 1;
+  while (lowest > priority && _ready[lowest].empty()) {
+    lowest--;
+  }
+  if (lowest == priority) {
+    _skips = 0;
+  } else if (++_skips > MAX_PRIORITY_SKIPS) {
+    _skips = 0;
+    priority = lowest;
+  }
+
+  const void* owner = _ready[priority].front();
+  _ready[priority].pop_front();
+
+  std::map<const void*, std::deque<Item> >::iterator it = _queues.find(owner);
+  std::deque<Item>& queue = it->second;
+  pFun->swap(queue.front().fun);
+
+  uint64_t now = now_ms();
+  _rotateWindow(now);
+  _minDelayMs = std::min(_minDelayMs, now - std::min(now, queue.front().queuedMs));
+  _lastPopMs = now;
+
+  queue.pop_front();
+  _size--;
+
+  // The owner goes to the back of the line for its next item.
+  if (queue.empty()) {
+    _queues.erase(it);
+  } else {
+    _ready[queue.front().priority].push_back(owner);
+  }
+  return true;
+}
+
+void MainThreadScheduler::run() {
+  ASSERT_MAIN_THREAD()
+  for (size_t i = 0; i < SLICE_SIZE; i++) {
+    std::function<void(void)> fun;
+    {
+      guard guard(_mutex);
+      if (!_pop(&fun)) {
+        break;
+      }
+    }
+
+    try {
+      fun();
+    } catch (...) {
+      // Don't leave the remaining items stranded.
+      _finishSlice();
+      throw;
+    }
+  }
+
+  _finishSlice();
+}
+
+void MainThreadScheduler::_finishSlice() {
+  guard guard(_mutex);
+  if (_size > 0) {
+    _schedule();
+  } else {
+    _scheduled = false;
+  }
+}
+
+size_t MainThreadScheduler::size() {
+  guard guard(_mutex);
+  return _size;
+}
+
+// Called with the mutex held.
+void MainThreadScheduler::_rotateWindow(uint64_t nowMs) {
+  uint64_t elapsed = nowMs - std::min(nowMs, _windowStartMs);
+  if (elapsed < DELAY_WINDOW_MS) {
+    return;
+  }
+  // If a whole window went by with nothing run, the previous window is empty.
+  _prevMinDelayMs = elapsed < 2 * DELAY_WINDOW_MS ? _minDelayMs : NO_DELAY;
+  _minDelayMs = NO_DELAY;
+  _windowStartMs = nowMs;
+}
+
+uint64_t MainThreadScheduler::queueDelayMs() {
+  uint64_t now = now_ms();
+  guard guard(_mutex);
+  if (_size == 0) {
+    return 0;
+  }
+  _rotateWindow(now);
+
+  uint64_t stalled = now - std::min(now, std::max(_busySinceMs, _lastPopMs));
+  uint64_t recent = std::min(_minDelayMs, _prevMinDelayMs);
+  if (recent == NO_DELAY) {
+    recent = 0;
+  }
+  return std::max(stalled, recent);
+}
+
+
+MainThreadScheduler* main_thread_scheduler() {
+  // This is never deleted, because items may still be added by the
+  // background thread while the process exits.
+  static MainThreadScheduler* scheduler = new MainThreadScheduler();
+  return scheduler;
+}
+
+void invoke_main(const void* owner,
+                 MainThreadPriority priority,
+                 std::function<void(void)> fun)
+{
+  if (trace_enabled()) {
+    fun = trace_handoff(TRACE_MAIN_THREAD, fun);
+  }
+  main_thread_scheduler()->push(owner, priority, fun);
+}
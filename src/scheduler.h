@@ -0,0 +1,111 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <deque>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <uv.h>
+#include "constants.h"
+
+// Priority classes for work that the background thread sends to the main
+// thread. Lower values run first.
+enum MainThreadPriority {
+  // Small items that other work waits on: WebSocket open and close, and
+  // flow control for streamed responses.
+  PRIORITY_CONTROL = 0,
+  // Request headers, responses, and WebSocket messages.
+  PRIORITY_NORMAL = 1,
+  // Request body data and parts of large WebSocket messages.
+  PRIORITY_BULK = 2
+};
+const int PRIORITY_COUNT = 3;
+
+// The queue of work for the main thread. Instead of putting each item in
+// later's global queue, where a client that sends thousands of body chunks
+// gets ahead of everyone else, the items are kept here and run by a callback
+// that later runs on the main thread.
+//
+// Each item belongs to an owner, usually a connection. An owner's items run
+// in the order they were added, because they depend on each other (a
+// request's headers have to be handled before its body). Among owners, the
+// one whose next item has the highest priority goes first, and owners with
+// the same priority take turns, one item at a time. So that bulk work isn't
+// starved, an item from the lowest waiting class runs after
+// `MAX_PRIORITY_SKIPS` items from higher classes have gone ahead of it.
+//
+// At most `SLICE_SIZE` items are run each time later calls in; if there are
+// more, the callback is rescheduled, so that other later callbacks (and R's
+// own event handling) get a turn.
+//
+// Items are added from either thread, and run on the main thread.
+class MainThreadScheduler : NoCopy {
+  struct Item {
+    MainThreadPriority priority;
+    std::function<void(void)> fun;
+    // uv_hrtime() in milliseconds
+    uint64_t queuedMs;
+  };
+
+  // The pending items for each owner
+  std::map<const void*, std::deque<Item> > _queues;
+  // For each priority, the owners whose next item has that priority, in the
+  // order that they'll take turns.
+  std::deque<const void*> _ready[PRIORITY_COUNT];
+  size_t _size;
+  int _skips;
+  // True if a call to run() is waiting in later's queue.
+  bool _scheduled;
+
+  // For measuring queue delay: the shortest time that an item waited in the
+  // queue, for the items that were run in the current and the previous
+  // window of DELAY_WINDOW_MS; the start of the current window; and when
+  // the queue last became non-empty, and last had an item taken from it.
+  uint64_t _minDelayMs;
+  uint64_t _prevMinDelayMs;
+  uint64_t _windowStartMs;
+  uint64_t _busySinceMs;
+  uint64_t _lastPopMs;
+
+  // Mutex is used whenever any of the above are accessed.
+  uv_mutex_t _mutex;
+
+  bool _pop(std::function<void(void)>* pFun);
+  void _schedule();
+  void _finishSlice();
+  void _rotateWindow(uint64_t nowMs);
+
+public:
+  static const size_t SLICE_SIZE = 64;
+  static const int MAX_PRIORITY_SKIPS = 16;
+  static const uint64_t DELAY_WINDOW_MS = 100;
+
+  MainThreadScheduler();
+  ~MainThreadScheduler();
+
+  void push(const void* owner,
+            MainThreadPriority priority,
+            std::function<void(void)> fun);
+  // Main thread. Run up to SLICE_SIZE items.
+  void run();
+
+  size_t size();
+
+  // Any thread. How far behind the main thread is, in the style of CoDel:
+  // the shortest time that the items run in the last 100-200 ms spent
+  // waiting, or the time that the queue has gone without an item being
+  // run, whichever is longer. This is 0 when the queue is empty. Because
+  // it's a minimum, a short burst of work doesn't raise it; only a queue
+  // that isn't draining does.
+  uint64_t queueDelayMs();
+};
+
+MainThreadScheduler* main_thread_scheduler();
+
+// Schedule a function to run on the main thread, after the functions that
+// were scheduled earlier for the same owner.
+void invoke_main(const void* owner,
+                 MainThreadPriority priority,
+                 std::function<void(void)> fun);
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,167 @@
+#include "serveroptions.h"
+#include "thread.h"
+#include "utils.h"
+#include <cmath>
+#include <limits>
+
+// Convert a non-negative number from R to a size_t; Inf means no limit.
+static size_t asSizeLimit(SEXP x) {
+  double value = Rcpp::as<double>(x);
+  if (value >= (double)std::numeric_limits<size_t>::max()) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return static_cast<size_t>(value);
+}
+
+// Convert a timeout in seconds from R to milliseconds; 0 and Inf both mean
+// no timeout.
+static uint64_t asTimeoutMs(SEXP x) {
+  double value = Rcpp::as<double>(x);
+  if (value * 1000 >= (double)std::numeric_limits<uint64_t>::max()) {
+    return 0;
+  }
+  // Round up, so that a tiny timeout doesn't turn into no timeout.
+  return static_cast<uint64_t>(std::ceil(value * 1000));
+}
+
+ServerOptions::ServerOptions() :
+  ws_deflate(false),
+  ws_deflate_threshold(0),
+  ws_deflate_window_bits(15),
+  ws_deflate_mem_level(8),
+  ws_deflate_server_no_context_takeover(false),
+  ws_deflate_client_no_context_takeover(false),
+  ws_send_buffer_limit(std::numeric_limits<size_t>::max()),
+  ws_send_buffer_policy(WS_SEND_CLOSE),
+  ws_batch(WS_BATCH_NONE),
+  ws_batch_size(100),
+  ws_batch_latency_ms(0),
+  ws_ping_interval_ms(20000),
+  ws_ping_jitter(0.1),
+  ws_ping_max_missed(0),
+  ws_max_message_size(std::numeric_limits<size_t>::max()),
+  ws_large_message(WS_LARGE_MESSAGE_BUFFER),
+  ws_large_message_threshold(1048576),
+  idle_timeout_ms(0),
+  header_timeout_ms(0),
+  body_timeout_ms(0),
+  write_timeout_ms(0),
+  listen_backlog(128),
+  max_connections(std::numeric_limits<size_t>::max()),
+  accept_batch_size(64),
+  response_cache_size(16 * 1024 * 1024),
+  coalesce(false),
+  shed_queue_delay_ms(0),
+  shed_retry_after(1),
+  admin_remote(false)
+{ }
+
+ServerOptions::ServerOptions(const Rcpp::List& options) : ServerOptions() {
+  ASSERT_MAIN_THREAD()
+
+  std::string obj_class = options.attr("class");
+  if (obj_class != "serverOptions") {
+    throw Rcpp::exception("Server options object must have class 'serverOptions'.");
+  }
+
+  ws_deflate = Rcpp::as<bool>(options["ws_deflate"]);
+  ws_deflate_threshold = asSizeLimit(options["ws_deflate_threshold"]);
+  ws_deflate_window_bits = Rcpp::as<int>(options["ws_deflate_window_bits"]);
+  ws_deflate_mem_level = Rcpp::as<int>(options["ws_deflate_mem_level"]);
+  ws_deflate_server_no_context_takeover =
+    Rcpp::as<bool>(options["ws_deflate_server_no_context_takeover"]);
+  ws_deflate_client_no_context_takeover =
+    Rcpp::as<bool>(options["ws_deflate_client_no_context_takeover"]);
+
+  ws_send_buffer_limit = asSizeLimit(options["ws_send_buffer_limit"]);
+  std::string policy = Rcpp::as<std::string>(options["ws_send_buffer_policy"]);
+  if (policy == "drop_newest") {
+    ws_send_buffer_policy = WS_SEND_DROP_NEWEST;
+  } else if (policy == "drop_oldest") {
+    ws_send_buffer_policy = WS_SEND_DROP_OLDEST;
+  } else if (policy == "close") {
+    ws_send_buffer_policy = WS_SEND_CLOSE;
+  } else {
+    throw Rcpp::exception("Unknown ws_send_buffer_policy.");
+  }
+
+  std::string batch = Rcpp::as<std::string>(options["ws_batch"]);
+  if (batch == "none") {
+    ws_batch = WS_BATCH_NONE;
+  } else if (batch == "connection") {
+    ws_batch = WS_BATCH_CONNECTION;
+  } else if (batch == "global") {
+    ws_batch = WS_BATCH_GLOBAL;
+  } else {
+    throw Rcpp::exception("Unknown ws_batch mode.");
+  }
+  ws_batch_size = asSizeLimit(options["ws_batch_size"]);
+  ws_batch_latency_ms = asTimeoutMs(options["ws_batch_latency"]);
+  if (ws_batch_size < 1) {
+    throw Rcpp::exception("ws_batch_size must be at least 1.");
+  }
+
+  ws_ping_interval_ms = asTimeoutMs(options["ws_ping_interval"]);
+  ws_ping_jitter = Rcpp::as<double>(options["ws_ping_jitter"]);
+  ws_ping_max_missed = Rcpp::as<unsigned int>(options["ws_ping_max_missed"]);
+  if (ws_ping_jitter < 0 || ws_ping_jitter > 1) {
+    throw Rcpp::exception("ws_ping_jitter must be between 0 and 1.");
+  }
+
+  ws_max_message_size = asSizeLimit(options["ws_max_message_size"]);
+  std::string largeMessage = Rcpp::as<std::string>(options["ws_large_message"]);
+  if (largeMessage == "buffer") {
+    ws_large_message = WS_LARGE_MESSAGE_BUFFER;
+  } else if (largeMessage == "stream") {
+    ws_large_message = WS_LARGE_MESSAGE_STREAM;
+  } else if (largeMessage == "spool") {
+    ws_large_message = WS_LARGE_MESSAGE_SPOOL;
+  } else {
+    throw Rcpp::exception("Unknown ws_large_message mode.");
+  }
+  ws_large_message_threshold = asSizeLimit(options["ws_large_message_threshold"]);
+  if (ws_large_message_threshold < 1) {
+    throw Rcpp::exception("ws_large_message_threshold must be at least 1.");
+  }
+  ws_spool_dir = Rcpp::as<std::string>(options["ws_spool_dir"]);
+
+  idle_timeout_ms = asTimeoutMs(options["idle_timeout"]);
+  header_timeout_ms = asTimeoutMs(options["header_timeout"]);
+  body_timeout_ms = asTimeoutMs(options["body_timeout"]);
+  write_timeout_ms = asTimeoutMs(options["write_timeout"]);
+
+  listen_backlog = Rcpp::as<int>(options["listen_backlog"]);
+  max_connections = asSizeLimit(options["max_connections"]);
+  accept_batch_size = asSizeLimit(options["accept_batch_size"]);
+  response_cache_size = asSizeLimit(options["response_cache_size"]);
+  coalesce = Rcpp::as<bool>(options["coalesce"]);
+  coalesce_headers =
+    Rcpp::as<std::vector<std::string> >(options["coalesce_headers"]);
+
+  shed_queue_delay_ms = asTimeoutMs(options["shed_queue_delay"]);
+  shed_retry_after = Rcpp::as<double>(options["shed_retry_after"]);
+  shed_exempt = Rcpp::as<std::vector<std::string> >(options["shed_exempt"]);
+  SEXP admin = options["admin_path"];
+  if (!Rf_isNull(admin)) {
+    admin_path = Rcpp::as<std::string>(admin);
+  }
+  admin_remote = Rcpp::as<bool>(options["admin_remote"]);
+  if (listen_backlog < 1) {
+    throw Rcpp::exception("listen_backlog must be at least 1.");
+  }
+  if (max_connections < 1) {
+    throw Rcpp::exception("max_connections must be at least 1.");
+  }
+  if (accept_batch_size < 1) {
+    throw Rcpp::exception("accept_batch_size must be at least 1.");
+  }
+
+  // zlib can't produce a raw deflate stream with an 8-bit window, so the
+  // smallest window that can be negotiated is 9 bits.
+  if (ws_deflate_window_bits < 9 || ws_deflate_window_bits > 15) {
+    throw Rcpp::exception("ws_deflate_window_bits must be between 9 and 15.");
+  }
+  if (ws_deflate_mem_level < 1 || ws_deflate_mem_level > 9) {
+    throw Rcpp::exception("ws_deflate_mem_level must be between 1 and 9.");
+  }
+}
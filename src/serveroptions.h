@@ -0,0 +1,135 @@
+#ifndef SERVEROPTIONS_HPP
+#define SERVEROPTIONS_HPP
+
+#include <string>
+#include <vector>
+#include <Rcpp.h>
+#include "thread.h"
+
+// What to do when a message is sent on a WebSocket connection whose send
+// buffer is already over the limit.
+enum WSSendBufferPolicy {
+  // Discard the message that is being sent
+  WS_SEND_DROP_NEWEST,
+  // Discard the oldest queued data messages to make room
+  WS_SEND_DROP_OLDEST,
+  // Close the connection with code 1008 (Policy Violation)
+  WS_SEND_CLOSE
+};
+
+// How incoming WebSocket messages are passed to R.
+enum WSBatchMode {
+  // One call into R per message
+  WS_BATCH_NONE,
+  // Messages are batched separately for each connection
+  WS_BATCH_CONNECTION,
+  // Messages from all of a server's connections are batched together
+  WS_BATCH_GLOBAL
+};
+
+// What to do with incoming WebSocket messages that are larger than
+// ws_large_message_threshold.
+enum WSLargeMessageMode {
+  // Collect the whole message in memory, like any other message
+  WS_LARGE_MESSAGE_BUFFER,
+  // Pass the message to R in chunks as it arrives
+  WS_LARGE_MESSAGE_STREAM,
+  // Write the message to a file, and pass the file's path to R
+  WS_LARGE_MESSAGE_SPOOL
+};
+
+// Settings for a server that are fixed when the server is created. These are
+// converted from an R `serverOptions` object on the main thread; after that
+// they are never modified, so they can be read from the background thread
+// without locking.
+class ServerOptions {
+public:
+  // permessage-deflate (RFC 7692) for WebSocket connections
+  bool ws_deflate;
+  // Messages smaller than this many bytes are sent uncompressed
+  size_t ws_deflate_threshold;
+  // The LZ77 window size (as a base-2 log) and zlib memLevel used when
+  // compressing outgoing messages
+  int ws_deflate_window_bits;
+  int ws_deflate_mem_level;
+  // If true, the compression context is reset after each outgoing message
+  bool ws_deflate_server_no_context_takeover;
+  // If true, ask the client to reset its compression context after each
+  // message it sends
+  bool ws_deflate_client_no_context_takeover;
+
+  // Maximum number of outgoing bytes that may be queued on a WebSocket
+  // connection, waiting for the client to read them.
+  size_t ws_send_buffer_limit;
+  WSSendBufferPolicy ws_send_buffer_policy;
+
+  // Batching of incoming WebSocket messages: a batch is passed to R when it
+  // has ws_batch_size messages, or ws_batch_latency_ms after its first
+  // message arrived.
+  WSBatchMode ws_batch;
+  size_t ws_batch_size;
+  uint64_t ws_batch_latency_ms;
+
+  // Keepalive pings: one is sent every ws_ping_interval_ms (0 disables them),
+  // randomly adjusted by up to ws_ping_jitter times the interval. A
+  // connection is closed after ws_ping_max_missed consecutive pings go
+  // unanswered (0 means never).
+  uint64_t ws_ping_interval_ms;
+  double ws_ping_jitter;
+  unsigned int ws_ping_max_missed;
+
+  // Incoming WebSocket messages larger than ws_max_message_size bytes cause
+  // the connection to be closed with code 1009 (Message Too Big). Messages
+  // larger than ws_large_message_threshold are handled according to
+  // ws_large_message; spooled messages are written to ws_spool_dir.
+  size_t ws_max_message_size;
+  WSLargeMessageMode ws_large_message;
+  size_t ws_large_message_threshold;
+  std::string ws_spool_dir;
+
+  // Connection timeouts, in milliseconds; 0 disables a timeout. A connection
+  // is closed if it is idle between HTTP requests for idle_timeout_ms, if a
+  // request's headers take longer than header_timeout_ms to arrive, if no
+  // part of a request body arrives for body_timeout_ms, or if none of the
+  // data being written to it is sent for write_timeout_ms.
+  uint64_t idle_timeout_ms;
+  uint64_t header_timeout_ms;
+  uint64_t body_timeout_ms;
+  uint64_t write_timeout_ms;
+
+  // The size of the listen queue for connections that haven't been accepted
+  // yet. At most max_connections connections are open at once; while a
+  // server has that many, it stops accepting. At most accept_batch_size
+  // connections are accepted each time the loop polls for I/O.
+  int listen_backlog;
+  size_t max_connections;
+  size_t accept_batch_size;
+
+  // The maximum number of bytes used by the cache of responses that R has
+  // marked as reusable; 0 disables the cache.
+  size_t response_cache_size;
+
+  // If true, concurrent GET requests with the same method, URL, and values
+  // of the headers named in coalesce_headers share a single call to R.
+  bool coalesce;
+  std::vector<std::string> coalesce_headers;
+
+  // Load shedding: when work for the main thread has been waiting longer
+  // than shed_queue_delay_ms (0 disables this), requests that would go to R
+  // get a 503 response with a Retry-After of shed_retry_after seconds.
+  // Requests for the paths in shed_exempt are never shed.
+  uint64_t shed_queue_delay_ms;
+  double shed_retry_after;
+  std::vector<std::string> shed_exempt;
+
+  // If not empty, the background thread answers requests for the pages under
+  // this path itself. Unless admin_remote is true, only clients on this
+  // machine get them.
+  std::string admin_path;
+  bool admin_remote;
+
+  ServerOptions();
+  ServerOptions(const Rcpp::List& options);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "serverstats.h"
+#include "thread.h"
+
+ServerStats::ServerStats()
+  : _wsConnections(0),
+    _bytesIn(0),
+    _bytesOut(0),
+    _gzipBytesIn(0),
+    _gzipBytesOut(0),
+    _wsFramesIn(0),
+    _wsFramesOut(0)
+{
+  for (size_t i = 0; i < 5; i++) {
+    _responses[i] = 0;
+  }
+  for (size_t i = 0; i < 3; i++) {
+    _staticFiles[i] = 0;
+  }
+}
+
+void ServerStats::onResponse(int statusCode) {
+  ASSERT_BACKGROUND_THREAD()
+  int statusClass = statusCode / 100;
+  if (statusClass >= 1 && statusClass <= 5) {
+    add(_responses[statusClass - 1], 1);
+  }
+}
+
+ServerCounters ServerStats::counters() const {
+  ServerCounters c;
+  for (size_t i = 0; i < 5; i++) {
+    c.responses[i] = get(_responses[i]);
+  }
+  c.wsConnections = get(_wsConnections);
+  c.bytesIn = get(_bytesIn);
+  c.bytesOut = get(_bytesOut);
+  c.gzipBytesIn = get(_gzipBytesIn);
+  c.gzipBytesOut = get(_gzipBytesOut);
+  for (size_t i = 0; i < 3; i++) {
+    c.staticFiles[i] = get(_staticFiles[i]);
+  }
+  c.wsFramesIn = get(_wsFramesIn);
+  c.wsFramesOut = get(_wsFramesOut);
+  return c;
+}
+
+Rcpp::List ServerStats::asRObject(uint64_t connections,
+                                  size_t backgroundQueue,
+                                  size_t mainQueue,
+                                  double eventLoopLag) const
+{
+  ASSERT_MAIN_THREAD()
+  using namespace Rcpp;
+
+  ServerCounters c = counters();
+  // The connection count and the WebSocket count are updated at slightly
+  // different times.
+  uint64_t http = connections > c.wsConnections ? connections - c.wsConnections : 0;
+
+  return List::create(
+    _["http_connections"] = (double)http,
+    _["ws_connections"] = (double)c.wsConnections,
+    _["responses"] = NumericVector::create(
+      _["1xx"] = (double)c.responses[0],
+      _["2xx"] = (double)c.responses[1],
+      _["3xx"] = (double)c.responses[2],
+      _["4xx"] = (double)c.responses[3],
+      _["5xx"] = (double)c.responses[4]
+    ),
+    _["bytes_in"] = (double)c.bytesIn,
+    _["bytes_out"] = (double)c.bytesOut,
+    _["gzip_bytes_saved"] = (double)c.gzipBytesSaved(),
+    _["static_hits"] = (double)c.staticFiles[STATIC_HIT],
+    _["static_misses"] = (double)c.staticFiles[STATIC_MISS],
+    _["static_fallthroughs"] = (double)c.staticFiles[STATIC_FALLTHROUGH],
+    _["ws_frames_in"] = (double)c.wsFramesIn,
+    _["ws_frames_out"] = (double)c.wsFramesOut,
+    _["background_queue"] = (double)backgroundQueue,
+    _["main_queue"] = (double)mainQueue,
+    _["event_loop_lag"] = eventLoopLag
+  );
+}
@@ -0,0 +1,104 @@
+#ifndef SERVERSTATS_HPP
+#define SERVERSTATS_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <Rcpp.h>
+#include "constants.h"
+
+enum StaticFileResult {
+  // The file was served (including 304 Not Modified responses).
+  STATIC_HIT,
+  // The path matched a static path, but there was no such file.
+  STATIC_MISS,
+  // The path matched a static path, but the request was passed on to R.
+  STATIC_FALLTHROUGH
+};
+
+// The values of a ServerStats' counters at one time.
+struct ServerCounters {
+  uint64_t responses[5];
+  uint64_t wsConnections;
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+  uint64_t gzipBytesIn;
+  uint64_t gzipBytesOut;
+  uint64_t staticFiles[3];
+  uint64_t wsFramesIn;
+  uint64_t wsFramesOut;
+
+  // The number of bytes that gzip compression saved.
+  uint64_t gzipBytesSaved() const {
+    return gzipBytesIn > gzipBytesOut ? gzipBytesIn - gzipBytesOut : 0;
+  }
+};
+
+// Counters for a server. They are only updated on the background thread, and
+// are read from the main thread without stopping it. Each is updated on its
+// own, so a set of counters that is read while requests are being handled
+// may not quite add up.
+class ServerStats : NoCopy {
+  // Responses by status class: 1xx, 2xx, 3xx, 4xx, 5xx.
+  std::atomic<uint64_t> _responses[5];
+  std::atomic<uint64_t> _wsConnections;
+  std::atomic<uint64_t> _bytesIn;
+  std::atomic<uint64_t> _bytesOut;
+  // Bytes of response bodies before and after gzip compression.
+  std::atomic<uint64_t> _gzipBytesIn;
+  std::atomic<uint64_t> _gzipBytesOut;
+  std::atomic<uint64_t> _staticFiles[3];
+  std::atomic<uint64_t> _wsFramesIn;
+  std::atomic<uint64_t> _wsFramesOut;
+
+  // Nothing else is ordered by these counters, so relaxed atomics are enough.
+  static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  }
+  static uint64_t get(const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+public:
+  ServerStats();
+
+  void onResponse(int statusCode);
+  void onWSOpen() {
+    add(_wsConnections, 1);
+  }
+  void onWSClose() {
+    _wsConnections.fetch_sub(1, std::memory_order_relaxed);
+  }
+  void onBytesIn(uint64_t bytes) {
+    add(_bytesIn, bytes);
+  }
+  void onBytesOut(uint64_t bytes) {
+    add(_bytesOut, bytes);
+  }
+  void onGzip(uint64_t bytesIn, uint64_t bytesOut) {
+    add(_gzipBytesIn, bytesIn);
+    add(_gzipBytesOut, bytesOut);
+  }
+  void onStaticFile(StaticFileResult result) {
+    add(_staticFiles[result], 1);
+  }
+  void onWSFrameIn() {
+    add(_wsFramesIn, 1);
+  }
+  void onWSFrameOut() {
+    add(_wsFramesOut, 1);
+  }
+
+  // May be called from either thread.
+  ServerCounters counters() const;
+
+  // Main thread. `connections` is the number of open connections, HTTP and
+  // WebSocket; the ones that aren't WebSocket connections are reported as
+  // HTTP connections. The queues and the event loop are shared by all
+  // servers, so they are passed in.
+  Rcpp::List asRObject(uint64_t connections,
+                       size_t backgroundQueue,
+                       size_t mainQueue,
+                       double eventLoopLag) const;
+};
+
+#endif // SERVERSTATS_HPP
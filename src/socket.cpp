@@ -1,18 +1,154 @@
 #include "socket.h"
 #include "httprequest.h"
+#include "wsmessagebatch.h"
 #include <later_api.h>
 #include <uv.h>
 
 void on_Socket_close(uv_handle_t* pHandle);
 
+Socket::Socket(std::shared_ptr<WebApplication> pWebApplication,
+               CallbackQueue* background_queue)
+  : pWebApplication(pWebApplication),
+    background_queue(background_queue),
+    acceptedCount(0),
+    acceptErrorCount(0),
+    acceptPausedCount(0),
+    connectionCount(0),
+    _acceptPending(false),
+    _acceptPaused(false),
+    _closing(false),
+    _acceptedThisWakeup(0),
+    _pAcceptCheck(NULL)
+{
+  const ServerOptions& options = pWebApplication->getServerOptions();
+  _maxConnections = options.max_connections;
+  _acceptBatchSize = options.accept_batch_size;
+}
+
 void Socket::addConnection(std::shared_ptr<HttpRequest> request) {
+  request->_connectionIndex = connections.size();
   connections.push_back(request);
+  connectionCount = connections.size();
 }
 
 void Socket::removeConnection(std::shared_ptr<HttpRequest> request) {
-  connections.erase(
-    std::remove(connections.begin(), connections.end(), request),
-    connections.end());
+  size_t index = request->_connectionIndex;
+  if (index >= connections.size() || connections[index] != request) {
+    return;
+  }
+
+  if (index != connections.size() - 1) {
+    connections[index].swap(connections.back());
+    connections[index]->_connectionIndex = index;
+  }
+  connections.pop_back();
+  request->_connectionIndex = (size_t)-1;
+  connectionCount = connections.size();
+
+  // This is called while the connection is closing, so don't accept a new
+  // one from here.
+  if (_acceptPending && _canAccept()) {
+    _scheduleAcceptCheck();
+  }
+}
+
+
+// ============================================================================
+// Accepting connections
+// ============================================================================
+
+void Socket_on_accept_check(uv_check_t* handle) {
+  Socket* pSocket = reinterpret_cast<Socket*>(handle->data);
+  pSocket->_onAcceptCheck();
+}
+
+bool Socket::_canAccept() const {
+  return !_closing && connections.size() < _maxConnections;
+}
+
+void Socket::onConnection(int status) {
+  ASSERT_BACKGROUND_THREAD()
+  if (status) {
+    // An error from listening; there's no connection to count.
+    err_printf("connection error: %s\n", uv_strerror(status));
+    return;
+  }
+
+  _acceptPending = true;
+
+  if (!_canAccept()) {
+    // Leave the connection with libuv, which stops accepting until it is
+    // taken. It is accepted once another connection closes; meanwhile, new
+    // connections wait in the listen backlog.
+    if (!_acceptPaused) {
+      _acceptPaused = true;
+      acceptPausedCount++;
+      debug_log("Socket: max_connections reached; pausing accept", LOG_INFO);
+    }
+    return;
+  }
+
+  if (_acceptedThisWakeup >= _acceptBatchSize) {
+    // Let the loop handle I/O on the existing connections before accepting
+    // more.
+    return;
+  }
+
+  _acceptOne();
+}
+
+void Socket::_acceptOne() {
+  ASSERT_BACKGROUND_THREAD()
+  _acceptPending = false;
+  _acceptPaused = false;
+
+  if (_acceptedThisWakeup++ == 0) {
+    _scheduleAcceptCheck();
+  }
+
+  // Copy the shared_ptr
+  std::shared_ptr<Socket> pSocket(*(std::shared_ptr<Socket>*)handle.stream.data);
+
+  // Freed by HttpRequest itself when close() is called, which
+  // can occur on EOF, error, or when the Socket is destroyed
+  std::shared_ptr<HttpRequest> req = createHttpRequest(
+    handle.stream.loop, pWebApplication, pSocket, background_queue
+  );
+
+  int r = uv_accept(&handle.stream, req->handle());
+  if (r) {
+    err_printf("accept: %s\n", uv_strerror(r));
+    acceptErrorCount++;
+    return;
+  }
+  acceptedCount++;
+
+  req->handleRequest();
+}
+
+void Socket::_scheduleAcceptCheck() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_closing) {
+    return;
+  }
+  if (!_pAcceptCheck) {
+    _pAcceptCheck = static_cast<uv_check_t*>(malloc(sizeof(uv_check_t)));
+    uv_check_init(handle.stream.loop, _pAcceptCheck);
+    _pAcceptCheck->data = this;
+  }
+  uv_check_start(_pAcceptCheck, Socket_on_accept_check);
+}
+
+void Socket::_onAcceptCheck() {
+  ASSERT_BACKGROUND_THREAD()
+  uv_check_stop(_pAcceptCheck);
+  _acceptedThisWakeup = 0;
+
+  // Accepting the held connection also tells libuv to start accepting
+  // again.
+  if (_acceptPending && _canAccept()) {
+    _acceptOne();
+  }
 }
 
 Socket::~Socket() {
@@ -34,14 +170,28 @@ void delete_ppsocket(uv_handle_t* pHandle) {
 void Socket::close() {
   ASSERT_BACKGROUND_THREAD()
   debug_log("Socket::close", LOG_DEBUG);
-  for (std::vector<std::shared_ptr<HttpRequest> >::reverse_iterator it = connections.rbegin();
-    it != connections.rend();
+  _closing = true;
+
+  if (_pAcceptCheck) {
+    uv_close(reinterpret_cast<uv_handle_t*>(_pAcceptCheck), freeAfterClose);
+    _pAcceptCheck = NULL;
+  }
+  // Closing a connection removes it from `connections`, so iterate over a
+  // copy.
+  std::vector<std::shared_ptr<HttpRequest> > toClose(connections);
+  for (std::vector<std::shared_ptr<HttpRequest> >::reverse_iterator it = toClose.rbegin();
+    it != toClose.rend();
     it++) {
 
     // std::cerr << "Request close on " << *it << std::endl;
     (*it)->close();
   }
 
+  if (wsBatcher) {
+    wsBatcher->flush();
+    wsBatcher.reset();
+  }
+
   uv_handle_t* pHandle = toHandle(&handle.stream);
 
   // Delete the shared_ptr<Socket> only after uv_close() does its work. This
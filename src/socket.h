@@ -2,29 +2,69 @@
 #define SOCKET_HPP
 
 #include "http.h"
+#include <atomic>
 #include <memory>
 #include <uv.h>
 
 class HttpRequest;
 class WebApplication;
+class WSMessageBatcher;
 
 class Socket {
 public:
   VariantHandle handle;
   std::shared_ptr<WebApplication> pWebApplication;
   CallbackQueue* background_queue;
+  // The open connections, in no particular order. Each HttpRequest records
+  // its position in this vector, so that it can be removed in constant time
+  // by moving the last connection into its place.
   std::vector<std::shared_ptr<HttpRequest> > connections;
+  // Shared by all connections when WebSocket messages are batched globally.
+  // Created by the first connection that needs it.
+  std::shared_ptr<WSMessageBatcher> wsBatcher;
+
+  // Connection counters. These are updated on the background thread and can
+  // be read from the main thread.
+  std::atomic<uint64_t> acceptedCount;
+  // Times that uv_accept() failed, for example because the process ran out
+  // of file descriptors. Connections are never refused because of
+  // max_connections; they wait in the listen backlog instead.
+  std::atomic<uint64_t> acceptErrorCount;
+  // The number of times accepting was paused because the server had
+  // max_connections connections.
+  std::atomic<uint64_t> acceptPausedCount;
+  std::atomic<size_t> connectionCount;
 
   Socket(std::shared_ptr<WebApplication> pWebApplication,
-         CallbackQueue* background_queue)
-    : pWebApplication(pWebApplication), background_queue(background_queue)
-  {
-  }
+         CallbackQueue* background_queue);
 
   void addConnection(std::shared_ptr<HttpRequest> request);
   void removeConnection(std::shared_ptr<HttpRequest> request);
   void close();
 
+  // Called when libuv has a new connection ready for this server.
+  void onConnection(int status);
+  void _onAcceptCheck();
+
+private:
+  size_t _maxConnections;
+  size_t _acceptBatchSize;
+  // True when libuv is holding a connection that hasn't been accepted yet.
+  // While that is the case, libuv stops accepting more connections.
+  bool _acceptPending;
+  bool _acceptPaused;
+  bool _closing;
+  // Connections accepted since the last time the loop polled for I/O.
+  size_t _acceptedThisWakeup;
+  // Runs after the loop polls for I/O, to end an accept batch and to resume
+  // accepting if it was held back.
+  uv_check_t* _pAcceptCheck;
+
+  bool _canAccept() const;
+  void _acceptOne();
+  void _scheduleAcceptCheck();
+public:
+
   virtual ~Socket();
 };
 
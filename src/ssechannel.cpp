@@ -0,0 +1,388 @@
+#include "ssechannel.h"
+#include "utils.h"
+#include "auto_deleter.h"
+#include "thread.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+std::string formatSSEEvent(const std::string& id,
+                           const std::string& event,
+                           const std::string& data)
+{
+  std::string text;
+  text.reserve(data.size() + id.size() + event.size() + 32);
+  text += "id: ";
+  text += id;
+  text += "\n";
+  if (!event.empty()) {
+    text += "event: ";
+    text += event;
+    text += "\n";
+  }
+
+  // Each line of the data gets its own field. Lines may end with "\r\n",
+  // "\r", or "\n".
+  size_t start = 0;
+  while (true) {
+    size_t end = data.find_first_of("\r\n", start);
+    text += "data: ";
+    text.append(data, start, end == std::string::npos ? std::string::npos : end - start);
+    text += "\n";
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+    if (data[end] == '\r' && start < data.size() && data[start] == '\n') {
+      start++;
+    }
+  }
+
+  // A blank line ends the event.
+  text += "\n";
+  return text;
+}
+
+static const SSEText keepaliveText = std::make_shared<const std::string>(":\n\n");
+
+
+SSEDataSource::SSEDataSource(std::weak_ptr<SSEChannel> pChannel,
+                             size_t maxBufferedAmount)
+  : _pChannel(pChannel),
+    _index((size_t)-1),
+    _pos(0),
+    _bufferedAmount(0),
+    _maxBufferedAmount(maxBufferedAmount),
+    _active(false),
+    _ended(false),
+    _closed(false),
+    _overflowed(false)
+{
+}
+
+std::function<void(void)> SSEDataSource::_enqueue(const SSEText& text) {
+  ASSERT_BACKGROUND_THREAD()
+  std::function<void(void)> resume;
+  if (_ended || _closed || _overflowed) {
+    return resume;
+  }
+
+  _active = true;
+  if (_bufferedAmount + text->size() > _maxBufferedAmount) {
+    // The client isn't keeping up. Drop it; getData() will report an error,
+    // so that the connection is closed. The queue is left alone, because
+    // part of it may be in the middle of being written.
+    _overflowed = true;
+  } else {
+    _queue.push_back(text);
+    _bufferedAmount += text->size();
+  }
+  resume.swap(_resume);
+  return resume;
+}
+
+std::function<void(void)> SSEDataSource::_end() {
+  ASSERT_BACKGROUND_THREAD()
+  std::function<void(void)> resume;
+  _ended = true;
+  resume.swap(_resume);
+  return resume;
+}
+
+uint64_t SSEDataSource::size() const {
+  // The size isn't known in advance.
+  return 0;
+}
+
+bool SSEDataSource::waitForData(std::function<void(void)> resume) {
+  ASSERT_BACKGROUND_THREAD()
+  if (!_queue.empty() && _pos < _queue.front()->size()) {
+    return false;
+  }
+  if (_queue.size() > 1 || _ended || _closed || _overflowed) {
+    return false;
+  }
+  _resume = resume;
+  return true;
+}
+
+void SSEDataSource::stopWaiting() {
+  ASSERT_BACKGROUND_THREAD()
+  std::function<void(void)> resume;
+  resume.swap(_resume);
+  if (resume) {
+    background_queue->push(resume);
+  }
+}
+
+uv_buf_t SSEDataSource::getData(size_t bytesDesired) {
+  ASSERT_BACKGROUND_THREAD()
+  if (_overflowed) {
+    throw std::runtime_error("SSE subscriber fell too far behind");
+  }
+
+  if (!_queue.empty() && _pos == _queue.front()->size()) {
+    _queue.pop_front();
+    _pos = 0;
+  }
+  if (_queue.empty()) {
+    // The channel was closed, and everything has been sent.
+    return uv_buf_init(NULL, 0);
+  }
+
+  const std::string& text = *_queue.front();
+  size_t bytes = std::min(bytesDesired, text.size() - _pos);
+  // The buffer isn't modified; uv_buf_t just doesn't have a const version.
+  uv_buf_t buf = uv_buf_init(const_cast<char*>(text.data() + _pos), bytes);
+  _pos += bytes;
+  return buf;
+}
+
+void SSEDataSource::freeData(uv_buf_t buffer) {
+  ASSERT_BACKGROUND_THREAD()
+  _bufferedAmount -= std::min(_bufferedAmount, (size_t)buffer.len);
+}
+
+// Called when the response is finished, either because the channel was
+// closed, or because the connection failed.
+void SSEDataSource::close() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_closed) {
+    return;
+  }
+  _closed = true;
+  _queue.clear();
+  _bufferedAmount = 0;
+  _resume = nullptr;
+
+  std::shared_ptr<SSEChannel> pChannel = _pChannel.lock();
+  if (pChannel) {
+    pChannel->unsubscribe(this);
+  }
+}
+
+
+SSEChannel::SSEChannel(size_t historySize,
+                       uint64_t keepaliveMs,
+                       size_t maxBufferedAmount)
+  : _closed(false),
+    _pLoop(NULL),
+    _nextId(1),
+    _historySize(historySize),
+    _keepaliveMs(keepaliveMs),
+    _maxBufferedAmount(maxBufferedAmount),
+    _subscriberCount(0)
+{
+  _keepaliveTimer.setCallback(std::bind(&SSEChannel::_onKeepalive, this));
+}
+
+SSEChannel::~SSEChannel() {
+  ASSERT_BACKGROUND_THREAD()
+  debug_log("SSEChannel::~SSEChannel", LOG_DEBUG);
+}
+
+std::string SSEChannel::publish(const std::string& data,
+                                const std::string& event,
+                                const std::string& id)
+{
+  ASSERT_MAIN_THREAD()
+  // A line break would let the caller add fields or events of their own, and
+  // clients ignore IDs that contain NUL.
+  const std::string forbidden("\r\n\0", 3);
+  if (event.find_first_of(forbidden) != std::string::npos ||
+      id.find_first_of(forbidden) != std::string::npos) {
+    throw std::invalid_argument("SSE event and id must not contain line breaks or NUL");
+  }
+
+  std::string eventId = id;
+  if (eventId.empty()) {
+    std::ostringstream os;
+    os << _nextId++;
+    eventId = os.str();
+  }
+
+  SSEText text = std::make_shared<const std::string>(
+    formatSSEEvent(eventId, event, data)
+  );
+  background_queue->push(
+    std::bind(&SSEChannel::_deliver, shared_from_this(), eventId, text)
+  );
+  return eventId;
+}
+
+std::shared_ptr<SSEDataSource> SSEChannel::subscribe(const std::string& lastEventId,
+                                                     uv_loop_t* pLoop)
+{
+  ASSERT_MAIN_THREAD()
+  std::shared_ptr<SSEDataSource> pSource = std::make_shared<SSEDataSource>(
+    shared_from_this(), _maxBufferedAmount
+  );
+  background_queue->push(
+    std::bind(&SSEChannel::_subscribe, shared_from_this(), pSource, lastEventId, pLoop)
+  );
+  return pSource;
+}
+
+void SSEChannel::close() {
+  ASSERT_MAIN_THREAD()
+  background_queue->push(std::bind(&SSEChannel::_close, shared_from_this()));
+}
+
+void SSEChannel::_deliver(std::string id, SSEText text) {
+  ASSERT_BACKGROUND_THREAD()
+  if (_closed) {
+    return;
+  }
+
+  if (_historySize > 0) {
+    if (_history.size() == _historySize) {
+      _history.pop_front();
+    }
+    Event e = { id, text };
+    _history.push_back(e);
+  }
+
+  // Resuming a write can finish a response and unsubscribe it, so the
+  // subscribers are resumed after the loop.
+  std::vector<std::function<void(void)> > resumes;
+  for (size_t i = 0; i < _subscribers.size(); i++) {
+    std::function<void(void)> resume = _subscribers[i]->_enqueue(text);
+    if (resume) {
+      resumes.push_back(resume);
+    }
+  }
+  for (size_t i = 0; i < resumes.size(); i++) {
+    resumes[i]();
+  }
+}
+
+void SSEChannel::_subscribe(std::shared_ptr<SSEDataSource> pSource,
+                            std::string lastEventId,
+                            uv_loop_t* pLoop)
+{
+  ASSERT_BACKGROUND_THREAD()
+  if (_closed) {
+    std::function<void(void)> resume = pSource->_end();
+    if (resume) {
+      resume();
+    }
+    return;
+  }
+
+  pSource->_index = _subscribers.size();
+  _subscribers.push_back(pSource);
+  _subscriberCount = _subscribers.size();
+
+  // Replay the events that a reconnecting client missed. If its last event
+  // is too old to be in the history (or unknown), it gets all of the history.
+  if (!lastEventId.empty()) {
+    size_t start = 0;
+    for (size_t i = _history.size(); i > 0; i--) {
+      if (_history[i - 1].id == lastEventId) {
+        start = i;
+        break;
+      }
+    }
+    std::function<void(void)> resume;
+    for (size_t i = start; i < _history.size(); i++) {
+      std::function<void(void)> r = pSource->_enqueue(_history[i].text);
+      if (r) {
+        resume = r;
+      }
+    }
+    if (resume) {
+      resume();
+    }
+  }
+
+  if (_pLoop == NULL) {
+    _pLoop = pLoop;
+  }
+  if (!_keepaliveTimer.active()) {
+    _startKeepalive();
+  }
+}
+
+void SSEChannel::unsubscribe(SSEDataSource* pSource) {
+  ASSERT_BACKGROUND_THREAD()
+  size_t idx = pSource->_index;
+  if (idx >= _subscribers.size() || _subscribers[idx].get() != pSource) {
+    return;
+  }
+
+  // Move the last subscriber into the freed slot.
+  if (idx != _subscribers.size() - 1) {
+    _subscribers[idx] = _subscribers.back();
+    _subscribers[idx]->_index = idx;
+  }
+  _subscribers.pop_back();
+  pSource->_index = (size_t)-1;
+  _subscriberCount = _subscribers.size();
+
+  if (_subscribers.empty()) {
+    _keepaliveTimer.cancel();
+  }
+}
+
+void SSEChannel::_close() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_closed) {
+    return;
+  }
+  _closed = true;
+  _history.clear();
+  _keepaliveTimer.cancel();
+
+  // Each subscriber unsubscribes itself once its response is finished.
+  std::vector<std::function<void(void)> > resumes;
+  for (size_t i = 0; i < _subscribers.size(); i++) {
+    std::function<void(void)> resume = _subscribers[i]->_end();
+    if (resume) {
+      resumes.push_back(resume);
+    }
+  }
+  for (size_t i = 0; i < resumes.size(); i++) {
+    resumes[i]();
+  }
+}
+
+void SSEChannel::_startKeepalive() {
+  ASSERT_BACKGROUND_THREAD()
+  if (_keepaliveMs == 0 || _pLoop == NULL || _closed) {
+    return;
+  }
+  TimerWheel::forLoop(_pLoop)->start(&_keepaliveTimer, _keepaliveMs);
+}
+
+// Send a comment to the subscribers that haven't been sent anything since the
+// last time this ran.
+void SSEChannel::_onKeepalive() {
+  ASSERT_BACKGROUND_THREAD()
+  std::vector<std::function<void(void)> > resumes;
+  for (size_t i = 0; i < _subscribers.size(); i++) {
+    SSEDataSource* pSource = _subscribers[i].get();
+    if (pSource->_active) {
+      pSource->_active = false;
+    } else {
+      std::function<void(void)> resume = pSource->_enqueue(keepaliveText);
+      pSource->_active = false;
+      if (resume) {
+        resumes.push_back(resume);
+      }
+    }
+  }
+  for (size_t i = 0; i < resumes.size(); i++) {
+    resumes[i]();
+  }
+
+  if (!_subscribers.empty()) {
+    _startKeepalive();
+  }
+}
+
+
+void finalizeSSEChannel(std::shared_ptr<SSEChannel>* pChannel) {
+  ASSERT_MAIN_THREAD()
+  (*pChannel)->close();
+  delete pChannel;
+}
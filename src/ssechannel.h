@@ -0,0 +1,137 @@
+#ifndef SSECHANNEL_HPP
+#define SSECHANNEL_HPP
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <uv.h>
+
+#include <Rcpp.h>
+#include "constants.h"
+#include "timerwheel.h"
+#include "uvutil.h"
+
+class SSEChannel;
+
+// A formatted Server-Sent Event. The text is shared by every subscriber that
+// it is sent to.
+typedef std::shared_ptr<const std::string> SSEText;
+
+// Format an event for the text/event-stream format. `data` is split into one
+// "data:" field per line. `event` may be empty.
+std::string formatSSEEvent(const std::string& id,
+                           const std::string& event,
+                           const std::string& data);
+
+
+// The response body for one subscriber to an SSEChannel. Everything except
+// construction happens on the background thread.
+class SSEDataSource : public DataSource, NoCopy {
+  friend class SSEChannel;
+
+  std::weak_ptr<SSEChannel> _pChannel;
+  // This subscriber's position in the channel's list of subscribers.
+  size_t _index;
+
+  std::deque<SSEText> _queue;
+  // The number of bytes of the first item in the queue that have been sent.
+  size_t _pos;
+  size_t _bufferedAmount;
+  size_t _maxBufferedAmount;
+  // True if something was queued since the last keepalive tick.
+  bool _active;
+  bool _ended;
+  bool _closed;
+  bool _overflowed;
+  std::function<void(void)> _resume;
+
+  // These return the function to call to resume sending, if the
+  // ExtendedWrite was waiting for data.
+  std::function<void(void)> _enqueue(const SSEText& text);
+  std::function<void(void)> _end();
+
+public:
+  SSEDataSource(std::weak_ptr<SSEChannel> pChannel, size_t maxBufferedAmount);
+
+  uint64_t size() const;
+  bool waitForData(std::function<void(void)> resume);
+  void stopWaiting();
+  uv_buf_t getData(size_t bytesDesired);
+  void freeData(uv_buf_t buffer);
+  void close();
+};
+
+
+// A channel of Server-Sent Events. R publishes each event once. It is
+// formatted once, and the background thread hands the same text to every
+// subscribed connection. The most recent events are kept, so that a
+// client that reconnects with a Last-Event-ID header gets the events it
+// missed. Subscribers that have received nothing for `keepaliveMs` get a
+// comment line, which keeps proxies from timing out the connection.
+//
+// A subscriber that falls more than `maxBufferedAmount` bytes behind is
+// disconnected. The client will reconnect and catch up from the history.
+class SSEChannel : public std::enable_shared_from_this<SSEChannel>, NoCopy {
+  struct Event {
+    std::string id;
+    SSEText text;
+  };
+
+  // Background thread only.
+  std::vector<std::shared_ptr<SSEDataSource> > _subscribers;
+  std::deque<Event> _history;
+  bool _closed;
+  uv_loop_t* _pLoop;
+  TimerWheelTimer _keepaliveTimer;
+
+  // Main thread only.
+  uint64_t _nextId;
+
+  const size_t _historySize;
+  const uint64_t _keepaliveMs;
+  const size_t _maxBufferedAmount;
+  std::atomic<size_t> _subscriberCount;
+
+  void _deliver(std::string id, SSEText text);
+  void _subscribe(std::shared_ptr<SSEDataSource> pSource,
+                  std::string lastEventId,
+                  uv_loop_t* pLoop);
+  void _close();
+  void _onKeepalive();
+  void _startKeepalive();
+
+public:
+  SSEChannel(size_t historySize, uint64_t keepaliveMs, size_t maxBufferedAmount);
+  ~SSEChannel();
+
+  // Main thread. Returns the event's ID; if `id` is empty, one is assigned.
+  std::string publish(const std::string& data,
+                      const std::string& event,
+                      const std::string& id);
+  // Main thread. Returns the response body for a new subscriber.
+  std::shared_ptr<SSEDataSource> subscribe(const std::string& lastEventId,
+                                           uv_loop_t* pLoop);
+  // Main thread. Ends every subscriber's response.
+  void close();
+
+  size_t subscriberCount() const {
+    return _subscriberCount;
+  }
+
+  // Background thread. Called when a subscriber's response is finished.
+  void unsubscribe(SSEDataSource* pSource);
+};
+
+// Channels are passed to R in an external pointer. If R lets go of a channel,
+// it is closed when the pointer is garbage collected.
+void finalizeSSEChannel(std::shared_ptr<SSEChannel>* pChannel);
+
+typedef Rcpp::XPtr<std::shared_ptr<SSEChannel>,
+                   Rcpp::PreserveStorage,
+                   finalizeSSEChannel,
+                   true> SSEChannelXPtr;
+
+#endif // SSECHANNEL_HPP
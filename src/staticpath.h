@@ -42,6 +42,8 @@ public:
   StaticPathOptions options;
 
   StaticPath(const Rcpp::List& sp);
+  StaticPath(const std::string& path, const StaticPathOptions& options)
+    : path(path), options(options) {}
 
   Rcpp::List asRObject() const;
 };
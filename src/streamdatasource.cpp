@@ -0,0 +1,197 @@
+#include "streamdatasource.h"
+#include "utils.h"
+#include "auto_deleter.h"
+#include "scheduler.h"
+#include "thread.h"
+#include <algorithm>
+
+StreamDataSource::StreamDataSource(size_t highWaterMark, Rcpp::Function onDrain)
+  : _bufferedAmount(0),
+    _ended(false),
+    _closed(false),
+    _needDrain(false),
+    _currentPos(0),
+    _highWaterMark(highWaterMark),
+    _pOnDrain(new Rcpp::Function(onDrain), auto_deleter_main<Rcpp::Function>)
+{
+  ASSERT_MAIN_THREAD()
+  uv_mutex_init(&_mutex);
+}
+
+StreamDataSource::~StreamDataSource() {
+  uv_mutex_destroy(&_mutex);
+}
+
+bool StreamDataSource::write(const Rcpp::RawVector& data) {
+  ASSERT_MAIN_THREAD()
+  std::function<void(void)> resume;
+  bool ok;
+  {
+    guard guard(_mutex);
+    if (_ended || _closed) {
+      return false;
+    }
+    // An empty chunk would mark the end of a chunked body, so empty writes
+    // are not queued.
+    if (data.size() > 0) {
+      _chunks.push_back(std::vector<uint8_t>(data.begin(), data.end()));
+      _bufferedAmount += data.size();
+      resume.swap(_resume);
+    }
+    ok = _bufferedAmount < _highWaterMark;
+    if (!ok) {
+      _needDrain = true;
+    }
+  }
+
+  if (resume) {
+    background_queue->push(resume);
+  }
+  return ok;
+}
+
+void StreamDataSource::end() {
+  ASSERT_MAIN_THREAD()
+  std::function<void(void)> resume;
+  {
+    guard guard(_mutex);
+    if (_ended) {
+      return;
+    }
+    _ended = true;
+    _needDrain = false;
+    resume.swap(_resume);
+  }
+
+  if (resume) {
+    background_queue->push(resume);
+  }
+  _releaseOnDrain();
+}
+
+size_t StreamDataSource::bufferedAmount() {
+  guard guard(_mutex);
+  return _bufferedAmount;
+}
+
+bool StreamDataSource::isOpen() {
+  guard guard(_mutex);
+  return !_ended && !_closed;
+}
+
+uint64_t StreamDataSource::size() const {
+  // The size isn't known in advance.
+  return 0;
+}
+
+bool StreamDataSource::waitForData(std::function<void(void)> resume) {
+  ASSERT_BACKGROUND_THREAD()
+  if (_currentPos < _current.size()) {
+    return false;
+  }
+
+  guard guard(_mutex);
+  if (!_chunks.empty() || _ended || _closed) {
+    return false;
+  }
+  _resume = resume;
+  return true;
+}
+
+void StreamDataSource::stopWaiting() {
+  ASSERT_BACKGROUND_THREAD()
+  std::function<void(void)> resume;
+  {
+    guard guard(_mutex);
+    resume.swap(_resume);
+  }
+  if (resume) {
+    background_queue->push(resume);
+  }
+}
+
+uv_buf_t StreamDataSource::getData(size_t bytesDesired) {
+  ASSERT_BACKGROUND_THREAD()
+  if (_currentPos == _current.size()) {
+    guard guard(_mutex);
+    if (_chunks.empty()) {
+      // The stream has ended and everything has been sent.
+      return uv_buf_init(NULL, 0);
+    }
+    _current.swap(_chunks.front());
+    _chunks.pop_front();
+    _currentPos = 0;
+  }
+
+  size_t bytes = std::min(bytesDesired, _current.size() - _currentPos);
+  uv_buf_t buf = uv_buf_init(reinterpret_cast<char*>(&_current[_currentPos]), bytes);
+  _currentPos += bytes;
+  return buf;
+}
+
+void StreamDataSource::freeData(uv_buf_t buffer) {
+  ASSERT_BACKGROUND_THREAD()
+  bool drained = false;
+  {
+    guard guard(_mutex);
+    _bufferedAmount -= std::min(_bufferedAmount, (size_t)buffer.len);
+    if (_needDrain && _bufferedAmount < _highWaterMark) {
+      _needDrain = false;
+      drained = true;
+    }
+  }
+
+  if (drained) {
+    invoke_main(this, PRIORITY_CONTROL,
+                std::bind(&StreamDataSource::_callOnDrain, shared_from_this()));
+  }
+}
+
+// Called when the response is finished, either because everything has been
+// sent, or because the connection failed. Anything R writes from now on is
+// discarded.
+void StreamDataSource::close() {
+  ASSERT_BACKGROUND_THREAD()
+  {
+    guard guard(_mutex);
+    if (_closed) {
+      return;
+    }
+    _closed = true;
+    _chunks.clear();
+    _bufferedAmount = 0;
+    _needDrain = false;
+    _resume = nullptr;
+  }
+  std::vector<uint8_t>().swap(_current);
+  _currentPos = 0;
+
+  invoke_main(this, PRIORITY_CONTROL,
+              std::bind(&StreamDataSource::_releaseOnDrain, shared_from_this()));
+}
+
+void StreamDataSource::_callOnDrain() {
+  ASSERT_MAIN_THREAD()
+  if (!_pOnDrain) {
+    return;
+  }
+  try {
+    (*_pOnDrain)();
+  } catch (...) {
+    debug_log("Exception occurred in StreamDataSource onDrain callback", LOG_INFO);
+  }
+}
+
+// The drain callback isn't needed once the stream has ended or the response
+// is finished. Letting go of it promptly means R objects that it refers to
+// can be garbage collected.
+void StreamDataSource::_releaseOnDrain() {
+  ASSERT_MAIN_THREAD()
+  _pOnDrain.reset();
+}
+
+void finalizeStreamDataSource(std::shared_ptr<StreamDataSource>* pStream) {
+  ASSERT_MAIN_THREAD()
+  (*pStream)->end();
+  delete pStream;
+}
@@ -0,0 +1,81 @@
+#ifndef STREAMDATASOURCE_HPP
+#define STREAMDATASOURCE_HPP
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <uv.h>
+
+#include <Rcpp.h>
+#include "constants.h"
+#include "uvutil.h"
+
+// A response body whose data is written from R, a piece at a time, while the
+// response is being sent. It is sent with chunked transfer encoding, because
+// its length isn't known in advance.
+//
+// write() and end() are called on the main thread; the DataSource methods are
+// called on the background thread by an ExtendedWrite. When the ExtendedWrite
+// has sent everything that has been written so far, it waits (see
+// waitForData()) until more data is written or the stream is ended.
+//
+// To keep a fast producer from buffering an unbounded amount of data,
+// write() returns false once more than `highWaterMark` bytes are waiting to
+// be sent. The drain callback is then invoked on the main thread when the
+// amount falls below the mark again.
+class StreamDataSource : public DataSource,
+                         public std::enable_shared_from_this<StreamDataSource>,
+                         NoCopy {
+  uv_mutex_t _mutex;
+  // These are protected by the mutex.
+  std::deque<std::vector<uint8_t> > _chunks;
+  size_t _bufferedAmount;
+  bool _ended;
+  bool _closed;
+  bool _needDrain;
+  std::function<void(void)> _resume;
+
+  // The chunk that is being written. Only used on the background thread.
+  std::vector<uint8_t> _current;
+  size_t _currentPos;
+
+  size_t _highWaterMark;
+  // Only used on the main thread.
+  std::shared_ptr<Rcpp::Function> _pOnDrain;
+
+  void _callOnDrain();
+  void _releaseOnDrain();
+
+public:
+  StreamDataSource(size_t highWaterMark, Rcpp::Function onDrain);
+  virtual ~StreamDataSource();
+
+  // Main thread. Returns false if the caller should wait for the drain
+  // callback before writing more, or if the stream can't be written to
+  // anymore.
+  bool write(const Rcpp::RawVector& data);
+  void end();
+  size_t bufferedAmount();
+  // False once the stream has been ended, or the connection has gone away.
+  bool isOpen();
+
+  // DataSource methods; background thread.
+  uint64_t size() const;
+  bool waitForData(std::function<void(void)> resume);
+  void stopWaiting();
+  uv_buf_t getData(size_t bytesDesired);
+  void freeData(uv_buf_t buffer);
+  void close();
+};
+
+// Streams are passed to R in an external pointer. If R lets go of a stream
+// without ending it, it is ended when the pointer is garbage collected.
+void finalizeStreamDataSource(std::shared_ptr<StreamDataSource>* pStream);
+
+typedef Rcpp::XPtr<std::shared_ptr<StreamDataSource>,
+                   Rcpp::PreserveStorage,
+                   finalizeStreamDataSource,
+                   true> StreamDataSourceXPtr;
+
+#endif // STREAMDATASOURCE_HPP
@@ -0,0 +1,149 @@
+#include "timerwheel.h"
+#include "thread.h"
+#include "utils.h"
+#include "uvutil.h"
+
+TimerWheelTimer::TimerWheelTimer()
+  : _pWheel(NULL), _prev(this), _next(this), _rounds(0)
+{
+}
+
+TimerWheelTimer::TimerWheelTimer(std::function<void(void)> callback)
+  : _pWheel(NULL), _prev(this), _next(this), _rounds(0), _callback(callback)
+{
+}
+
+TimerWheelTimer::~TimerWheelTimer() {
+  cancel();
+}
+
+void TimerWheelTimer::cancel() {
+  if (_pWheel) {
+    _pWheel->unlink(this);
+  }
+}
+
+
+TimerWheel::TimerWheel(uv_loop_t* pLoop, uint64_t tickMs, size_t numSlots)
+  : _pLoop(pLoop),
+    _tickMs(tickMs),
+    _numSlots(numSlots),
+    _slots(new TimerWheelTimer[numSlots]),
+    _cursor(0),
+    _lastTick(0),
+    _size(0)
+{
+  ASSERT_BACKGROUND_THREAD()
+  _pTimer = static_cast<uv_timer_t*>(malloc(sizeof(uv_timer_t)));
+  uv_timer_init(pLoop, _pTimer);
+  _pTimer->data = this;
+}
+
+TimerWheel::~TimerWheel() {
+  ASSERT_BACKGROUND_THREAD()
+  debug_log("TimerWheel::~TimerWheel", LOG_DEBUG);
+  // Detach any timers that are still scheduled, so that their owners don't
+  // try to unlink them from this wheel later.
+  for (size_t i = 0; i < _numSlots; i++) {
+    TimerWheelTimer* pHead = &_slots[i];
+    while (pHead->_next != pHead) {
+      unlink(pHead->_next);
+    }
+  }
+  delete[] _slots;
+  if (uv_is_closing(toHandle(_pTimer))) {
+    // The loop is being shut down, and has already closed the timer.
+    free(_pTimer);
+  } else {
+    // calling uv_close() on a timer implicitly calls uv_timer_stop()
+    uv_close(toHandle(_pTimer), freeAfterClose);
+  }
+}
+
+void TimerWheel::start(TimerWheelTimer* pTimer, uint64_t delayMs) {
+  ASSERT_BACKGROUND_THREAD()
+  pTimer->cancel();
+
+  if (_size == 0) {
+    // The uv timer doesn't run while the wheel is empty, so the wheel's
+    // notion of the current time must be brought up to date.
+    _lastTick = uv_now(_pLoop);
+    uv_timer_start(_pTimer, TimerWheel_on_tick, _tickMs, _tickMs);
+  }
+
+  uint64_t ticks = (delayMs + _tickMs - 1) / _tickMs;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  TimerWheelTimer* pHead = &_slots[(_cursor + ticks) % _numSlots];
+  pTimer->_rounds = (ticks - 1) / _numSlots;
+  pTimer->_pWheel = this;
+  pTimer->_prev = pHead->_prev;
+  pTimer->_next = pHead;
+  pHead->_prev->_next = pTimer;
+  pHead->_prev = pTimer;
+  _size++;
+}
+
+void TimerWheel::unlink(TimerWheelTimer* pTimer) {
+  pTimer->_prev->_next = pTimer->_next;
+  pTimer->_next->_prev = pTimer->_prev;
+  pTimer->_prev = pTimer;
+  pTimer->_next = pTimer;
+  pTimer->_pWheel = NULL;
+  _size--;
+
+  if (_size == 0) {
+    uv_timer_stop(_pTimer);
+  }
+}
+
+// Move to the next slot and fire the timers in it that are due.
+void TimerWheel::advance() {
+  _cursor = (_cursor + 1) % _numSlots;
+  TimerWheelTimer* pHead = &_slots[_cursor];
+
+  // Move the timers that are due onto a separate list before running any
+  // callbacks. A callback may schedule, cancel, or destroy timers, including
+  // ones in this slot.
+  TimerWheelTimer due;
+  TimerWheelTimer* pTimer = pHead->_next;
+  while (pTimer != pHead) {
+    TimerWheelTimer* pNext = pTimer->_next;
+    if (pTimer->_rounds > 0) {
+      pTimer->_rounds--;
+    } else {
+      pTimer->_prev->_next = pTimer->_next;
+      pTimer->_next->_prev = pTimer->_prev;
+      pTimer->_prev = due._prev;
+      pTimer->_next = &due;
+      due._prev->_next = pTimer;
+      due._prev = pTimer;
+    }
+    pTimer = pNext;
+  }
+
+  while (due._next != &due) {
+    pTimer = due._next;
+    unlink(pTimer);
+    if (pTimer->_callback) {
+      pTimer->_callback();
+    }
+  }
+}
+
+void TimerWheel::onTick() {
+  ASSERT_BACKGROUND_THREAD()
+  // If the loop was busy, more than one tick may have passed.
+  uint64_t now = uv_now(_pLoop);
+  while (_size > 0 && now - _lastTick >= _tickMs) {
+    _lastTick += _tickMs;
+    advance();
+  }
+}
+
+void TimerWheel_on_tick(uv_timer_t* handle) {
+  TimerWheel* pWheel = reinterpret_cast<TimerWheel*>(handle->data);
+  pWheel->onTick();
+}
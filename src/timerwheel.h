@@ -0,0 +1,92 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <stdint.h>
+#include <functional>
+#include <uv.h>
+
+#include "constants.h"
+
+class TimerWheel;
+
+void TimerWheel_on_tick(uv_timer_t* handle);
+
+// A timer that is driven by a TimerWheel. Objects that need a timer keep one
+// of these as a member, instead of allocating a uv_timer_t of their own. It
+// is cancelled automatically when it is destroyed.
+class TimerWheelTimer : NoCopy {
+  friend class TimerWheel;
+
+  // Non-NULL while the timer is scheduled.
+  TimerWheel* _pWheel;
+  // Links in the list of timers for a slot of the wheel.
+  TimerWheelTimer* _prev;
+  TimerWheelTimer* _next;
+  // The number of times the wheel must turn before this timer fires.
+  uint64_t _rounds;
+  std::function<void(void)> _callback;
+
+public:
+  TimerWheelTimer();
+  explicit TimerWheelTimer(std::function<void(void)> callback);
+  ~TimerWheelTimer();
+
+  void setCallback(std::function<void(void)> callback) {
+    _callback = callback;
+  }
+  bool active() const {
+    return _pWheel != NULL;
+  }
+  void cancel();
+};
+
+
+// A hashed timing wheel (Varghese and Lauck, scheme 6). Timers are kept in a
+// ring of slots, one per tick, so scheduling and cancelling a timer take
+// constant time, and the wheel as a whole needs just one uv_timer_t, which
+// only runs while there are timers scheduled. Timers fire on the first tick
+// after they are due, so they are accurate to within one tick.
+//
+// There is one wheel for the background thread's loop; see forLoop().
+class TimerWheel : NoCopy {
+  friend class TimerWheelTimer;
+  friend void TimerWheel_on_tick(uv_timer_t* handle);
+
+  uv_loop_t* _pLoop;
+  uv_timer_t* _pTimer;
+  uint64_t _tickMs;
+  size_t _numSlots;
+  // Each slot is the head of a circular list of timers.
+  TimerWheelTimer* _slots;
+  size_t _cursor;
+  // The loop time at which the wheel last advanced.
+  uint64_t _lastTick;
+  size_t _size;
+
+  void unlink(TimerWheelTimer* pTimer);
+  void advance();
+  void onTick();
+
+public:
+  TimerWheel(uv_loop_t* pLoop, uint64_t tickMs = 100, size_t numSlots = 512);
+  ~TimerWheel();
+
+  // Schedule pTimer to fire after delayMs. If it was already scheduled, it is
+  // rescheduled.
+  void start(TimerWheelTimer* pTimer, uint64_t delayMs);
+
+  // The number of scheduled timers.
+  size_t size() const {
+    return _size;
+  }
+  uint64_t tickMs() const {
+    return _tickMs;
+  }
+
+  // The wheel that belongs to a loop. It is stored in the loop's data field.
+  static TimerWheel* forLoop(uv_loop_t* pLoop) {
+    return reinterpret_cast<TimerWheel*>(pLoop->data);
+  }
+};
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,161 @@
+#include "trace.h"
+#include "thread.h"
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <uv.h>
+
+struct TraceEvent {
+  uint64_t time;
+  uint64_t id;
+  uint64_t arg;
+  uint16_t name;
+  char phase;
+};
+
+// The events recorded by one thread. Only that thread writes to it, so the
+// only synchronization is with the main thread, when it starts, stops, and
+// writes out the trace.
+struct TraceBuffer {
+  std::vector<TraceEvent> events;
+  // The number of events recorded; the nth is at events[n % events.size()].
+  std::atomic<uint64_t> count;
+  // Set while the thread is recording an event.
+  std::atomic<bool> busy;
+
+  TraceBuffer() : count(0), busy(false) {}
+};
+
+static const char* trace_names[TRACE_NAME_COUNT] = {
+  "parse", "main_thread", "background_queue", "queue_flush", "write",
+  "gzip", "ws_frame_in", "ws_frame_out"
+};
+
+std::atomic<bool> trace_enabled_(false);
+static std::atomic<uint64_t> trace_next_flow(1);
+static uint64_t trace_start_time = 0;
+// The main thread's events, then the background thread's.
+static TraceBuffer trace_buffers[2];
+
+void trace_record(TraceName name, TracePhase phase, uint64_t id, uint64_t arg) {
+  TraceBuffer& buf = trace_buffers[is_background_thread() ? 1 : 0];
+  buf.busy.store(true);
+  // Checked again now that the buffer is marked busy, so that once
+  // trace_stop() has seen that it isn't busy, it won't be written to.
+  if (trace_enabled_.load() && !buf.events.empty()) {
+    uint64_t n = buf.count.load(std::memory_order_relaxed);
+    TraceEvent& event = buf.events[n % buf.events.size()];
+    event.time = uv_hrtime();
+    event.id = id;
+    event.arg = arg;
+    event.name = (uint16_t)name;
+    event.phase = (char)phase;
+    buf.count.store(n + 1, std::memory_order_release);
+  }
+  buf.busy.store(false);
+}
+
+static void run_traced(TraceName name, uint64_t flow, const std::function<void(void)>& fn) {
+  TraceSlice slice(name, flow);
+  trace_event(name, TRACE_FLOW_END, flow);
+  fn();
+}
+
+std::function<void(void)> trace_handoff(TraceName name, std::function<void(void)> fn) {
+  if (!trace_enabled()) {
+    return fn;
+  }
+  uint64_t flow = trace_next_flow++;
+  trace_record(name, TRACE_FLOW_START, flow, 0);
+  return std::bind(run_traced, name, flow, fn);
+}
+
+void trace_start(size_t capacity) {
+  ASSERT_MAIN_THREAD()
+  trace_stop();
+  for (size_t i = 0; i < 2; i++) {
+    trace_buffers[i].events.assign(capacity, TraceEvent());
+    trace_buffers[i].count = 0;
+  }
+  trace_start_time = uv_hrtime();
+  trace_enabled_.store(true);
+}
+
+void trace_stop() {
+  ASSERT_MAIN_THREAD()
+  trace_enabled_.store(false);
+  // Wait for an event that the background thread is in the middle of
+  // recording.
+  for (size_t i = 0; i < 2; i++) {
+    while (trace_buffers[i].busy.load()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+size_t trace_write(const std::string& path) {
+  ASSERT_MAIN_THREAD()
+  if (trace_enabled()) {
+    throw std::runtime_error("Tracing must be stopped before the trace is written.");
+  }
+
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Can't open " + path + " for writing.");
+  }
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+      << "\"args\":{\"name\":\"R main thread\"}},\n";
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+      << "\"args\":{\"name\":\"httpuv background thread\"}}";
+  out << std::fixed << std::setprecision(3);
+
+  size_t written = 0;
+  for (size_t tid = 0; tid < 2; tid++) {
+    const TraceBuffer& buf = trace_buffers[tid];
+    size_t size = buf.events.size();
+    uint64_t count = buf.count.load(std::memory_order_acquire);
+    // When the buffer has wrapped around, the oldest events are gone.
+    uint64_t first = count > size ? count - size : 0;
+
+    for (uint64_t n = first; n < count; n++) {
+      const TraceEvent& e = buf.events[n % size];
+      double ts = e.time > trace_start_time ? (e.time - trace_start_time) / 1e3 : 0;
+      out << ",\n{\"name\":\"" << trace_names[e.name] << "\",\"cat\":\"httpuv\""
+          << ",\"ph\":\"" << e.phase << "\",\"ts\":" << ts
+          << ",\"pid\":1,\"tid\":" << tid;
+
+      switch (e.phase) {
+      case TRACE_ASYNC_BEGIN:
+      case TRACE_ASYNC_END:
+      case TRACE_FLOW_START:
+        out << ",\"id\":" << e.id;
+        break;
+      case TRACE_FLOW_END:
+        // Bind to the slice that encloses this event.
+        out << ",\"id\":" << e.id << ",\"bp\":\"e\"";
+        break;
+      case TRACE_INSTANT:
+        out << ",\"s\":\"t\"";
+        break;
+      }
+
+      // An end event's id is already on its begin event.
+      bool args = e.phase == TRACE_END ? e.arg != 0 : (e.id != 0 || e.arg != 0);
+      if (args) {
+        out << ",\"args\":{\"id\":" << e.id << ",\"n\":" << e.arg << "}";
+      }
+      out << "}";
+      written++;
+    }
+  }
+  out << "\n]}\n";
+
+  if (!out) {
+    throw std::runtime_error("Error writing " + path + ".");
+  }
+  return written;
+}
@@ -0,0 +1,106 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+// A trace of the work that the main and background threads do, which can be
+// written as a Chrome Trace Event file and viewed in chrome://tracing or
+// Perfetto. Each thread records compact events into its own ring buffer, so
+// recording doesn't take any locks; when tracing is off, recording an event
+// costs one branch.
+
+enum TraceName {
+  // http-parser reading data from a connection
+  TRACE_PARSE,
+  // Work handed to the main thread with invoke_main(), from when it was
+  // scheduled to when it ran
+  TRACE_MAIN_THREAD,
+  // Work handed to the background thread with CallbackQueue::push()
+  TRACE_BACKGROUND_QUEUE,
+  // The background thread running the callbacks in its queue
+  TRACE_QUEUE_FLUSH,
+  // A write to a connection, from uv_write() until it finished
+  TRACE_WRITE,
+  // Compressing a block of a response body
+  TRACE_GZIP,
+  TRACE_WS_FRAME_IN,
+  TRACE_WS_FRAME_OUT,
+  TRACE_NAME_COUNT
+};
+
+// The kinds of events, with their Chrome Trace Event phase letters.
+enum TracePhase {
+  // A slice of time on one thread
+  TRACE_BEGIN = 'B',
+  TRACE_END = 'E',
+  // Something that happened at one time
+  TRACE_INSTANT = 'i',
+  // Work that is started and finished in different callbacks
+  TRACE_ASYNC_BEGIN = 'b',
+  TRACE_ASYNC_END = 'e',
+  // A handoff from one slice to another, usually on another thread
+  TRACE_FLOW_START = 's',
+  TRACE_FLOW_END = 'f'
+};
+
+extern std::atomic<bool> trace_enabled_;
+
+inline bool trace_enabled() {
+  return trace_enabled_.load(std::memory_order_relaxed);
+}
+
+// Record an event. `id` ties together the events for one connection, write,
+// or handoff; `arg` is a size or count. Only the main and background threads
+// may record events.
+void trace_record(TraceName name, TracePhase phase, uint64_t id, uint64_t arg);
+
+inline void trace_event(TraceName name, TracePhase phase,
+                        uint64_t id = 0, uint64_t arg = 0)
+{
+  if (trace_enabled()) {
+    trace_record(name, phase, id, arg);
+  }
+}
+
+inline uint64_t trace_id(const void* p) {
+  return (uint64_t)(uintptr_t)p;
+}
+
+// If tracing is on, returns a function that runs `fn` in a slice named
+// `name`, with a flow from the place where this was called. Otherwise, it
+// returns `fn`.
+std::function<void(void)> trace_handoff(TraceName name, std::function<void(void)> fn);
+
+// Records a slice for the lifetime of this object.
+class TraceSlice {
+  TraceName _name;
+  uint64_t _id;
+  bool _enabled;
+public:
+  TraceSlice(TraceName name, uint64_t id = 0)
+    : _name(name), _id(id), _enabled(trace_enabled())
+  {
+    if (_enabled) {
+      trace_record(_name, TRACE_BEGIN, _id, 0);
+    }
+  }
+  ~TraceSlice() {
+    if (_enabled) {
+      trace_record(_name, TRACE_END, _id, 0);
+    }
+  }
+};
+
+// Main thread. Starting clears the events recorded before; each thread keeps
+// the most recent `capacity` events.
+void trace_start(size_t capacity);
+void trace_stop();
+// Main thread. Writes the events that have been recorded, in the Chrome Trace
+// Event JSON format, and returns the number of events written. Tracing must
+// be stopped.
+size_t trace_write(const std::string& path);
+
+#endif // TRACE_HPP
@@ -0,0 +1,120 @@
+#include "uri.h"
+#include <iomanip>
+#include <sstream>
+
+static bool isReservedUrlChar(char c) {
+  switch (c) {
+    case ';':
+    case ',':
+    case '/':
+    case '?':
+    case ':':
+    case '@':
+    case '&':
+    case '=':
+    case '+':
+    case '$':
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool needsEscape(char c, bool encodeReserved) {
+  if (c >= 'a' && c <= 'z')
+    return false;
+  if (c >= 'A' && c <= 'Z')
+    return false;
+  if (c >= '0' && c <= '9')
+    return false;
+  if (isReservedUrlChar(c))
+    return encodeReserved;
+  switch (c) {
+    case '-':
+    case '_':
+    case '.':
+    case '!':
+    case '~':
+    case '*':
+    case '\'':
+    case '(':
+    case ')':
+      return false;
+  }
+  return true;
+}
+
+std::string doEncodeURI(std::string value, bool encodeReserved) {
+  std::ostringstream os;
+  os << std::hex << std::uppercase;
+  for (std::string::const_iterator it = value.begin();
+    it != value.end();
+    it++) {
+
+    if (!needsEscape(*it, encodeReserved)) {
+      os << *it;
+    } else {
+      os << '%' << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(static_cast<unsigned char>(*it));
+    }
+  }
+  return os.str();
+}
+
+static int hexToInt(char c) {
+  switch (c) {
+    case '0': return 0;
+    case '1': return 1;
+    case '2': return 2;
+    case '3': return 3;
+    case '4': return 4;
+    case '5': return 5;
+    case '6': return 6;
+    case '7': return 7;
+    case '8': return 8;
+    case '9': return 9;
+    case 'A': case 'a': return 10;
+    case 'B': case 'b': return 11;
+    case 'C': case 'c': return 12;
+    case 'D': case 'd': return 13;
+    case 'E': case 'e': return 14;
+    case 'F': case 'f': return 15;
+    default: return -1;
+  }
+}
+
+std::string doDecodeURI(std::string value, bool component) {
+  std::ostringstream os;
+  for (std::string::const_iterator it = value.begin();
+    it != value.end();
+    it++) {
+
+    // If there aren't enough characters left for this to be a
+    // valid escape code, just use the character and move on
+    if (it > value.end() - 3) {
+      os << *it;
+      continue;
+    }
+
+    if (*it == '%') {
+      char hi = *(++it);
+      char lo = *(++it);
+      int iHi = hexToInt(hi);
+      int iLo = hexToInt(lo);
+      if (iHi < 0 || iLo < 0) {
+        // Invalid escape sequence
+        os << '%' << hi << lo;
+        continue;
+      }
+      char c = (char)(iHi << 4 | iLo);
+      if (!component && isReservedUrlChar(c)) {
+        os << '%' << hi << lo;
+      } else {
+        os << c;
+      }
+    } else {
+      os << *it;
+    }
+  }
+
+  return os.str();
+}
@@ -0,0 +1,13 @@
+#ifndef URI_HPP
+#define URI_HPP
+
+#include <string>
+
+// Percent-encode a string, as JavaScript's encodeURI() does, or as
+// encodeURIComponent() does if `encodeReserved` is true.
+std::string doEncodeURI(std::string value, bool encodeReserved);
+// Decode percent-encoded sequences, as JavaScript's decodeURI() does, or as
+// decodeURIComponent() does if `component` is true.
+std::string doDecodeURI(std::string value, bool component);
+
+#endif
@@ -0,0 +1,89 @@
+#include "utf8.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HTTPUV_UTF8_SSE2
+#endif
+
+// Returns the number of bytes at the start of the input that are ASCII.
+// Only whole blocks are counted, so the result may be less than the actual
+// number; the caller checks the rest one byte at a time.
+static size_t asciiPrefix(const uint8_t* p, size_t len) {
+  size_t i = 0;
+#ifdef HTTPUV_UTF8_SSE2
+  // A byte is ASCII if its high bit is clear; movemask collects the high
+  // bits of 16 bytes at once.
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    if (_mm_movemask_epi8(chunk) != 0)
+      return i;
+  }
+#endif
+  // Portable fallback: check eight bytes at a time in a 64-bit word.
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof(word));
+    if ((word & 0x8080808080808080ULL) != 0)
+      return i;
+  }
+  return i;
+}
+
+bool UTF8Validator::validate(const char* pData, size_t len) {
+  if (!_valid)
+    return false;
+
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(pData);
+  size_t i = 0;
+
+  while (i < len) {
+    if (_needed == 0) {
+      i += asciiPrefix(p + i, len - i);
+      if (i == len)
+        break;
+    }
+
+    uint8_t b = p[i++];
+
+    if (_needed == 0) {
+      // The first byte of a sequence determines its length, and narrows the
+      // range of the second byte to rule out overlong forms, surrogates
+      // (U+D800 to U+DFFF), and code points above U+10FFFF.
+      if (b < 0x80) {
+        continue;
+      } else if (b >= 0xC2 && b <= 0xDF) {
+        _needed = 1;
+      } else if (b == 0xE0) {
+        _needed = 2;
+        _lower = 0xA0;
+      } else if ((b >= 0xE1 && b <= 0xEC) || b == 0xEE || b == 0xEF) {
+        _needed = 2;
+      } else if (b == 0xED) {
+        _needed = 2;
+        _upper = 0x9F;
+      } else if (b == 0xF0) {
+        _needed = 3;
+        _lower = 0x90;
+      } else if (b >= 0xF1 && b <= 0xF3) {
+        _needed = 3;
+      } else if (b == 0xF4) {
+        _needed = 3;
+        _upper = 0x8F;
+      } else {
+        _valid = false;
+        return false;
+      }
+    } else {
+      if (b < _lower || b > _upper) {
+        _valid = false;
+        return false;
+      }
+      _lower = 0x80;
+      _upper = 0xBF;
+      _needed--;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checks that a byte stream is well-formed UTF-8 (RFC 3629), as required for
+// the payload of WebSocket text messages (RFC 6455 Section 8.1). Overlong
+// encodings, surrogates, and code points above U+10FFFF are rejected.
+//
+// The input can be passed in pieces, which may split a multi-byte sequence;
+// the validator remembers where it is in the sequence. Runs of ASCII are
+// checked several bytes at a time.
+class UTF8Validator {
+  // Number of continuation bytes still expected in the current sequence
+  int _needed;
+  // Range that the next continuation byte must fall in
+  uint8_t _lower;
+  uint8_t _upper;
+  bool _valid;
+
+public:
+  UTF8Validator() {
+    reset();
+  }
+
+  void reset() {
+    _needed = 0;
+    _lower = 0x80;
+    _upper = 0xBF;
+    _valid = true;
+  }
+
+  // Check the next piece of input. Returns false if the input so far is not
+  // valid UTF-8; once that happens, it stays false until reset().
+  bool validate(const char* pData, size_t len);
+
+  // True if the input so far is valid and doesn't end in the middle of a
+  // multi-byte sequence.
+  bool complete() const {
+    return _valid && _needed == 0;
+  }
+};
+
+inline bool isValidUTF8(const char* pData, size_t len) {
+  UTF8Validator validator;
+  return validator.validate(pData, len) && validator.complete();
+}
+
+#endif
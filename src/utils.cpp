@@ -1,12 +1,13 @@
 #include "utils.h"
+#include "eventlog.h"
 
 // Set the default log level
 LogLevel log_level_ = LOG_ERROR;
 
 void debug_log(const std::string& msg, LogLevel level) {
-  if (log_level_ >= level) {
+  if (log_enabled(level)) {
     err_printf("%s\n", msg.c_str());
-  };
+  }
 }
 
 
@@ -41,6 +42,12 @@ std::string log_level(const std::string& level) {
   }
 }
 
+// Removes the events from the event log and returns them.
+// [[Rcpp::export]]
+Rcpp::List getLogEvents_() {
+  return log_events_drain();
+}
+
 // @param input The istream to parse from
 // @param digits The exact number of digits to parse; if this number of digits
 //   is not available, false is returned.
@@ -111,7 +118,7 @@ time_t parse_http_date_string(const std::string& date) {
     return 0;
   }
 
-  std::tm t = {0};
+  std::tm t = {};
 
   try {
     std::istringstream date_ss(date);
@@ -153,3 +160,27 @@ time_t parse_http_date_string(const std::string& date) {
 
   return timegm2(&t);
 }
+
+bool parse_vary(const std::string& value, std::vector<std::string>* pNames) {
+  size_t start = 0;
+  while (start < value.size()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    size_t first = value.find_first_not_of(" \t", start);
+    size_t last = value.find_last_not_of(" \t", end - 1);
+    std::string name;
+    if (first != std::string::npos && first < end) {
+      name = value.substr(first, last - first + 1);
+    }
+    if (name == "*") {
+      return false;
+    }
+    if (!name.empty()) {
+      pNames->push_back(name);
+    }
+    start = end + 1;
+  }
+  return true;
+}
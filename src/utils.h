@@ -75,8 +75,23 @@ enum LogLevel {
   LOG_DEBUG
 };
 
+extern LogLevel log_level_;
+
+inline bool log_enabled(LogLevel level) {
+  return log_level_ >= level;
+}
+
 void debug_log(const std::string& msg, LogLevel level);
 
+// Most messages are string literals. This keeps them from being copied into a
+// std::string when they won't be logged. Messages that are built up should be
+// inside an `if (log_enabled(level))`.
+inline void debug_log(const char* msg, LogLevel level) {
+  if (log_enabled(level)) {
+    err_printf("%s\n", msg);
+  }
+}
+
 // ============================================================================
 
 
@@ -266,6 +281,10 @@ inline std::string http_date_string(const time_t& t) {
 // time_t representing that time. If the date is malformed, then return 0.
 time_t parse_http_date_string(const std::string& date);
 
+// Get the names of the request headers in a Vary header. Returns false if the
+// response varies on something other than request headers ("*").
+bool parse_vary(const std::string& value, std::vector<std::string>* pNames);
+
 // Compares two strings in constant time. Returns true if they are the same;
 // false otherwise.
 inline bool constant_time_compare(const std::string& a, const std::string& b) {
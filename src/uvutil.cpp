@@ -1,5 +1,8 @@
 #include "uvutil.h"
 #include "thread.h"
+#include "utils.h"
+#include "trace.h"
+#include "eventlog.h"
 #include <string.h>
 
 
@@ -49,6 +52,7 @@ public:
     ASSERT_BACKGROUND_THREAD()
     pParent->_pDataSource->freeData(buffer);
     pParent->_activeWrites--;
+    pParent->onPartWriteFinished();
 
     if (handle.handle->write_queue_size == 0) {
       // Write queue is empty, so we're ready to check for
@@ -90,9 +94,34 @@ void InMemoryDataSource::add(const std::vector<uint8_t>& moreData) {
   _buffer.insert(_buffer.end(), moreData.begin(), moreData.end());
 }
 
+uint64_t SharedBufferDataSource::size() const {
+  return _pBuffer->size();
+}
+uv_buf_t SharedBufferDataSource::getData(size_t bytesDesired) {
+  ASSERT_BACKGROUND_THREAD()
+  size_t bytes = _pBuffer->size() - _pos;
+  if (bytesDesired < bytes)
+    bytes = bytesDesired;
+
+  // The buffer isn't modified; uv_buf_t just doesn't have a const version.
+  uv_buf_t mem;
+  mem.base = bytes > 0 ? const_cast<char*>(reinterpret_cast<const char*>(&(*_pBuffer)[_pos])) : 0;
+  mem.len = bytes;
+
+  _pos += bytes;
+  return mem;
+}
+void SharedBufferDataSource::freeData(uv_buf_t buffer) {
+}
+void SharedBufferDataSource::close() {
+  ASSERT_BACKGROUND_THREAD()
+  _pos = _pBuffer->size();
+}
+
 static void writecb(uv_write_t* handle, int status) {
   ASSERT_BACKGROUND_THREAD()
   WriteOp* pWriteOp = (WriteOp*)handle->data;
+  trace_event(TRACE_WRITE, TRACE_ASYNC_END, trace_id(pWriteOp));
   pWriteOp->end();
 }
 
@@ -114,6 +143,18 @@ void ExtendedWrite::next() {
     return;
   }
 
+  if (uv_is_closing(toHandle(_pHandle))) {
+    // The connection was closed, perhaps while we were waiting for data.
+    _errored = true;
+    next();
+    return;
+  }
+
+  if (_pDataSource->waitForData(std::bind(&ExtendedWrite::next, this))) {
+    // next() will be called again when there's more data.
+    return;
+  }
+
   uv_buf_t buf;
   try {
     buf = _pDataSource->getData(65536);
@@ -170,5 +211,17 @@ void ExtendedWrite::next() {
   WriteOp* pWriteOp = new WriteOp(this, prefix, buf, suffix);
   _activeWrites++;
   auto op_bufs = pWriteOp->bufs();
-  uv_write(&pWriteOp->handle, _pHandle, &op_bufs[0], op_bufs.size(), &writecb);
+  int r = uv_write(&pWriteOp->handle, _pHandle, &op_bufs[0], op_bufs.size(), &writecb);
+  if (r == 0) {
+    size_t bytes = prefix.size() + buf.len + suffix.size();
+    trace_event(TRACE_WRITE, TRACE_ASYNC_BEGIN, trace_id(pWriteOp), bytes);
+    onPartWriteStarted(bytes);
+  } else {
+    log_event(LOG_INFO, EV_WRITE_ERROR, 0, r);
+    _pDataSource->freeData(buf);
+    _activeWrites--;
+    delete pWriteOp;
+    _errored = true;
+    next();
+  }
 }
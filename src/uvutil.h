@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <uv.h>
 
 #include <Rcpp.h>
@@ -33,6 +34,15 @@ class DataSource {
 public:
   virtual ~DataSource() {}
   virtual uint64_t size() const = 0;
+  // For data sources whose data arrives over time. If there's no data to be
+  // had right now, but there will be, return true and arrange for `resume`
+  // to be called on the background thread once there is.
+  virtual bool waitForData(std::function<void(void)> /* resume */) {
+    return false;
+  }
+  // If waitForData() is waiting, call `resume` soon, on the background
+  // thread, without waiting for data. Used when the connection closes.
+  virtual void stopWaiting() {}
   virtual uv_buf_t getData(size_t bytesDesired) = 0;
   virtual void freeData(uv_buf_t buffer) = 0;
   virtual void close() = 0;
@@ -65,6 +75,27 @@ public:
   void add(const std::vector<uint8_t>& moreData);
 };
 
+// A DataSource over bytes that are shared with other responses, so that the
+// same body can be sent on many connections without being copied. The bytes
+// must not change while any response that uses them is being written.
+class SharedBufferDataSource : public DataSource {
+private:
+  std::shared_ptr<const std::vector<uint8_t> > _pBuffer;
+  size_t _pos;
+public:
+  explicit SharedBufferDataSource(std::shared_ptr<const std::vector<uint8_t> > pBuffer)
+    : _pBuffer(pBuffer), _pos(0) {}
+
+  std::shared_ptr<const std::vector<uint8_t> > buffer() const {
+    return _pBuffer;
+  }
+
+  uint64_t size() const;
+  uv_buf_t getData(size_t bytesDesired);
+  void freeData(uv_buf_t buffer);
+  void close();
+};
+
 // Class for writing a DataSource to a uv_stream_t. Takes care
 // not to buffer too much data in memory (happens when you try
 // to write too much data to a slow uv_stream_t).
@@ -83,6 +114,9 @@ public:
   virtual ~ExtendedWrite() {}
 
   virtual void onWriteComplete(int status) = 0;
+  // Called when each uv_write() for a part of the data starts and finishes.
+  virtual void onPartWriteStarted(size_t /* bytes */) {}
+  virtual void onPartWriteFinished() {}
 
   void begin();
   friend class WriteOp;
@@ -1,7 +1,11 @@
+#include <string.h>
 #include <functional>
 #include <memory>
 #include "httpuv.h"
+#include "uri.h"
 #include "filedatasource.h"
+#include "streamdatasource.h"
+#include "ssechannel.h"
 #include "webapplication.h"
 #include "httprequest.h"
 #include "http.h"
@@ -10,6 +14,7 @@
 #include "mime.h"
 #include "staticpath.h"
 #include "fs.h"
+#include "admin.h"
 #include <Rinternals.h>
 
 // ============================================================================
@@ -127,6 +132,12 @@ std::pair<std::string, std::string> splitQueryString(const std::string& url) {
   return std::pair<std::string, std::string>(path, queryString);
 }
 
+// True if the request has a body (or says that it does).
+static bool has_request_body(std::shared_ptr<HttpRequest> pRequest) {
+  return (pRequest->hasHeader("Content-Length") && pRequest->getHeader("Content-Length") != "0")
+    || pRequest->hasHeader("Transfer-Encoding");
+}
+
 
 void requestToEnv(std::shared_ptr<HttpRequest> pRequest, Rcpp::Environment* pEnv) {
   ASSERT_MAIN_THREAD()
@@ -181,9 +192,58 @@ void requestToEnv(std::shared_ptr<HttpRequest> pRequest, Rcpp::Environment* pEnv
 }
 
 
+// Store a response that R marked as cacheable, so that the background thread
+// can answer matching requests with it.
+static void cache_response(ResponseCache* pCache,
+                           std::shared_ptr<HttpRequest> pRequest,
+                           int status,
+                           std::shared_ptr<HttpResponse> pResponse,
+                           std::shared_ptr<const std::vector<uint8_t> > body,
+                           double ttl)
+{
+  ASSERT_MAIN_THREAD()
+  std::shared_ptr<CachedResponse> pEntry = std::make_shared<CachedResponse>();
+  pEntry->method = pRequest->method();
+  pEntry->url = pRequest->url();
+  pEntry->status = status;
+  pEntry->body = body;
+  pEntry->size = body->size() + pEntry->url.size() + sizeof(CachedResponse);
+
+  const RequestHeaders& requestHeaders = pRequest->headers();
+  const ResponseHeaders& headers = pResponse->headers();
+  ResponseHeaders::const_iterator it;
+  for (it = headers.begin(); it != headers.end(); it++) {
+    if (strcasecmp(it->first.c_str(), "Date") == 0) {
+      // Each response that is made from the entry gets its own Date.
+      continue;
+    }
+    if (strcasecmp(it->first.c_str(), "Set-Cookie") == 0) {
+      // Never share one client's cookies with another.
+      return;
+    }
+    if (strcasecmp(it->first.c_str(), "Vary") == 0) {
+      std::vector<std::string> names;
+      if (!parse_vary(it->second, &names)) {
+        return;
+      }
+      for (size_t i = 0; i < names.size(); i++) {
+        RequestHeaders::const_iterator h = requestHeaders.find(names[i]);
+        pEntry->vary.push_back(std::make_pair(
+          names[i], h == requestHeaders.end() ? std::string() : h->second
+        ));
+      }
+    }
+    pEntry->headers.push_back(*it);
+    pEntry->size += it->first.size() + it->second.size();
+  }
+
+  pCache->put(pEntry, (uint64_t)(ttl * 1000));
+}
+
 std::shared_ptr<HttpResponse> listToResponse(
   std::shared_ptr<HttpRequest> pRequest,
-  const Rcpp::List& response)
+  const Rcpp::List& response,
+  ResponseCache* pCache = NULL)
 {
   ASSERT_MAIN_THREAD()
   using namespace Rcpp;
@@ -212,8 +272,31 @@ std::shared_ptr<HttpResponse> listToResponse(
 
   // The response can either contain:
   // - bodyFile: String value that names the file that should be streamed
+  // - bodyStream: External pointer to a StreamDataSource that R writes to
+  // - bodySSEChannel: External pointer to an SSEChannel to subscribe to
   // - body: Character vector (which is charToRaw-ed) or raw vector, or NULL
-  if (std::find(names.begin(), names.end(), "bodyFile") != names.end()) {
+  bool chunked = false;
+  double cacheTtl = 0;
+  std::shared_ptr<const std::vector<uint8_t> > sharedBody;
+  if (std::find(names.begin(), names.end(), "bodyStream") != names.end()) {
+    SEXP stream = response["bodyStream"];
+    StreamDataSourceXPtr stream_xptr(stream);
+    pDataSource = *stream_xptr.get();
+    chunked = true;
+  }
+  else if (std::find(names.begin(), names.end(), "bodySSEChannel") != names.end()) {
+    SEXP channel = response["bodySSEChannel"];
+    SSEChannelXPtr channel_xptr(channel);
+    std::string lastEventId;
+    const RequestHeaders& requestHeaders = pRequest->headers();
+    RequestHeaders::const_iterator it = requestHeaders.find("Last-Event-ID");
+    if (it != requestHeaders.end()) {
+      lastEventId = it->second;
+    }
+    pDataSource = (*channel_xptr.get())->subscribe(lastEventId, pRequest->handle()->loop);
+    chunked = true;
+  }
+  else if (std::find(names.begin(), names.end(), "bodyFile") != names.end()) {
     std::shared_ptr<FileDataSource> pFDS = std::make_shared<FileDataSource>();
     FileDataSourceResult ret = pFDS->initialize(
       Rcpp::as<std::string>(response["bodyFile"]),
@@ -225,19 +308,42 @@ std::shared_ptr<HttpResponse> listToResponse(
     }
     pDataSource = pFDS;
   }
-  else if (hasBody && Rf_isString(response["body"])) {
-    RawVector responseBytes = Function("charToRaw")(response["body"]);
-    pDataSource = std::make_shared<InMemoryDataSource>(responseBytes);
-  }
-  else if (hasBody) {
-    RawVector responseBytes = response["body"];
-    pDataSource = std::make_shared<InMemoryDataSource>(responseBytes);
+  else {
+    // Only GET responses with an in-memory body are cached, and only if the
+    // request had no body.
+    if (pCache != NULL && pCache->enabled() &&
+        std::find(names.begin(), names.end(), "cacheTtl") != names.end() &&
+        pRequest->method() == "GET" && !has_request_body(pRequest))
+    {
+      cacheTtl = Rcpp::as<double>(response["cacheTtl"]);
+    }
+
+    RawVector responseBytes;
+    if (hasBody && Rf_isString(response["body"])) {
+      responseBytes = Function("charToRaw")(response["body"]);
+    } else if (hasBody) {
+      responseBytes = response["body"];
+    }
+
+    if (cacheTtl > 0 || pRequest->isCoalescing()) {
+      // The cache, and any requests that were coalesced with this one, share
+      // the bytes with this response.
+      sharedBody = std::make_shared<const std::vector<uint8_t> >(
+        responseBytes.begin(), responseBytes.end()
+      );
+      pDataSource = std::make_shared<SharedBufferDataSource>(sharedBody);
+    } else if (hasBody) {
+      pDataSource = std::make_shared<InMemoryDataSource>(responseBytes);
+    }
   }
 
   std::shared_ptr<HttpResponse> pResp(
     new HttpResponse(pRequest, status, statusDesc, pDataSource),
     auto_deleter_background<HttpResponse>
   );
+  if (chunked) {
+    pResp->setChunked();
+  }
   CharacterVector headerNames = responseHeaders.names();
   for (R_len_t i = 0; i < responseHeaders.size(); i++) {
     pResp->addHeader(
@@ -245,17 +351,24 @@ std::shared_ptr<HttpResponse> listToResponse(
       Rcpp::as<std::string>(responseHeaders[i]));
   }
 
+  if (cacheTtl > 0) {
+    cache_response(pCache, pRequest, status, pResp, sharedBody, cacheTtl);
+  }
+
   return pResp;
 }
 
 void invokeResponseFun(std::function<void(std::shared_ptr<HttpResponse>)> fun,
                        std::shared_ptr<HttpRequest> pRequest,
+                       ResponseCache* pCache,
                        Rcpp::List response)
 {
   ASSERT_MAIN_THREAD()
+  pRequest->timestamps().appEnd = uv_hrtime();
   // new HttpResponse object. The callback will invoke
   // HttpResponse->writeResponse().
-  std::shared_ptr<HttpResponse> pResponse = listToResponse(pRequest, response);
+  std::shared_ptr<HttpResponse> pResponse = listToResponse(pRequest, response, pCache);
+  pRequest->timestamps().converted = uv_hrtime();
   fun(pResponse);
 }
 
@@ -270,11 +383,22 @@ RWebApplication::RWebApplication(
     Rcpp::Function onRequest,
     Rcpp::Function onWSOpen,
     Rcpp::Function onWSMessage,
+    Rcpp::Function onWSMessageBatch,
+    Rcpp::Function onWSMessageStream,
     Rcpp::Function onWSClose,
     Rcpp::List     staticPaths,
-    Rcpp::List     staticPathOptions) :
+    Rcpp::List     staticPathOptions,
+    Rcpp::List     serverOptions) :
     _onHeaders(onHeaders), _onBodyData(onBodyData), _onRequest(onRequest),
-    _onWSOpen(onWSOpen), _onWSMessage(onWSMessage), _onWSClose(onWSClose)
+    _onWSOpen(onWSOpen), _onWSMessage(onWSMessage),
+    _onWSMessageBatch(onWSMessageBatch), _onWSMessageStream(onWSMessageStream),
+    _onWSClose(onWSClose),
+    _serverOptions(serverOptions),
+    _responseCache(_serverOptions.response_cache_size),
+    _requestCoalescer(_serverOptions.coalesce_headers),
+    _loadShedder(_serverOptions.shed_queue_delay_ms,
+                 _serverOptions.shed_retry_after,
+                 _serverOptions.shed_exempt)
 {
   ASSERT_MAIN_THREAD()
 
@@ -347,11 +471,12 @@ void RWebApplication::getResponse(std::shared_ptr<HttpRequest> pRequest,
   ASSERT_MAIN_THREAD()
   debug_log("RWebApplication::getResponse", LOG_DEBUG);
   using namespace Rcpp;
+  pRequest->timestamps().appStart = uv_hrtime();
 
   // Pass callback to R:
   // invokeResponseFun(callback, pRequest, _1)
   std::function<void(List)>* callback_wrapper = new std::function<void(List)>(
-    std::bind(invokeResponseFun, callback, pRequest, std::placeholders::_1)
+    std::bind(invokeResponseFun, callback, pRequest, &_responseCache, std::placeholders::_1)
   );
 
   SEXP callback_xptr = PROTECT(R_MakeExternalPtr(callback_wrapper, R_NilValue, R_NilValue));
@@ -396,9 +521,17 @@ void RWebApplication::onWSOpen(std::shared_ptr<HttpRequest> pRequest,
   }
 
   requestToEnv(pRequest, &pRequest->env());
+
+  // This is the only external pointer created for this connection. R keeps
+  // it in the WebSocket object and uses it to send messages and close the
+  // connection.
+  Rcpp::RObject handle = externalize_shared_ptr(pConn);
+  _wsConnections[pConn->id()] = handle;
+
   try {
     _onWSOpen(
-      externalize_shared_ptr(pConn),
+      handle,
+      pConn->id(),
       pRequest->env()
     );
   } catch(...) {
@@ -406,33 +539,150 @@ void RWebApplication::onWSOpen(std::shared_ptr<HttpRequest> pRequest,
   }
 }
 
+// Make an R string from the payload of a text message. The payload has already
+// been validated as UTF-8 on the background thread, so it is marked as UTF-8
+// without being checked or translated again. R strings can't contain NUL
+// characters, so the text ends at the first one, if there is one.
+static Rcpp::RObject utf8Message(const std::vector<char>& data) {
+  ASSERT_MAIN_THREAD()
+  const char* pData = data.empty() ? "" : &data[0];
+  const char* pNul = static_cast<const char*>(memchr(pData, '\0', data.size()));
+  size_t len = pNul ? pNul - pData : data.size();
+
+  SEXP chr = PROTECT(Rf_mkCharLenCE(pData, len, CE_UTF8));
+  Rcpp::RObject result(Rf_ScalarString(chr));
+  UNPROTECT(1);
+  return result;
+}
+
 void RWebApplication::onWSMessage(std::shared_ptr<WebSocketConnection> pConn,
                                   bool binary,
                                   std::shared_ptr<std::vector<char> > data,
                                   std::function<void(void)> error_callback)
 {
   ASSERT_MAIN_THREAD()
+  // Messages can still arrive after R has been told that the connection
+  // closed, or if the connection was never opened in R.
+  if (_wsConnections.find(pConn->id()) == _wsConnections.end()) {
+    return;
+  }
+
   try {
     if (binary)
       _onWSMessage(
-        externalize_shared_ptr(pConn),
+        pConn->id(),
         binary,
         std::vector<uint8_t>(data->begin(), data->end())
       );
     else
       _onWSMessage(
-        externalize_shared_ptr(pConn),
+        pConn->id(),
         binary,
-        std::string(data->begin(), data->end())
+        utf8Message(*data)
       );
   } catch(...) {
     error_callback();
   }
 }
 
+// Pass a batch of messages to R in a single call. The R function receives an
+// integer vector of connection IDs, a logical vector indicating which
+// messages are binary, and a list of the messages.
+void RWebApplication::onWSMessageBatch(std::shared_ptr<WSMessageBatch> batch)
+{
+  ASSERT_MAIN_THREAD()
+  // Leave out messages for connections that R doesn't know about.
+  std::vector<const WSBatchedMessage*> open;
+  open.reserve(batch->size());
+  for (WSMessageBatch::const_iterator it = batch->begin(); it != batch->end(); it++) {
+    if (_wsConnections.find(it->pConn->id()) != _wsConnections.end()) {
+      open.push_back(&(*it));
+    }
+  }
+  if (open.empty()) {
+    return;
+  }
+
+  size_t n = open.size();
+  Rcpp::IntegerVector ids(n);
+  Rcpp::LogicalVector binary(n);
+  Rcpp::List messages(n);
+
+  for (size_t i = 0; i < n; i++) {
+    const WSBatchedMessage& msg = *open[i];
+    ids[i] = msg.pConn->id();
+    binary[i] = msg.binary;
+    if (msg.binary) {
+      messages[i] = std::vector<uint8_t>(msg.data->begin(), msg.data->end());
+    } else {
+      messages[i] = utf8Message(*msg.data);
+    }
+  }
+
+  try {
+    _onWSMessageBatch(ids, binary, messages);
+  } catch(...) {
+    for (size_t i = 0; i < n; i++) {
+      open[i]->error_callback();
+    }
+  }
+}
+
+// Large messages are passed to the same R function whether they are streamed
+// or spooled: it receives the connection ID, whether the message is binary,
+// and either a raw vector with the next part of the message and whether it
+// is the last part, or the path of the file that holds the whole message.
+void RWebApplication::onWSMessageChunk(std::shared_ptr<WebSocketConnection> pConn,
+                                       bool binary,
+                                       std::shared_ptr<std::vector<char> > data,
+                                       bool last,
+                                       std::function<void(void)> error_callback)
+{
+  ASSERT_MAIN_THREAD()
+  if (_wsConnections.find(pConn->id()) == _wsConnections.end()) {
+    return;
+  }
+
+  try {
+    _onWSMessageStream(
+      pConn->id(),
+      binary,
+      std::vector<uint8_t>(data->begin(), data->end()),
+      last
+    );
+  } catch(...) {
+    error_callback();
+  }
+}
+
+void RWebApplication::onWSMessageFile(std::shared_ptr<WebSocketConnection> pConn,
+                                      bool binary,
+                                      std::string path,
+                                      std::function<void(void)> error_callback)
+{
+  ASSERT_MAIN_THREAD()
+  if (_wsConnections.find(pConn->id()) == _wsConnections.end()) {
+    remove(path.c_str());
+    return;
+  }
+
+  try {
+    _onWSMessageStream(pConn->id(), binary, path, true);
+  } catch(...) {
+    error_callback();
+  }
+}
+
 void RWebApplication::onWSClose(std::shared_ptr<WebSocketConnection> pConn) {
   ASSERT_MAIN_THREAD()
-  _onWSClose(externalize_shared_ptr(pConn));
+  std::map<int, Rcpp::RObject>::iterator it = _wsConnections.find(pConn->id());
+  if (it == _wsConnections.end()) {
+    return;
+  }
+  // R's WebSocket object may still refer to the handle, so the external
+  // pointer isn't necessarily freed here.
+  _wsConnections.erase(it);
+  _onWSClose(pConn->id());
 }
 
 
@@ -443,6 +693,40 @@ void RWebApplication::onWSClose(std::shared_ptr<WebSocketConnection> pConn) {
 // Unlike most of the methods for an RWebApplication, these ones are called on
 // the background thread.
 
+// Make a response whose body is shared with other responses, for a request
+// that matched a fixed or cached response.
+std::shared_ptr<HttpResponse> shared_body_response(
+  std::shared_ptr<HttpRequest> pRequest,
+  int status_code,
+  const ResponseHeaders& headers,
+  std::shared_ptr<const std::vector<uint8_t> > body
+) {
+  ASSERT_BACKGROUND_THREAD()
+  // 1xx, 204 and 304 responses can't have a body. Other responses always get
+  // one, even if it's empty, so that the Content-Length is sent.
+  bool no_body = (status_code >= 100 && status_code < 200) ||
+    status_code == 204 || status_code == 304;
+
+  std::shared_ptr<DataSource> pDataSource;
+  if (!no_body && pRequest->method() != "HEAD") {
+    pDataSource = std::make_shared<SharedBufferDataSource>(body);
+  }
+
+  std::shared_ptr<HttpResponse> pResponse = std::shared_ptr<HttpResponse>(
+    new HttpResponse(pRequest, status_code, getStatusDescription(status_code), pDataSource),
+    auto_deleter_background<HttpResponse>
+  );
+
+  ResponseHeaders& respHeaders = pResponse->headers();
+  respHeaders.insert(respHeaders.end(), headers.begin(), headers.end());
+  if (!no_body && !pDataSource) {
+    // Tell a HEAD request how long the body for a GET would be.
+    respHeaders.push_back(std::make_pair("Content-Length", toString(body->size())));
+  }
+
+  return pResponse;
+}
+
 std::shared_ptr<HttpResponse> RWebApplication::staticFileResponse(
   std::shared_ptr<HttpRequest> pRequest
 ) {
@@ -458,6 +742,14 @@ std::shared_ptr<HttpResponse> RWebApplication::staticFileResponse(
   std::pair<std::string, std::string> url_query = splitQueryString(pRequest->url());
   std::string url_path = doDecodeURI(url_query.first, true);
 
+  // Fixed responses take precedence over static paths. Requests that have a
+  // body are left to the R code, which can read it.
+  std::shared_ptr<const FixedResponse> pFixed =
+    _fixedResponseManager.get(pRequest->method(), url_path);
+  if (pFixed && !has_request_body(pRequest)) {
+    return shared_body_response(pRequest, pFixed->status, pFixed->headers, pFixed->body);
+  }
+
   std::experimental::optional<std::pair<StaticPath, std::string>> sp_pair =
     _staticPathManager.matchStaticPath(url_path);
 
@@ -504,6 +796,7 @@ std::shared_ptr<HttpResponse> RWebApplication::staticFileResponse(
       (url_path.length() >= 3 && url_path.substr(url_path.length()-3, 3) == "/..")
   ) {
     if (*sp.options.fallthrough) {
+      _serverStats.onStaticFile(STATIC_FALLTHROUGH);
       return std::shared_ptr<HttpResponse>();
     } else {
       return error_response(pRequest, 400);
@@ -528,8 +821,10 @@ std::shared_ptr<HttpResponse> RWebApplication::staticFileResponse(
   if (ret != FDS_OK) {
     if (ret == FDS_NOT_EXIST || ret == FDS_ISDIR) {
       if (*sp.options.fallthrough) {
+        _serverStats.onStaticFile(STATIC_FALLTHROUGH);
         return std::shared_ptr<HttpResponse>();
       } else {
+        _serverStats.onStaticFile(STATIC_MISS);
         return error_response(pRequest, 404);
       }
     } else {
@@ -623,9 +918,137 @@ std::shared_ptr<HttpResponse> RWebApplication::staticFileResponse(
     respHeaders.push_back(std::make_pair("Last-Modified", http_date_string(pDataSource->getMtime())));
   }
 
+  _serverStats.onStaticFile(STATIC_HIT);
+  return pResponse;
+}
+
+std::shared_ptr<HttpResponse> RWebApplication::cachedResponse(
+  std::shared_ptr<HttpRequest> pRequest
+) {
+  ASSERT_BACKGROUND_THREAD()
+  const std::string& method = pRequest->method();
+  if (!_responseCache.enabled() ||
+      (method != "GET" && method != "HEAD") ||
+      pRequest->hasHeader("Upgrade") ||
+      has_request_body(pRequest))
+  {
+    return std::shared_ptr<HttpResponse>();
+  }
+
+  std::shared_ptr<const CachedResponse> pCached =
+    _responseCache.get(method, pRequest->url(), pRequest->headers());
+  if (!pCached) {
+    return std::shared_ptr<HttpResponse>();
+  }
+
+  std::shared_ptr<HttpResponse> pResponse =
+    shared_body_response(pRequest, pCached->status, pCached->headers, pCached->body);
+  pResponse->headers().push_back(std::make_pair("Age", toString(pCached->age())));
   return pResponse;
 }
 
+// If the main thread is too far behind, a 503 response for a request that
+// would otherwise go to R.
+std::shared_ptr<HttpResponse> RWebApplication::shedResponse(
+  std::shared_ptr<HttpRequest> pRequest
+) {
+  ASSERT_BACKGROUND_THREAD()
+  if (!_loadShedder.enabled()) {
+    return std::shared_ptr<HttpResponse>();
+  }
+
+  std::pair<std::string, std::string> url_query = splitQueryString(pRequest->url());
+  if (!_loadShedder.shouldShed(doDecodeURI(url_query.first, true))) {
+    return std::shared_ptr<HttpResponse>();
+  }
+
+  std::shared_ptr<HttpResponse> pResponse = error_response(pRequest, 503);
+  pResponse->addHeader("Retry-After", _loadShedder.retryAfter());
+  return pResponse;
+}
+
+// Whether a request came through a proxy. A proxy on the same machine makes
+// every request look local, so the peer address can't be trusted then.
+static bool isProxied(const HttpRequest& request) {
+  return request.hasHeader("X-Forwarded-For") ||
+    request.hasHeader("Forwarded") ||
+    request.hasHeader("X-Real-IP");
+}
+
+// A page under the admin path, if there is one. Unless admin_remote is set,
+// requests from other machines, or through a proxy, get a 404.
+std::shared_ptr<HttpResponse> RWebApplication::adminResponse(
+  std::shared_ptr<HttpRequest> pRequest
+) {
+  ASSERT_BACKGROUND_THREAD()
+  const std::string& adminPath = _serverOptions.admin_path;
+  if (adminPath.empty()) {
+    return std::shared_ptr<HttpResponse>();
+  }
+
+  std::string url_path = doDecodeURI(splitQueryString(pRequest->url()).first, true);
+  if (url_path.compare(0, adminPath.size(), adminPath) != 0 ||
+      (url_path.size() > adminPath.size() && url_path[adminPath.size()] != '/'))
+  {
+    return std::shared_ptr<HttpResponse>();
+  }
+  if (!_serverOptions.admin_remote &&
+      (!pRequest->isLocal() || isProxied(*pRequest)))
+  {
+    return error_response(pRequest, 404);
+  }
+
+  const std::string& method = pRequest->method();
+  if (method != "GET" && method != "HEAD") {
+    return error_response(pRequest, 405);
+  }
+
+  std::string page = url_path.substr(adminPath.size());
+  std::string body;
+  ResponseHeaders headers;
+  if (page == "/metrics") {
+    body = admin_metrics(*pRequest->socket(), *this);
+    headers.push_back(std::make_pair("Content-Type", "text/plain; version=0.0.4; charset=utf-8"));
+  } else if (page == "/connections") {
+    body = admin_connections(*pRequest->socket());
+    headers.push_back(std::make_pair("Content-Type", "application/json"));
+  } else {
+    return error_response(pRequest, 404);
+  }
+  headers.push_back(std::make_pair("Cache-Control", "no-store"));
+
+  return shared_body_response(pRequest, 200, headers,
+    std::make_shared<const std::vector<uint8_t> >(body.begin(), body.end()));
+}
+
 StaticPathManager& RWebApplication::getStaticPathManager() {
   return _staticPathManager;
 }
+
+FixedResponseManager& RWebApplication::getFixedResponseManager() {
+  return _fixedResponseManager;
+}
+
+ResponseCache& RWebApplication::getResponseCache() {
+  return _responseCache;
+}
+
+RequestCoalescer& RWebApplication::getRequestCoalescer() {
+  return _requestCoalescer;
+}
+
+LoadShedder& RWebApplication::getLoadShedder() {
+  return _loadShedder;
+}
+
+RequestTimings& RWebApplication::getRequestTimings() {
+  return _requestTimings;
+}
+
+ServerStats& RWebApplication::getServerStats() {
+  return _serverStats;
+}
+
+const ServerOptions& RWebApplication::getServerOptions() const {
+  return _serverOptions;
+}
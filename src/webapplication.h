@@ -2,11 +2,20 @@
 #define WEBAPPLICATION_HPP
 
 #include <functional>
+#include <map>
 #include <uv.h>
 #include <Rcpp.h>
 #include "websockets.h"
 #include "thread.h"
 #include "staticpath.h"
+#include "fixedresponse.h"
+#include "responsecache.h"
+#include "coalescer.h"
+#include "loadshedder.h"
+#include "latency.h"
+#include "serverstats.h"
+#include "serveroptions.h"
+#include "wsmessagebatch.h"
 
 class HttpRequest;
 class HttpResponse;
@@ -27,11 +36,34 @@ public:
                            bool binary,
                            std::shared_ptr<std::vector<char> > data,
                            std::function<void(void)> error_callback) = 0;
+  virtual void onWSMessageBatch(std::shared_ptr<WSMessageBatch> batch) = 0;
+  virtual void onWSMessageChunk(std::shared_ptr<WebSocketConnection>,
+                                bool binary,
+                                std::shared_ptr<std::vector<char> > data,
+                                bool last,
+                                std::function<void(void)> error_callback) = 0;
+  virtual void onWSMessageFile(std::shared_ptr<WebSocketConnection>,
+                               bool binary,
+                               std::string path,
+                               std::function<void(void)> error_callback) = 0;
   virtual void onWSClose(std::shared_ptr<WebSocketConnection>) = 0;
 
   virtual std::shared_ptr<HttpResponse> staticFileResponse(
     std::shared_ptr<HttpRequest> pRequest) = 0;
+  virtual std::shared_ptr<HttpResponse> cachedResponse(
+    std::shared_ptr<HttpRequest> pRequest) = 0;
+  virtual std::shared_ptr<HttpResponse> shedResponse(
+    std::shared_ptr<HttpRequest> pRequest) = 0;
+  virtual std::shared_ptr<HttpResponse> adminResponse(
+    std::shared_ptr<HttpRequest> pRequest) = 0;
   virtual StaticPathManager& getStaticPathManager() = 0;
+  virtual FixedResponseManager& getFixedResponseManager() = 0;
+  virtual ResponseCache& getResponseCache() = 0;
+  virtual RequestCoalescer& getRequestCoalescer() = 0;
+  virtual LoadShedder& getLoadShedder() = 0;
+  virtual RequestTimings& getRequestTimings() = 0;
+  virtual ServerStats& getServerStats() = 0;
+  virtual const ServerOptions& getServerOptions() const = 0;
 };
 
 
@@ -42,9 +74,25 @@ private:
   Rcpp::Function _onRequest;
   Rcpp::Function _onWSOpen;
   Rcpp::Function _onWSMessage;
+  Rcpp::Function _onWSMessageBatch;
+  Rcpp::Function _onWSMessageStream;
   Rcpp::Function _onWSClose;
 
   StaticPathManager _staticPathManager;
+  FixedResponseManager _fixedResponseManager;
+  ServerOptions _serverOptions;
+  // Initialized from _serverOptions, so these must come after it.
+  ResponseCache _responseCache;
+  RequestCoalescer _requestCoalescer;
+  LoadShedder _loadShedder;
+  RequestTimings _requestTimings;
+  ServerStats _serverStats;
+
+  // The WebSocket connections that R knows about, keyed by connection ID.
+  // Each entry holds the one external pointer that R uses as the handle for
+  // that connection; messages and close events refer to it by ID. Only used
+  // on the main thread.
+  std::map<int, Rcpp::RObject> _wsConnections;
 
 public:
   RWebApplication(Rcpp::Function onHeaders,
@@ -52,9 +100,12 @@ public:
                   Rcpp::Function onRequest,
                   Rcpp::Function onWSOpen,
                   Rcpp::Function onWSMessage,
+                  Rcpp::Function onWSMessageBatch,
+                  Rcpp::Function onWSMessageStream,
                   Rcpp::Function onWSClose,
                   Rcpp::List     staticPaths,
-                  Rcpp::List     staticPathOptions);
+                  Rcpp::List     staticPathOptions,
+                  Rcpp::List     serverOptions);
 
   virtual ~RWebApplication() {
     ASSERT_MAIN_THREAD()
@@ -73,12 +124,44 @@ public:
                            bool binary,
                            std::shared_ptr<std::vector<char> > data,
                            std::function<void(void)> error_callback);
+  virtual void onWSMessageBatch(std::shared_ptr<WSMessageBatch> batch);
+  virtual void onWSMessageChunk(std::shared_ptr<WebSocketConnection> conn,
+                                bool binary,
+                                std::shared_ptr<std::vector<char> > data,
+                                bool last,
+                                std::function<void(void)> error_callback);
+  virtual void onWSMessageFile(std::shared_ptr<WebSocketConnection> conn,
+                               bool binary,
+                               std::string path,
+                               std::function<void(void)> error_callback);
   virtual void onWSClose(std::shared_ptr<WebSocketConnection> conn);
 
   virtual std::shared_ptr<HttpResponse> staticFileResponse(
     std::shared_ptr<HttpRequest> pRequest);
+  virtual std::shared_ptr<HttpResponse> cachedResponse(
+    std::shared_ptr<HttpRequest> pRequest);
+  virtual std::shared_ptr<HttpResponse> shedResponse(
+    std::shared_ptr<HttpRequest> pRequest);
+  virtual std::shared_ptr<HttpResponse> adminResponse(
+    std::shared_ptr<HttpRequest> pRequest);
   virtual StaticPathManager& getStaticPathManager();
+  virtual FixedResponseManager& getFixedResponseManager();
+  virtual ResponseCache& getResponseCache();
+  virtual RequestCoalescer& getRequestCoalescer();
+  virtual LoadShedder& getLoadShedder();
+  virtual RequestTimings& getRequestTimings();
+  virtual ServerStats& getServerStats();
+  virtual const ServerOptions& getServerOptions() const;
 };
 
 
+// Background thread. A response whose body is shared with other responses,
+// like a fixed or cached response. Responses to HEAD requests get the
+// Content-Length of the body, but not the body.
+std::shared_ptr<HttpResponse> shared_body_response(
+  std::shared_ptr<HttpRequest> pRequest,
+  int status_code,
+  const ResponseHeaders& headers,
+  std::shared_ptr<const std::vector<uint8_t> > body);
+
 #endif // WEBAPPLICATION_HPP
@@ -24,7 +24,9 @@ public:
                          ResponseHeaders* responseHeaders,
                          std::vector<uint8_t>* pResponse) const = 0;
 
-  void createFrameHeader(Opcode opcode, bool mask, size_t payloadSize,
+  // rsv1 should be true for the first frame of a message that was compressed
+  // with permessage-deflate.
+  void createFrameHeader(Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
                          int32_t maskingKey,
                          char pData[MAX_HEADER_BYTES], size_t* pLen) const;
 
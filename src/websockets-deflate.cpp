@@ -0,0 +1,319 @@
+#include "websockets-deflate.h"
+#include "utils.h"
+#include "thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <set>
+#include <sstream>
+
+// The four bytes that end every sync-flushed deflate block. These are
+// stripped from outgoing messages and re-appended to incoming ones.
+static const char deflateTail[4] = { 0x00, 0x00, (char)0xFF, (char)0xFF };
+
+static const size_t DEFLATE_CHUNK_SIZE = 16384;
+
+
+// Split a header value on a delimiter, ignoring delimiters that appear inside
+// a quoted-string.
+static std::vector<std::string> splitUnquoted(const std::string& value, char delim) {
+  std::vector<std::string> result;
+  std::string current;
+  bool inQuotes = false;
+  for (std::string::const_iterator it = value.begin(); it != value.end(); it++) {
+    if (*it == '"') {
+      inQuotes = !inQuotes;
+    }
+    if (*it == delim && !inQuotes) {
+      result.push_back(trim(current));
+      current.clear();
+    } else {
+      current.push_back(*it);
+    }
+  }
+  result.push_back(trim(current));
+  return result;
+}
+
+// Parse a window bits value; returns -1 if it isn't an integer in [8, 15].
+static int parseWindowBits(const std::string& value) {
+  if (value.size() < 1 || value.size() > 2)
+    return -1;
+  for (size_t i = 0; i < value.size(); i++) {
+    if (value[i] < '0' || value[i] > '9')
+      return -1;
+  }
+  int bits = atoi(value.c_str());
+  if (bits < 8 || bits > 15)
+    return -1;
+  return bits;
+}
+
+// Try to accept a single permessage-deflate offer. The offer is a list of
+// extension parameters (the extension name has already been removed).
+static bool acceptOffer(const std::vector<std::string>& offerParams,
+                        const ServerOptions& options,
+                        WSDeflateParams* pParams)
+{
+  WSDeflateParams params;
+  params.server_no_context_takeover = options.ws_deflate_server_no_context_takeover;
+  params.client_no_context_takeover = options.ws_deflate_client_no_context_takeover;
+  params.server_max_window_bits = options.ws_deflate_window_bits;
+
+  int offeredServerBits = -1;
+  std::set<std::string> seen;
+
+  for (std::vector<std::string>::const_iterator it = offerParams.begin();
+       it != offerParams.end();
+       it++)
+  {
+    std::string name = *it;
+    std::string value;
+    bool hasValue = false;
+
+    size_t eq = it->find('=');
+    if (eq != std::string::npos) {
+      name = trim(it->substr(0, eq));
+      value = trim(it->substr(eq + 1));
+      hasValue = true;
+      if (value.size() >= 2 && value[0] == '"' && value[value.size() - 1] == '"') {
+        value = value.substr(1, value.size() - 2);
+      }
+    }
+
+    // Each parameter may appear at most once.
+    if (!seen.insert(name).second)
+      return false;
+
+    if (name == "server_no_context_takeover") {
+      if (hasValue) return false;
+      params.server_no_context_takeover = true;
+
+    } else if (name == "client_no_context_takeover") {
+      if (hasValue) return false;
+      params.client_no_context_takeover = true;
+
+    } else if (name == "server_max_window_bits") {
+      if (!hasValue) return false;
+      offeredServerBits = parseWindowBits(value);
+      if (offeredServerBits == -1) return false;
+
+    } else if (name == "client_max_window_bits") {
+      // The client is telling us that it supports limiting its own window
+      // size. We always inflate with the largest window, so there's nothing
+      // to ask for, and the parameter doesn't need to be echoed.
+      if (hasValue && parseWindowBits(value) == -1) return false;
+
+    } else {
+      return false;
+    }
+  }
+
+  if (offeredServerBits != -1) {
+    if (offeredServerBits < params.server_max_window_bits)
+      params.server_max_window_bits = offeredServerBits;
+    // zlib can't produce raw deflate streams with an 8-bit window.
+    if (params.server_max_window_bits < 9)
+      return false;
+    params.send_server_max_window_bits = true;
+  } else {
+    params.send_server_max_window_bits = params.server_max_window_bits < 15;
+  }
+
+  *pParams = params;
+  return true;
+}
+
+bool negotiateWSDeflate(const RequestHeaders& requestHeaders,
+                        const ServerOptions& options,
+                        WSDeflateParams* pParams)
+{
+  ASSERT_BACKGROUND_THREAD()
+  if (!options.ws_deflate)
+    return false;
+
+  RequestHeaders::const_iterator header = requestHeaders.find("sec-websocket-extensions");
+  if (header == requestHeaders.end())
+    return false;
+
+  // Offers are listed in order of the client's preference.
+  std::vector<std::string> offers = splitUnquoted(header->second, ',');
+  for (std::vector<std::string>::const_iterator it = offers.begin();
+       it != offers.end();
+       it++)
+  {
+    std::vector<std::string> offerParams = splitUnquoted(*it, ';');
+    if (offerParams.empty() || offerParams[0] != "permessage-deflate")
+      continue;
+
+    offerParams.erase(offerParams.begin());
+    if (acceptOffer(offerParams, options, pParams)) {
+      if (log_enabled(LOG_DEBUG)) {
+        debug_log("Accepted permessage-deflate offer: " + *it, LOG_DEBUG);
+      }
+      return true;
+    }
+    if (log_enabled(LOG_DEBUG)) {
+      debug_log("Declined permessage-deflate offer: " + *it, LOG_DEBUG);
+    }
+  }
+
+  return false;
+}
+
+std::string WSDeflateParams::responseHeader() const {
+  std::ostringstream header;
+  header << "permessage-deflate";
+  if (server_no_context_takeover)
+    header << "; server_no_context_takeover";
+  if (client_no_context_takeover)
+    header << "; client_no_context_takeover";
+  if (send_server_max_window_bits)
+    header << "; server_max_window_bits=" << server_max_window_bits;
+  return header.str();
+}
+
+
+WSPerMessageDeflate::WSPerMessageDeflate(const WSDeflateParams& params, int memLevel) :
+  _params(params),
+  _memLevel(memLevel),
+  _deflateInitialized(false),
+  _inflateInitialized(false)
+{
+  memset(&_deflateStrm, 0, sizeof(z_stream));
+  memset(&_inflateStrm, 0, sizeof(z_stream));
+}
+
+WSPerMessageDeflate::~WSPerMessageDeflate() {
+  // ignore errors on destruction
+  if (_deflateInitialized)
+    deflateEnd(&_deflateStrm);
+  if (_inflateInitialized)
+    inflateEnd(&_inflateStrm);
+}
+
+bool WSPerMessageDeflate::compress(const char* pData, size_t len,
+                                   std::vector<char>* pOut)
+{
+  ASSERT_BACKGROUND_THREAD()
+  if (!_deflateInitialized) {
+    // Negative window bits tell zlib to produce a raw deflate stream, without
+    // the zlib header and trailer.
+    int res = deflateInit2(&_deflateStrm, 6, Z_DEFLATED,
+                           -_params.server_max_window_bits, _memLevel,
+                           Z_DEFAULT_STRATEGY);
+    if (res != Z_OK) {
+      debug_log("permessage-deflate: deflateInit2 failed", LOG_ERROR);
+      return false;
+    }
+    _deflateInitialized = true;
+  }
+
+  pOut->clear();
+  _deflateStrm.next_in = (Bytef*)pData;
+  _deflateStrm.avail_in = len;
+
+  // With Z_SYNC_FLUSH, deflate is done once it leaves some of the output
+  // buffer unused.
+  do {
+    size_t offset = pOut->size();
+    pOut->resize(offset + DEFLATE_CHUNK_SIZE);
+    _deflateStrm.next_out = (Bytef*)safe_vec_addr(*pOut) + offset;
+    _deflateStrm.avail_out = DEFLATE_CHUNK_SIZE;
+
+    int res = deflate(&_deflateStrm, Z_SYNC_FLUSH);
+    if (res != Z_OK && res != Z_BUF_ERROR) {
+      debug_log("permessage-deflate: deflate failed", LOG_ERROR);
+      return false;
+    }
+    pOut->resize(pOut->size() - _deflateStrm.avail_out);
+  } while (_deflateStrm.avail_out == 0);
+
+  if (pOut->size() >= 4 &&
+      memcmp(safe_vec_addr(*pOut) + pOut->size() - 4, deflateTail, 4) == 0)
+  {
+    pOut->resize(pOut->size() - 4);
+  }
+
+  if (_params.server_no_context_takeover)
+    deflateReset(&_deflateStrm);
+
+  return true;
+}
+
+WSInflateResult WSPerMessageDeflate::decompress(const char* pData, size_t len,
+                                                size_t maxSize,
+                                                std::vector<char>* pOut)
+{
+  ASSERT_BACKGROUND_THREAD()
+  if (!_inflateInitialized) {
+    // We never restrict client_max_window_bits, so the client may use a
+    // window of up to 15 bits.
+    int res = inflateInit2(&_inflateStrm, -15);
+    if (res != Z_OK) {
+      debug_log("permessage-deflate: inflateInit2 failed", LOG_ERROR);
+      return WS_INFLATE_INVALID;
+    }
+    _inflateInitialized = true;
+  }
+
+  pOut->clear();
+
+  // Inflate the payload, followed by the tail that the sender removed.
+  const char* inputs[2] = { pData, deflateTail };
+  size_t inputLens[2] = { len, sizeof(deflateTail) };
+  // True if the payload ended with the end of a deflate stream. Then there's
+  // no tail to add: it would be read as the start of a new stream, and the
+  // next message would be inflated as part of it.
+  bool streamEnded = false;
+
+  for (int i = 0; i < 2 && !(i == 1 && streamEnded); i++) {
+    _inflateStrm.next_in = (Bytef*)inputs[i];
+    _inflateStrm.avail_in = inputLens[i];
+
+    // Keep going while there's input, or while the last call filled the
+    // output buffer (in which case there may be more output pending).
+    do {
+      size_t offset = pOut->size();
+      pOut->resize(offset + DEFLATE_CHUNK_SIZE);
+      _inflateStrm.next_out = (Bytef*)safe_vec_addr(*pOut) + offset;
+      _inflateStrm.avail_out = DEFLATE_CHUNK_SIZE;
+
+      uInt availIn = _inflateStrm.avail_in;
+      int res = inflate(&_inflateStrm, Z_SYNC_FLUSH);
+      pOut->resize(pOut->size() - _inflateStrm.avail_out);
+      if (_inflateStrm.avail_in != availIn) {
+        streamEnded = false;
+      }
+
+      if (res == Z_STREAM_END) {
+        // The sender finished the deflate stream (BFINAL was set). Anything
+        // after it starts a new stream.
+        inflateReset(&_inflateStrm);
+        streamEnded = true;
+      } else if (res != Z_OK && res != Z_BUF_ERROR) {
+        debug_log("permessage-deflate: inflate failed", LOG_INFO);
+        inflateReset(&_inflateStrm);
+        return WS_INFLATE_INVALID;
+      } else if (res == Z_BUF_ERROR && _inflateStrm.avail_in > 0 &&
+                 _inflateStrm.avail_out > 0) {
+        // No progress was possible, even though there was input and room
+        // for output.
+        inflateReset(&_inflateStrm);
+        return WS_INFLATE_INVALID;
+      }
+
+      // Stop early, rather than inflating a huge message only to reject it.
+      if (pOut->size() > maxSize) {
+        inflateReset(&_inflateStrm);
+        return WS_INFLATE_TOO_BIG;
+      }
+    } while (_inflateStrm.avail_in > 0 || _inflateStrm.avail_out == 0);
+  }
+
+  if (_params.client_no_context_takeover)
+    inflateReset(&_inflateStrm);
+
+  return WS_INFLATE_OK;
+}
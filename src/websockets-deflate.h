@@ -0,0 +1,84 @@
+#ifndef WEBSOCKETS_DEFLATE_H
+#define WEBSOCKETS_DEFLATE_H
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "serveroptions.h"
+
+// The parameters of a permessage-deflate extension (RFC 7692) that was
+// agreed upon during the opening handshake.
+class WSDeflateParams {
+public:
+  bool server_no_context_takeover;
+  bool client_no_context_takeover;
+  // Window size (as a base-2 log) used when compressing server messages.
+  int server_max_window_bits;
+  // True if server_max_window_bits must be echoed in the response, because
+  // it is smaller than the 15-bit default.
+  bool send_server_max_window_bits;
+
+  WSDeflateParams() :
+    server_no_context_takeover(false),
+    client_no_context_takeover(false),
+    server_max_window_bits(15),
+    send_server_max_window_bits(false)
+  { }
+
+  // The value of the Sec-WebSocket-Extensions response header.
+  std::string responseHeader() const;
+};
+
+// Look through the Sec-WebSocket-Extensions request header for a
+// permessage-deflate offer that can be accepted with the given options. If
+// one is found, the agreed parameters are stored in pParams and true is
+// returned. Offers with unknown or malformed parameters are declined, as
+// required by RFC 7692 Section 5.
+bool negotiateWSDeflate(const RequestHeaders& requestHeaders,
+                        const ServerOptions& options,
+                        WSDeflateParams* pParams);
+
+
+enum WSInflateResult {
+  WS_INFLATE_OK,
+  // The data is not a valid deflate stream
+  WS_INFLATE_INVALID,
+  // The decompressed message would be larger than the limit
+  WS_INFLATE_TOO_BIG
+};
+
+// Compresses and decompresses the payloads of messages on a single
+// WebSocket connection. The zlib streams are created the first time they are
+// used, so a connection that never sends (or never receives) a compressed
+// message doesn't pay for the memory.
+class WSPerMessageDeflate : NoCopy {
+  WSDeflateParams _params;
+  int _memLevel;
+  z_stream _deflateStrm;
+  z_stream _inflateStrm;
+  bool _deflateInitialized;
+  bool _inflateInitialized;
+
+public:
+  WSPerMessageDeflate(const WSDeflateParams& params, int memLevel);
+  ~WSPerMessageDeflate();
+
+  // Compress a complete message payload into pOut. The trailing
+  // 0x00 0x00 0xFF 0xFF of the sync flush is removed, as required by
+  // RFC 7692 Section 7.2.1. Returns false on failure.
+  bool compress(const char* pData, size_t len, std::vector<char>* pOut);
+  // Decompress a complete message payload into pOut. Decompression stops if
+  // the output grows beyond maxSize bytes.
+  WSInflateResult decompress(const char* pData, size_t len, size_t maxSize,
+                             std::vector<char>* pOut);
+
+  const WSDeflateParams& params() const {
+    return _params;
+  }
+};
+
+#endif // WEBSOCKETS_DEFLATE_H
@@ -11,10 +11,12 @@ void WSHixie76Parser::handshake(const std::string& url,
 }
 
 void WSHixie76Parser::createFrameHeaderFooter(
-                       Opcode opcode, bool mask, size_t payloadSize,
+                       Opcode opcode, bool mask, bool /* rsv1 */, size_t payloadSize,
                        int32_t maskingKey,
                        char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
                        char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen) const {
+  // Hixie-76 frames have no header bits to set. permessage-deflate is never
+  // negotiated for these connections, so nothing is sent compressed.
   pHeaderData[0] = 0;
   *pHeaderLen = 1;
 
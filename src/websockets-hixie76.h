@@ -41,7 +41,7 @@ public:
                  std::vector<uint8_t>* pResponse) const;
 
   void createFrameHeaderFooter(
-                 Opcode opcode, bool mask, size_t payloadSize,
+                 Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
                  int32_t maskingKey,
                  char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
                  char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
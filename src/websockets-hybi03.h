@@ -18,7 +18,7 @@ public:
                  ResponseHeaders* pResponseHeaders,
                  std::vector<uint8_t>* pResponse) const;
 
-  void createFrameHeader(Opcode opcode, bool mask, size_t payloadSize,
+  void createFrameHeader(Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
                          int32_t maskingKey,
                          char pData[MAX_HEADER_BYTES], size_t* pLen) const;
 
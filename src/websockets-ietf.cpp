@@ -6,18 +6,19 @@
 #include "base64/base64.hpp"
 
 bool WebSocketProto_IETF::canHandle(const RequestHeaders& requestHeaders,
-                                    const char* pData, size_t len) const {
+                                    const char* /* pData */,
+                                    size_t /* len */) const {
 
   return requestHeaders.find("upgrade") != requestHeaders.end() &&
          strcasecmp(requestHeaders.at("upgrade").c_str(), "websocket") == 0 &&
          requestHeaders.find("sec-websocket-key") != requestHeaders.end();
 }
 
-void WebSocketProto_IETF::handshake(const std::string& url,
+void WebSocketProto_IETF::handshake(const std::string& /* url */,
                                     const RequestHeaders& requestHeaders,
-                                    char** ppData, size_t* pLen,
+                                    char** /* ppData */, size_t* /* pLen */,
                                     ResponseHeaders* pResponseHeaders,
-                                    std::vector<uint8_t>* pResponse) const {
+                                    std::vector<uint8_t>* /* pResponse */) const {
 
   std::string key = requestHeaders.at("sec-websocket-key");
 
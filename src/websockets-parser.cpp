@@ -0,0 +1,204 @@
+#include "websockets-parser.h"
+#include "thread.h"
+#include <assert.h>
+
+template <typename T>
+T min(T a, T b) {
+  return (a > b) ? b : a;
+}
+
+bool WSHyBiFrameHeader::isHeaderComplete() const {
+  if (_data.size() < 2)
+    return false;
+
+  return _data.size() >= (size_t)headerLength();
+}
+
+WSFrameHeaderInfo WSHyBiFrameHeader::info() const {
+  WSFrameHeaderInfo inf;
+  inf.fin = fin();
+  inf.rsv1 = rsv1();
+  inf.opcode = opcode();
+  inf.hasLength = true;
+  inf.masked = masked();
+  if (masked()) {
+    maskingKey(inf.maskingKey);
+  }
+  inf.payloadLength = payloadLength();
+  return inf;
+}
+
+bool WSHyBiFrameHeader::fin() const {
+  return _pProto->isFin(read(0, 1));
+}
+bool WSHyBiFrameHeader::rsv1() const {
+  return read(1, 1) != 0;
+}
+Opcode WSHyBiFrameHeader::opcode() const {
+  uint8_t oc = read(4, 4);
+  return _pProto->decodeOpcode(oc);
+}
+bool WSHyBiFrameHeader::masked() const {
+  return read(8, 1) != 0;
+}
+uint64_t WSHyBiFrameHeader::payloadLength() const {
+  uint8_t pl = read(9, 7);
+  switch (pl) {
+    case 126:
+      return read64(16, 16);
+    case 127:
+      return read64(16, 64);
+    default:
+      return pl;
+  }
+}
+void WSHyBiFrameHeader::maskingKey(uint8_t key[4]) const {
+  if (!masked())
+    memset(key, 0, 4);
+  else {
+    key[0] = read(9 + payloadLengthLength(), 8);
+    key[1] = read(9 + payloadLengthLength() + 8, 8);
+    key[2] = read(9 + payloadLengthLength() + 16, 8);
+    key[3] = read(9 + payloadLengthLength() + 24, 8);
+  }
+}
+size_t WSHyBiFrameHeader::headerLength() const {
+  return (9 + payloadLengthLength() + maskingKeyLength()) / 8;
+}
+uint8_t WSHyBiFrameHeader::read(size_t bitOffset, size_t bitWidth) const {
+  size_t byteOffset = bitOffset / 8;
+  bitOffset = bitOffset % 8;
+
+  assert((bitOffset + bitWidth) <= 8);
+  assert(byteOffset < _data.size());
+
+  uint8_t mask = 0xFF;
+  mask <<= (8 - bitWidth);
+  mask >>= bitOffset;
+
+  char byte = _data[byteOffset];
+  return (byte & mask) >> (8 - bitWidth - bitOffset);
+}
+uint64_t WSHyBiFrameHeader::read64(size_t bitOffset, size_t bitWidth) const {
+  assert((bitOffset % 8) == 0);
+  assert((bitWidth % 8) == 0);
+
+  size_t byteOffset = bitOffset / 8;
+  size_t byteWidth = bitWidth / 8;
+  assert(byteOffset + byteWidth <= _data.size());
+
+  uint64_t result = 0;
+
+  for (size_t i = 0; i < byteWidth; i++) {
+    result <<= 8;
+    result += (uint64_t)(unsigned char)_data[byteOffset + i];
+  }
+
+  return result;
+}
+uint8_t WSHyBiFrameHeader::payloadLengthLength() const {
+  uint8_t pll = read(9, 7);
+  switch (pll) {
+    case 126:
+      return 7 + 16;
+    case 127:
+      return 7 + 64;
+    default:
+      return 7;
+  }
+}
+uint8_t WSHyBiFrameHeader::maskingKeyLength() const {
+  return masked() ? 32 : 0;
+}
+
+void WSHyBiParser::handshake(const std::string& url,
+                             const RequestHeaders& requestHeaders,
+                             char** ppData, size_t* pLen,
+                             ResponseHeaders* pResponseHeaders,
+                             std::vector<uint8_t>* pResponse) const {
+  ASSERT_BACKGROUND_THREAD()
+  _pProto->handshake(url, requestHeaders, ppData, pLen, pResponseHeaders,
+                     pResponse);
+}
+
+void WSHyBiParser::createFrameHeaderFooter(
+                     Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
+                     int32_t maskingKey,
+                     char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
+                     char /* pFooterData */[MAX_FOOTER_BYTES],
+                     size_t* /* pFooterLen */
+                     ) const {
+  _pProto->createFrameHeader(opcode, mask, rsv1, payloadSize, maskingKey,
+                             pHeaderData, pHeaderLen);
+}
+
+void WSHyBiParser::read(const char* data, size_t len) {
+  ASSERT_BACKGROUND_THREAD()
+  bool recur = false;
+  while (len > 0 || recur) {
+    // crude check for underflow
+    assert(len < 1000000000000000000);
+
+    switch (_state) {
+      case InHeader: {
+        // The _header buffer accumulates header data until
+        // the complete header is read. It's possible/likely it also
+        // holds part of the payload.
+        size_t startingSize = _headerSize;
+        size_t toCopy = min(len, MAX_HEADER_BYTES - startingSize);
+        memcpy(_header + startingSize, data, toCopy);
+        _headerSize += toCopy;
+
+        WSHyBiFrameHeader frame(_pProto, _header, _headerSize);
+
+        if (frame.isHeaderComplete()) {
+          _pCallbacks->onHeaderComplete(frame.info());
+
+          size_t payloadOffset = frame.headerLength() - startingSize;
+          _bytesLeft = frame.payloadLength();
+
+          // Header was consumed, but no payload
+          if (_bytesLeft == 0) recur = true;
+
+          _state = InPayload;
+          _headerSize = 0;
+
+          data += payloadOffset;
+          len -= payloadOffset;
+        }
+        else {
+          // All of the data was consumed, but no header
+          data += len;
+          len = 0;
+        }
+        break;
+      }
+      case InPayload: {
+        recur = false;
+
+        size_t bytesToConsume = min((uint64_t)len, _bytesLeft);
+        _bytesLeft -= bytesToConsume;
+        _pCallbacks->onPayload(data, bytesToConsume);
+
+        data += bytesToConsume;
+        len -= bytesToConsume;
+
+        if (_bytesLeft == 0) {
+          _pCallbacks->onFrameComplete();
+
+          _state = InHeader;
+        }
+        break;
+      }
+      default:
+        assert(false);
+        break;
+    }
+  }
+}
+
+void applyMask(char* data, size_t len, const uint8_t maskingKey[4], uint64_t offset) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = data[i] ^ maskingKey[(offset + i) % 4];
+  }
+}
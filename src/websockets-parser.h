@@ -0,0 +1,154 @@
+#ifndef WEBSOCKETS_PARSER_HPP
+#define WEBSOCKETS_PARSER_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "websockets-base.h"
+
+class WSFrameHeaderInfo {
+public:
+  bool fin;
+  // RSV1 marks the first frame of a compressed message when the
+  // permessage-deflate extension is in use.
+  bool rsv1;
+  Opcode opcode;
+  bool masked;
+  uint8_t maskingKey[4];
+  bool hasLength;
+  uint64_t payloadLength;
+
+  WSFrameHeaderInfo() :
+    fin(false), rsv1(false), opcode(Reserved), masked(false), maskingKey(),
+    hasLength(false), payloadLength(0)
+  { }
+};
+
+/* Interprets the bytes that make up a WebSocket frame header.
+ * See RFC 6455 Section 5 (especially 5.2) for details on the
+ * wire format.
+ */
+class WSHyBiFrameHeader {
+  std::vector<char> _data;
+  WebSocketProto* _pProto;
+
+public:
+  WSHyBiFrameHeader() : _data(MAX_HEADER_BYTES), _pProto(NULL) {
+  }
+
+  // The data is copied (up to 14 bytes worth)
+  WSHyBiFrameHeader(WebSocketProto* pProto, const char* data, size_t len)
+    : _data(data, data + (std::min(MAX_HEADER_BYTES, len))), _pProto(pProto) {
+  }
+
+  virtual ~WSHyBiFrameHeader() {
+  }
+
+  // IMPORTANT: Don't attempt to call any of the other methods
+  // until isHeaderComplete is true!!
+  bool isHeaderComplete() const;
+  bool isPayloadComplete() const;
+
+  WSFrameHeaderInfo info() const;
+  uint64_t payloadLength() const;
+  size_t headerLength() const;
+
+private:
+
+  bool fin() const;
+  bool rsv1() const;
+  Opcode opcode() const;
+  bool masked() const;
+  void maskingKey(uint8_t key[4]) const;
+
+  // Read part of a byte, and interpret the bits as an unsigned number.
+  // The bitOffset is starting from the most significant bit.
+  // IMPORTANT: (bitOffset % 8) + bitWidth MUST be 8 or less!
+  // In other words, the bits you request must not span multiple bytes.
+  uint8_t read(size_t bitOffset, size_t bitWidth) const;
+  // Read bytes, an interpret them as a big endian number.
+  // IMPORTANT: bitOffset and bitWidth MUST be multiples of 8!
+  // IMPORTANT: bitWidth MUST be 64 or less!
+  uint64_t read64(size_t bitOffset, size_t bitWidth) const;
+  uint8_t payloadLengthLength() const;
+  uint8_t maskingKeyLength() const;
+};
+
+class WSParserCallbacks {
+public:
+  virtual void onHeaderComplete(const WSFrameHeaderInfo& header) = 0;
+  // The data is copied
+  virtual void onPayload(const char* data, size_t len) = 0;
+  virtual void onFrameComplete() = 0;
+};
+
+class WSParser {
+public:
+  virtual ~WSParser() {}
+
+  // Populate response headers with the appropriate values. This call
+  // must not fail, but it will not be called unless canHandle returned
+  // true previously, so any validation should be done in canHandle.
+  virtual void handshake(const std::string& url,
+                         const RequestHeaders& requestHeaders,
+                         char** ppData, size_t* pLen,
+                         ResponseHeaders* responseHeaders,
+                         std::vector<uint8_t>* pResponse) const = 0;
+
+  virtual void createFrameHeaderFooter(
+                         Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
+                         int32_t maskingKey,
+                         char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
+                         char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
+                         ) const = 0;
+
+  virtual void read(const char* data, size_t len) = 0;
+};
+
+class WSHyBiParser : public WSParser {
+  WSParserCallbacks* _pCallbacks;
+  WebSocketProto* _pProto;
+  WSParseState _state;
+  // Accumulates a frame header that arrives in more than one read.
+  char _header[MAX_HEADER_BYTES];
+  size_t _headerSize;
+  uint64_t _bytesLeft;
+
+public:
+  WSHyBiParser(WSParserCallbacks* callbacks, WebSocketProto* pProto)
+      : _pCallbacks(callbacks), _pProto(pProto), _state(InHeader),
+        _headerSize(0) {
+  }
+  virtual ~WSHyBiParser() {
+    try {
+      delete _pProto;
+    } catch(...) {}
+  }
+
+  void handshake(const std::string& url,
+                 const RequestHeaders& requestHeaders,
+                 char** ppData, size_t* pLen,
+                 ResponseHeaders* responseHeaders,
+                 std::vector<uint8_t>* pResponse) const;
+
+  void createFrameHeaderFooter(
+                         Opcode opcode, bool mask, bool rsv1, size_t payloadSize,
+                         int32_t maskingKey,
+                         char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
+                         char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
+                         ) const;
+
+  void read(const char* data, size_t len);
+};
+
+// XOR a piece of a frame's payload with the frame's masking key, in place.
+// `offset` is how far into the payload `data` starts. Masking and unmasking
+// are the same operation.
+void applyMask(char* data, size_t len, const uint8_t maskingKey[4], uint64_t offset);
+
+#endif // WEBSOCKETS_PARSER_HPP
@@ -1,11 +1,16 @@
 #include "websockets.h"
 #include "utils.h"
 #include "thread.h"
+#include "trace.h"
+#include "fs.h"
 #include <assert.h>
+#include <string.h>
 
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <random>
 #include <memory>
 
 #include "sha1/sha1.h"
@@ -15,11 +20,6 @@
 #include "websockets-hybi03.h"
 #include "websockets-hixie76.h"
 
-template <typename T>
-T min(T a, T b) {
-  return (a > b) ? b : a;
-}
-
 std::string dumpbin(const char* data, size_t len) {
   std::string output;
   for (size_t i = 0; i < len; i++) {
@@ -35,195 +35,59 @@ std::string dumpbin(const char* data, size_t len) {
   return output;
 }
 
-bool WSHyBiFrameHeader::isHeaderComplete() const {
-  if (_data.size() < 2)
-    return false;
-
-  return _data.size() >= (size_t)headerLength();
-}
-
-WSFrameHeaderInfo WSHyBiFrameHeader::info() const {
-  WSFrameHeaderInfo inf;
-  inf.fin = fin();
-  inf.opcode = opcode();
-  inf.hasLength = true;
-  inf.masked = masked();
-  if (masked()) {
-    inf.maskingKey.resize(4);
-    maskingKey(safe_vec_addr(inf.maskingKey));
-  }
-  inf.payloadLength = payloadLength();
-  return inf;
-}
-
-bool WSHyBiFrameHeader::fin() const {
-  return _pProto->isFin(read(0, 1));
-}
-Opcode WSHyBiFrameHeader::opcode() const {
-  uint8_t oc = read(4, 4);
-  return _pProto->decodeOpcode(oc);
-}
-bool WSHyBiFrameHeader::masked() const {
-  return read(8, 1) != 0;
-}
-uint64_t WSHyBiFrameHeader::payloadLength() const {
-  uint8_t pl = read(9, 7);
-  switch (pl) {
-    case 126:
-      return read64(16, 16);
-    case 127:
-      return read64(16, 64);
-    default:
-      return pl;
-  }
-}
-void WSHyBiFrameHeader::maskingKey(uint8_t key[4]) const {
-  if (!masked())
-    memset(key, 0, 4);
-  else {
-    key[0] = read(9 + payloadLengthLength(), 8);
-    key[1] = read(9 + payloadLengthLength() + 8, 8);
-    key[2] = read(9 + payloadLengthLength() + 16, 8);
-    key[3] = read(9 + payloadLengthLength() + 24, 8);
-  }
-}
-size_t WSHyBiFrameHeader::headerLength() const {
-  return (9 + payloadLengthLength() + maskingKeyLength()) / 8;
-}
-uint8_t WSHyBiFrameHeader::read(size_t bitOffset, size_t bitWidth) const {
-  size_t byteOffset = bitOffset / 8;
-  bitOffset = bitOffset % 8;
-
-  assert((bitOffset + bitWidth) <= 8);
-  assert(byteOffset < _data.size());
-
-  uint8_t mask = 0xFF;
-  mask <<= (8 - bitWidth);
-  mask >>= bitOffset;
-
-  char byte = _data[byteOffset];
-  return (byte & mask) >> (8 - bitWidth - bitOffset);
-}
-uint64_t WSHyBiFrameHeader::read64(size_t bitOffset, size_t bitWidth) const {
-  assert((bitOffset % 8) == 0);
-  assert((bitWidth % 8) == 0);
-
-  size_t byteOffset = bitOffset / 8;
-  size_t byteWidth = bitWidth / 8;
-  assert(byteOffset + byteWidth <= _data.size());
-
-  uint64_t result = 0;
-
-  for (size_t i = 0; i < byteWidth; i++) {
-    result <<= 8;
-    result += (uint64_t)(unsigned char)_data[byteOffset + i];
-  }
-
-  return result;
-}
-uint8_t WSHyBiFrameHeader::payloadLengthLength() const {
-  uint8_t pll = read(9, 7);
-  switch (pll) {
-    case 126:
-      return 7 + 16;
-    case 127:
-      return 7 + 64;
-    default:
-      return 7;
+// Randomly shorten or lengthen a ping interval by up to `jitter` times its
+// length, so that pings on connections that were opened at the same time
+// don't stay lined up.
+static uint64_t jitterInterval(uint64_t intervalMs, double jitter) {
+  ASSERT_BACKGROUND_THREAD()
+  if (jitter <= 0) {
+    return intervalMs;
   }
-}
-uint8_t WSHyBiFrameHeader::maskingKeyLength() const {
-  return masked() ? 32 : 0;
+  static std::minstd_rand rng(static_cast<unsigned int>(uv_hrtime()));
+  std::uniform_real_distribution<double> dist(-jitter, jitter);
+  double ms = intervalMs * (1 + dist(rng));
+  return ms < 1 ? 1 : static_cast<uint64_t>(ms);
 }
 
-void WSHyBiParser::handshake(const std::string& url,
-                             const RequestHeaders& requestHeaders,
-                             char** ppData, size_t* pLen,
-                             ResponseHeaders* pResponseHeaders,
-                             std::vector<uint8_t>* pResponse) const {
+void WebSocketConnection::startPingTimer() {
   ASSERT_BACKGROUND_THREAD()
-  _pProto->handshake(url, requestHeaders, ppData, pLen, pResponseHeaders,
-                     pResponse);
-}
+  if (_pOptions->ws_ping_interval_ms == 0) {
+    return;
+  }
 
-void WSHyBiParser::createFrameHeaderFooter(
-                     Opcode opcode, bool mask, size_t payloadSize,
-                     int32_t maskingKey,
-                     char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
-                     char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
-                     ) const {
-  _pProto->createFrameHeader(opcode, mask, payloadSize, maskingKey,
-                             pHeaderData, pHeaderLen);
+  TimerWheel::forLoop(_pLoop)->start(
+    &_pingTimer,
+    jitterInterval(_pOptions->ws_ping_interval_ms, _pOptions->ws_ping_jitter)
+  );
 }
 
-void WSHyBiParser::read(const char* data, size_t len) {
+void WebSocketConnection::onPingTimer() {
   ASSERT_BACKGROUND_THREAD()
-  bool recur = false;
-  while (len > 0 || recur) {
-    // crude check for underflow
-    assert(len < 1000000000000000000);
-
-    switch (_state) {
-      case InHeader: {
-        // The _header vector<char> accumulates header data until
-        // the complete header is read. It's possible/likely it also
-        // holds part of the payload.
-        size_t startingSize = _header.size();
-        std::copy(data, data + min(len, MAX_HEADER_BYTES - startingSize),
-          std::back_inserter(_header));
-
-        WSHyBiFrameHeader frame(_pProto, safe_vec_addr(_header), _header.size());
-
-        if (frame.isHeaderComplete()) {
-          _pCallbacks->onHeaderComplete(frame.info());
-
-          size_t payloadOffset = frame.headerLength() - startingSize;
-          _bytesLeft = frame.payloadLength();
-
-          // Header was consumed, but no payload
-          if (_bytesLeft == 0) recur = true;
-
-          _state = InPayload;
-          _header.clear();
-
-          data += payloadOffset;
-          len -= payloadOffset;
-        }
-        else {
-          // All of the data was consumed, but no header
-          data += len;
-          len = 0;
-        }
-        break;
-      }
-      case InPayload: {
-        recur = false;
-
-        size_t bytesToConsume = min((uint64_t)len, _bytesLeft);
-        _bytesLeft -= bytesToConsume;
-        _pCallbacks->onPayload(data, bytesToConsume);
-
-        data += bytesToConsume;
-        len -= bytesToConsume;
-
-        if (_bytesLeft == 0) {
-          _pCallbacks->onFrameComplete();
+  if (_connState == WS_CLOSED) return;
 
-          _state = InHeader;
-        }
-        break;
-      }
-      default:
-        assert(false);
-        break;
+  if (_trackPongs && _pingOutstanding) {
+    _missedPongs++;
+    if (_pOptions->ws_ping_max_missed > 0 &&
+        _missedPongs >= _pOptions->ws_ping_max_missed)
+    {
+      failWS(1001, "Ping timeout");
+      return;
     }
   }
+
+  sendPing();
+  startPingTimer();
 }
 
-void WebSocketConnection::startPingTimer() {
+// Connection IDs are positive R integers. They are handed out on the
+// background thread, which all servers share, so a plain counter is enough.
+int WebSocketConnection::nextId() {
   ASSERT_BACKGROUND_THREAD()
-
-  uv_timer_start(_pPingTimer, pingTimerCallback, 20000, 20000);
+  static int lastId = 0;
+  if (lastId == std::numeric_limits<int>::max()) {
+    lastId = 0;
+  }
+  return ++lastId;
 }
 
 bool WebSocketConnection::accept(const RequestHeaders& requestHeaders,
@@ -235,6 +99,16 @@ bool WebSocketConnection::accept(const RequestHeaders& requestHeaders,
   WebSocketProto_IETF ietf;
   if (ietf.canHandle(requestHeaders, pData, len)) {
     _pParser = new WSHyBiParser(this, new WebSocketProto_IETF());
+    _trackPongs = true;
+
+    // permessage-deflate is only defined for RFC 6455 connections.
+    WSDeflateParams deflateParams;
+    if (negotiateWSDeflate(requestHeaders, *_pOptions, &deflateParams)) {
+      _pDeflate = new WSPerMessageDeflate(deflateParams,
+                                          _pOptions->ws_deflate_mem_level);
+      _deflateResponseHeader = deflateParams.responseHeader();
+    }
+
     this->startPingTimer();
     return true;
   }
@@ -259,34 +133,136 @@ void WebSocketConnection::handshake(const std::string& url,
 
   _pParser->handshake(url, requestHeaders, ppData, pLen, pResponseHeaders,
                       pResponse);
+
+  if (_pDeflate) {
+    pResponseHeaders->push_back(
+      std::pair<std::string, std::string>("Sec-WebSocket-Extensions",
+                                          _deflateResponseHeader));
+    // It isn't needed after the handshake.
+    std::string().swap(_deflateResponseHeader);
+  }
 }
 
 void WebSocketConnection::sendWSMessage(Opcode opcode, const char* pData, size_t length) {
   ASSERT_BACKGROUND_THREAD()
   if (_connState == WS_CLOSED) return;
 
+  bool isData = (opcode == Text || opcode == Binary);
+
+  // Control frames are always sent. Data messages are subject to the send
+  // buffer limit, which keeps slow clients from making us queue an
+  // unbounded amount of data.
+  if (isData) {
+    size_t limit = _pOptions->ws_send_buffer_limit;
+    size_t buffered = _pCallbacks->wsBufferedAmount();
+    if (buffered > limit || length > limit - buffered) {
+      switch (_pOptions->ws_send_buffer_policy) {
+      case WS_SEND_DROP_NEWEST:
+        debug_log("WebSocket send buffer full; dropping newest message", LOG_INFO);
+        return;
+      case WS_SEND_DROP_OLDEST:
+        debug_log("WebSocket send buffer full; dropping oldest messages", LOG_INFO);
+        // If not enough can be dropped, the message is sent anyway; the
+        // newest message is the one to keep.
+        _pCallbacks->dropWSFrames(buffered + length - limit);
+        break;
+      case WS_SEND_CLOSE:
+        // The client won't get the queued messages anyway, and without them
+        // the Close frame is next in line.
+        _pCallbacks->discardWSFrames();
+        failWS(1008, "Send buffer limit exceeded");
+        return;
+      }
+    }
+  }
+
   std::vector<char> header(MAX_HEADER_BYTES);
   std::vector<char> footer(MAX_FOOTER_BYTES);
 
   size_t headerLength = 0;
   size_t footerLength = 0;
 
-  _pParser->createFrameHeaderFooter(opcode, false, length, 0,
+  // Compress data messages if permessage-deflate was negotiated. If
+  // compression fails for some reason, the message is sent as-is; the RSV1
+  // bit tells the client which messages are compressed.
+  bool compressed = false;
+  std::vector<char> compressedData;
+  if (_pDeflate && isData &&
+      length > 0 && length >= _pOptions->ws_deflate_threshold)
+  {
+    if (_pDeflate->compress(pData, length, &compressedData)) {
+      compressed = true;
+      pData = safe_vec_addr(compressedData);
+      length = compressedData.size();
+    }
+  }
+
+  _pParser->createFrameHeaderFooter(opcode, false, compressed, length, 0,
     safe_vec_addr(header), &headerLength,
     safe_vec_addr(footer), &footerLength);
   header.resize(headerLength);
   footer.resize(footerLength);
 
+  // A compressed message can only be dropped if the client's decompressor
+  // doesn't depend on having seen it.
+  bool droppable = isData &&
+    (!compressed || _pDeflate->params().server_no_context_takeover);
+
+  _pStats->onWSFrameOut();
+  trace_event(TRACE_WS_FRAME_OUT, TRACE_INSTANT, _id, length);
   _pCallbacks->sendWSFrame(safe_vec_addr(header), header.size(),
                            pData, length,
-                           safe_vec_addr(footer), footer.size());
+                           safe_vec_addr(footer), footer.size(),
+                           droppable);
+}
+
+size_t WebSocketConnection::bufferedAmount() const {
+  return _pCallbacks->wsBufferedAmount();
+}
+
+double WebSocketConnection::roundTripTime() const {
+  return _roundTripTime.load();
 }
 
 void WebSocketConnection::sendPing() {
   ASSERT_BACKGROUND_THREAD()
   assert(_pParser);
   debug_log("WebSocketConnection::sendPing", LOG_DEBUG);
-  this->sendWSMessage(Ping, NULL, 0);
+  if (!_trackPongs) {
+    this->sendWSMessage(Ping, NULL, 0);
+    return;
+  }
+
+  // The payload is the ping's sequence number, in network byte order. The
+  // client must echo it in its pong.
+  _pingSeq++;
+  char payload[8];
+  for (int i = 0; i < 8; i++) {
+    payload[i] = static_cast<char>((_pingSeq >> (8 * (7 - i))) & 0xFF);
+  }
+  _pingOutstanding = true;
+  _pingSentAt = uv_hrtime();
+  this->sendWSMessage(Ping, payload, sizeof(payload));
+}
+
+void WebSocketConnection::onPong(const std::vector<char>& payload) {
+  ASSERT_BACKGROUND_THREAD()
+  // Any pong shows that the client is alive, but only a pong for the latest
+  // ping can be used to measure the round-trip time. Clients may also send
+  // unsolicited pongs as heartbeats.
+  _missedPongs = 0;
+  if (!_pingOutstanding || payload.size() != 8) {
+    return;
+  }
+
+  uint64_t seq = 0;
+  for (int i = 0; i < 8; i++) {
+    seq = (seq << 8) | static_cast<uint8_t>(payload[i]);
+  }
+  if (seq == _pingSeq) {
+    _pingOutstanding = false;
+    _roundTripTime.store((uv_hrtime() - _pingSentAt) / 1e9);
+  }
 }
 
 void WebSocketConnection::closeWS(uint16_t code, std::string reason) {
@@ -320,6 +296,19 @@ void WebSocketConnection::closeWS(uint16_t code, std::string reason) {
     _pCallbacks->closeWSSocket();
 }
 
+void WebSocketConnection::failWS(uint16_t code, const std::string& reason) {
+  ASSERT_BACKGROUND_THREAD()
+  debug_log("WebSocketConnection::failWS: " + reason, LOG_INFO);
+
+  closeWS(code, reason);
+
+  // closeWS() closes the socket itself if a Close frame was already received.
+  if (_connState != WS_CLOSED) {
+    _connState = WS_CLOSED;
+    _pCallbacks->closeWSSocket();
+  }
+}
+
 void WebSocketConnection::read(const char* data, size_t len) {
   ASSERT_BACKGROUND_THREAD()
   if (_connState == WS_CLOSED) return;
@@ -330,15 +319,40 @@ void WebSocketConnection::read(const char* data, size_t len) {
 void WebSocketConnection::markClosed() {
   ASSERT_BACKGROUND_THREAD()
   _connState = WS_CLOSED;
+  _pingTimer.cancel();
 }
 
 void WebSocketConnection::onHeaderComplete(const WSFrameHeaderInfo& header) {
   ASSERT_BACKGROUND_THREAD()
   if (_connState == WS_CLOSED) return;
 
+  // RSV1 may only be set on the first frame of a data message, and only if
+  // permessage-deflate was negotiated (RFC 7692 Section 6).
+  if (header.rsv1 &&
+      (!_pDeflate || (header.opcode != Text && header.opcode != Binary)))
+  {
+    failWS(1002, "Unexpected RSV1 bit");
+    return;
+  }
+
   _header = header;
+  _payloadOffset = 0;
   if (!header.fin && header.opcode != Continuation)
     _incompleteContentHeader = header;
+
+  if (isMessageFrame()) {
+    if (header.opcode != Continuation) {
+      _messageBytes = 0;
+      _utf8.reset();
+    }
+    // Check the size before any of the payload arrives, so that an
+    // oversized message is never buffered.
+    _messageBytes += header.payloadLength;
+    if (_messageBytes > _pOptions->ws_max_message_size) {
+      failWS(1009, "Message too big");
+      return;
+    }
+  }
 }
 void WebSocketConnection::onPayload(const char* data, size_t len) {
   ASSERT_BACKGROUND_THREAD()
@@ -347,10 +361,44 @@ void WebSocketConnection::onPayload(const char* data, size_t len) {
   size_t origSize = _payload.size();
   std::copy(data, data + len, std::back_inserter(_payload));
 
-  if (_header.masked != 0) {
-    for (size_t i = origSize; i < _payload.size(); i++) {
-      size_t j = i % 4;
-      _payload[i] = _payload[i] ^ _header.maskingKey[j];
+  if (_header.masked != 0 && len > 0) {
+    applyMask(&_payload[origSize], len, _header.maskingKey, _payloadOffset);
+  }
+  _payloadOffset += len;
+
+  // Hixie-76 text frames don't say how long they are up front.
+  if (isMessageFrame() && !_header.hasLength) {
+    _messageBytes += len;
+    if (_messageBytes > _pOptions->ws_max_message_size) {
+      failWS(1009, "Message too big");
+      return;
+    }
+  }
+
+  // Compressed messages can only be inflated as a whole, so they are never
+  // streamed.
+  const WSFrameHeaderInfo& first = messageHeader();
+  if (!isMessageFrame() || first.rsv1 ||
+      _pOptions->ws_large_message == WS_LARGE_MESSAGE_BUFFER)
+  {
+    return;
+  }
+
+  if (!_streaming &&
+      _incompleteContentPayload.size() + _payload.size() >=
+        _pOptions->ws_large_message_threshold)
+  {
+    _streaming = true;
+  }
+
+  if (_streaming) {
+    if (!validateText(safe_vec_addr(_payload), _payload.size(), false))
+      return;
+    std::copy(_payload.begin(), _payload.end(),
+      std::back_inserter(_incompleteContentPayload));
+    _payload.clear();
+    if (_incompleteContentPayload.size() >= _pOptions->ws_large_message_threshold) {
+      streamPayload(false);
     }
   }
 }
@@ -358,8 +406,24 @@ void WebSocketConnection::onFrameComplete() {
   ASSERT_BACKGROUND_THREAD()
   debug_log("WebSocketConnection::onFrameComplete", LOG_DEBUG);
   if (_connState == WS_CLOSED) return;
+  _pStats->onWSFrameIn();
+  trace_event(TRACE_WS_FRAME_IN, TRACE_INSTANT, _id, _payload.size());
+
+  if (isMessageFrame() &&
+      !validateText(safe_vec_addr(_payload), _payload.size(), _header.fin))
+  {
+    _payload.clear();
+    return;
+  }
 
-  if (!_header.fin) {
+  if (_streaming && isMessageFrame()) {
+    std::copy(_payload.begin(), _payload.end(),
+      std::back_inserter(_incompleteContentPayload));
+    if (_header.fin) {
+      streamPayload(true);
+      _streaming = false;
+    }
+  } else if (!_header.fin) {
     std::copy(_payload.begin(), _payload.end(),
       std::back_inserter(_incompleteContentPayload));
   } else {
@@ -367,18 +431,26 @@ void WebSocketConnection::onFrameComplete() {
       case Continuation: {
         std::copy(_payload.begin(), _payload.end(),
           std::back_inserter(_incompleteContentPayload));
-        _pCallbacks->onWSMessage(_incompleteContentHeader.opcode == Binary,
-          safe_vec_addr(_incompleteContentPayload), _incompleteContentPayload.size());
+        deliverMessage(_incompleteContentHeader, _incompleteContentPayload);
 
-        _incompleteContentPayload.clear();
+        std::vector<char>().swap(_incompleteContentPayload);
         break;
       }
       case Text:
       case Binary: {
-        _pCallbacks->onWSMessage(_header.opcode == Binary, safe_vec_addr(_payload), _payload.size());
+        deliverMessage(_header, _payload);
         break;
       }
       case Close: {
+        // The body of a Close frame is a two-byte status code, optionally
+        // followed by a UTF-8 reason (RFC 6455 Section 5.5.1).
+        if (_payload.size() > 2 &&
+            !isValidUTF8(safe_vec_addr(_payload) + 2, _payload.size() - 2))
+        {
+          _payload.clear();
+          failWS(1007, "Invalid UTF-8 in close reason");
+          return;
+        }
 
         if (_connState == WS_OPEN) {
           _connState = WS_CLOSE_RECEIVED;
@@ -407,7 +479,7 @@ void WebSocketConnection::onFrameComplete() {
         break;
       }
       case Pong: {
-        // No action needed
+        onPong(_payload);
         break;
       }
       case Reserved: {
@@ -417,12 +489,133 @@ void WebSocketConnection::onFrameComplete() {
     }
   }
 
-  _payload.clear();
+  // Free the buffer rather than keeping its capacity, so that idle
+  // connections don't hold on to the memory used by their last frame.
+  std::vector<char>().swap(_payload);
 }
 
-void pingTimerCallback(uv_timer_t* pHandle) {
+// Pass a complete data message to the callbacks. `header` is the header of
+// the message's first frame.
+void WebSocketConnection::deliverMessage(const WSFrameHeaderInfo& header,
+                                         std::vector<char>& payload) {
   ASSERT_BACKGROUND_THREAD()
+  bool binary = header.opcode == Binary;
 
-  WebSocketConnection* c = reinterpret_cast<WebSocketConnection*>(pHandle->data);
-  c->sendPing();
+  if (!header.rsv1) {
+    _pCallbacks->onWSMessage(binary, payload);
+    return;
+  }
+
+  std::vector<char> inflated;
+  WSInflateResult res = _pDeflate->decompress(safe_vec_addr(payload),
+                                              payload.size(),
+                                              _pOptions->ws_max_message_size,
+                                              &inflated);
+  if (res == WS_INFLATE_TOO_BIG) {
+    failWS(1009, "Message too big");
+    return;
+  } else if (res != WS_INFLATE_OK) {
+    failWS(1007, "Invalid compressed data");
+    return;
+  }
+  if (!binary && !isValidUTF8(safe_vec_addr(inflated), inflated.size())) {
+    failWS(1007, "Invalid UTF-8 in text message");
+    return;
+  }
+  _pCallbacks->onWSMessage(binary, inflated);
+}
+
+bool WebSocketConnection::isMessageFrame() const {
+  return _header.opcode == Text || _header.opcode == Binary ||
+    _header.opcode == Continuation;
+}
+
+// The header of the first frame of the message that is being received.
+const WSFrameHeaderInfo& WebSocketConnection::messageHeader() const {
+  return _header.opcode == Continuation ? _incompleteContentHeader : _header;
+}
+
+// Check the next part of a text message's payload, as it arrives, so that
+// invalid text is rejected without waiting for the rest of the message. If
+// `last` is true, the message must not end in the middle of a character.
+// Returns false, after failing the connection, if the text is invalid.
+// Compressed messages are checked once they have been inflated instead.
+bool WebSocketConnection::validateText(const char* pData, size_t len, bool last) {
+  ASSERT_BACKGROUND_THREAD()
+  const WSFrameHeaderInfo& first = messageHeader();
+  if (first.opcode != Text || first.rsv1)
+    return true;
+
+  if (_utf8.validate(pData, len) && (!last || _utf8.complete()))
+    return true;
+
+  failWS(1007, "Invalid UTF-8 in text message");
+  return false;
 }
+
+// Pass on the part of a large message that is in _incompleteContentPayload,
+// either to the callbacks or to the spool file. When `last` is true, the
+// message is complete.
+void WebSocketConnection::streamPayload(bool last) {
+  ASSERT_BACKGROUND_THREAD()
+  const WSFrameHeaderInfo& first = messageHeader();
+  bool binary = first.opcode == Binary;
+
+  if (_pOptions->ws_large_message == WS_LARGE_MESSAGE_STREAM) {
+    _pCallbacks->onWSMessageChunk(binary, _incompleteContentPayload, last);
+    _incompleteContentPayload.clear();
+    return;
+  }
+
+  if (!_pSpoolFile) {
+    static unsigned int spoolCount = 0;
+    _spoolPath = _pOptions->ws_spool_dir + "/httpuv-ws-" + toString(_id) +
+      "-" + toString(++spoolCount);
+    _pSpoolFile = create_private_file(_spoolPath);
+    if (!_pSpoolFile) {
+      debug_log("Unable to create WebSocket spool file " + _spoolPath, LOG_ERROR);
+      _spoolPath.clear();
+      failWS(1011, "Unable to store message");
+      return;
+    }
+  }
+
+  // This is a blocking write on the background thread, so every connection
+  // waits while it happens. Each write is about ws_large_message_threshold
+  // bytes and usually only goes to the page cache, but a slow disk under
+  // ws_spool_dir slows down the whole server.
+  size_t len = _incompleteContentPayload.size();
+  if (len > 0 &&
+      fwrite(safe_vec_addr(_incompleteContentPayload), 1, len, _pSpoolFile) != len)
+  {
+    debug_log("Unable to write WebSocket spool file " + _spoolPath, LOG_ERROR);
+    discardSpoolFile();
+    failWS(1011, "Unable to store message");
+    return;
+  }
+  _incompleteContentPayload.clear();
+
+  if (last) {
+    int res = fclose(_pSpoolFile);
+    _pSpoolFile = NULL;
+    if (res != 0) {
+      remove(_spoolPath.c_str());
+      _spoolPath.clear();
+      failWS(1011, "Unable to store message");
+      return;
+    }
+    _pCallbacks->onWSMessageFile(binary, _spoolPath);
+    _spoolPath.clear();
+  }
+}
+
+// Close and remove a partially written spool file.
+void WebSocketConnection::discardSpoolFile() {
+  if (_pSpoolFile) {
+    fclose(_pSpoolFile);
+    _pSpoolFile = NULL;
+    remove(_spoolPath.c_str());
+    _spoolPath.clear();
+  }
+}
+
@@ -1,9 +1,13 @@
 #ifndef WEBSOCKETS_HPP
 #define WEBSOCKETS_HPP
 
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,132 +16,14 @@
 #include "thread.h"
 #include "constants.h"
 #include "websockets-base.h"
+#include "websockets-deflate.h"
+#include "websockets-parser.h"
+#include "serveroptions.h"
+#include "serverstats.h"
+#include "timerwheel.h"
+#include "utf8.h"
 #include "uvutil.h"
 
-class WSFrameHeaderInfo {
-public:
-  bool fin;
-  Opcode opcode;
-  bool masked;
-  std::vector<uint8_t> maskingKey;
-  bool hasLength;
-  uint64_t payloadLength;
-};
-
-/* Interprets the bytes that make up a WebSocket frame header.
- * See RFC 6455 Section 5 (especially 5.2) for details on the
- * wire format.
- */
-class WSHyBiFrameHeader {
-  std::vector<char> _data;
-  WebSocketProto* _pProto;
-
-public:
-  WSHyBiFrameHeader() : _data(MAX_HEADER_BYTES), _pProto(NULL) {
-  }
-
-  // The data is copied (up to 14 bytes worth)
-  WSHyBiFrameHeader(WebSocketProto* pProto, const char* data, size_t len)
-    : _data(data, data + (std::min(MAX_HEADER_BYTES, len))), _pProto(pProto) {
-  }
-
-  virtual ~WSHyBiFrameHeader() {
-  }
-
-  // IMPORTANT: Don't attempt to call any of the other methods
-  // until isHeaderComplete is true!!
-  bool isHeaderComplete() const;
-  bool isPayloadComplete() const;
-
-  WSFrameHeaderInfo info() const;
-  uint64_t payloadLength() const;
-  size_t headerLength() const;
-
-private:
-
-  bool fin() const;
-  Opcode opcode() const;
-  bool masked() const;
-  void maskingKey(uint8_t key[4]) const;
-
-  // Read part of a byte, and interpret the bits as an unsigned number.
-  // The bitOffset is starting from the most significant bit.
-  // IMPORTANT: (bitOffset % 8) + bitWidth MUST be 8 or less!
-  // In other words, the bits you request must not span multiple bytes.
-  uint8_t read(size_t bitOffset, size_t bitWidth) const;
-  // Read bytes, an interpret them as a big endian number.
-  // IMPORTANT: bitOffset and bitWidth MUST be multiples of 8!
-  // IMPORTANT: bitWidth MUST be 64 or less!
-  uint64_t read64(size_t bitOffset, size_t bitWidth) const;
-  uint8_t payloadLengthLength() const;
-  uint8_t maskingKeyLength() const;
-};
-
-class WSParserCallbacks {
-public:
-  virtual void onHeaderComplete(const WSFrameHeaderInfo& header) = 0;
-  // The data is copied
-  virtual void onPayload(const char* data, size_t len) = 0;
-  virtual void onFrameComplete() = 0;
-};
-
-class WSParser {
-public:
-  virtual ~WSParser() {}
-
-  // Populate response headers with the appropriate values. This call
-  // must not fail, but it will not be called unless canHandle returned
-  // true previously, so any validation should be done in canHandle.
-  virtual void handshake(const std::string& url,
-                         const RequestHeaders& requestHeaders,
-                         char** ppData, size_t* pLen,
-                         ResponseHeaders* responseHeaders,
-                         std::vector<uint8_t>* pResponse) const = 0;
-
-  virtual void createFrameHeaderFooter(
-                         Opcode opcode, bool mask, size_t payloadSize,
-                         int32_t maskingKey,
-                         char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
-                         char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
-                         ) const = 0;
-
-  virtual void read(const char* data, size_t len) = 0;
-};
-
-class WSHyBiParser : public WSParser {
-  WSParserCallbacks* _pCallbacks;
-  WebSocketProto* _pProto;
-  WSParseState _state;
-  std::vector<char> _header;
-  uint64_t _bytesLeft;
-
-public:
-  WSHyBiParser(WSParserCallbacks* callbacks, WebSocketProto* pProto)
-      : _pCallbacks(callbacks), _pProto(pProto), _state(InHeader) {
-  }
-  virtual ~WSHyBiParser() {
-    try {
-      delete _pProto;
-    } catch(...) {}
-  }
-
-  void handshake(const std::string& url,
-                 const RequestHeaders& requestHeaders,
-                 char** ppData, size_t* pLen,
-                 ResponseHeaders* responseHeaders,
-                 std::vector<uint8_t>* pResponse) const;
-
-  void createFrameHeaderFooter(
-                         Opcode opcode, bool mask, size_t payloadSize,
-                         int32_t maskingKey,
-                         char pHeaderData[MAX_HEADER_BYTES], size_t* pHeaderLen,
-                         char pFooterData[MAX_FOOTER_BYTES], size_t* pFooterLen
-                         ) const;
-
-  void read(const char* data, size_t len);
-};
-
-
 enum WSConnState {
   WS_OPEN,
   WS_CLOSE_RECEIVED,
@@ -151,52 +37,128 @@ enum WSConnState {
 
 class WebSocketConnectionCallbacks {
 public:
-  virtual void onWSMessage(bool binary, const char* data, size_t len) = 0;
+  // Called with a complete message. Implementers may take the contents of
+  // data (for example, by swapping it into a vector of their own).
+  virtual void onWSMessage(bool binary, std::vector<char>& data) = 0;
+  // Called with each part of a message that is being streamed, in order.
+  // As with onWSMessage(), the contents of data may be taken.
+  virtual void onWSMessageChunk(bool binary, std::vector<char>& data,
+                                bool last) = 0;
+  // Called when a message has been spooled to a file. The receiver is
+  // responsible for removing the file.
+  virtual void onWSMessageFile(bool binary, const std::string& path) = 0;
   virtual void onWSClose(int code) = 0;
-  // Implementers MUST copy data
+  // Implementers MUST copy data. If droppable is true, the frame may be
+  // discarded by dropWSFrames() as long as it hasn't started to be written.
   virtual void sendWSFrame(const char* headerData, size_t headerLength,
                            const char* pData, size_t dataLength,
-                           const char* footerData, size_t footerLength) = 0;
+                           const char* footerData, size_t footerLength,
+                           bool droppable) = 0;
+  // Close the socket. Frames that are already being written, and the ones
+  // queued behind them, may be written first.
   virtual void closeWSSocket() = 0;
+  // Number of bytes that have been passed to sendWSFrame() but haven't been
+  // written to the socket yet. May be called from any thread.
+  virtual size_t wsBufferedAmount() const = 0;
+  // Discard queued droppable frames, oldest first, until at least `bytes`
+  // bytes have been freed or there are none left. Returns the number of
+  // bytes freed.
+  virtual size_t dropWSFrames(size_t bytes) = 0;
+  // Discard all queued frames that haven't started to be written, droppable
+  // or not.
+  virtual void discardWSFrames() = 0;
 };
 
-void pingTimerCallback(uv_timer_t *handle);
-
 class WebSocketConnection : WSParserCallbacks, NoCopy {
+  // Identifies this connection to R; see RWebApplication::onWSOpen.
+  int _id;
   uv_loop_t* _pLoop;
   WSConnState _connState;
   std::shared_ptr<WebSocketConnectionCallbacks> _pCallbacks;
+  // Owned by the WebApplication, which outlives this object because
+  // _pCallbacks (the HttpRequest) holds a reference to it.
+  const ServerOptions* _pOptions;
+  // Owned by the WebApplication, like _pOptions.
+  ServerStats* _pStats;
   WSParser* _pParser;
+  // Non-NULL if permessage-deflate was negotiated for this connection.
+  WSPerMessageDeflate* _pDeflate;
+  std::string _deflateResponseHeader;
   WSFrameHeaderInfo _incompleteContentHeader;
   WSFrameHeaderInfo _header;
+  // The payload of a fragmented message, up to the current frame. When the
+  // message is being streamed or spooled, only the part that hasn't been
+  // passed on yet.
   std::vector<char> _incompleteContentPayload;
+  // The payload of the current frame that has been received so far. When
+  // streaming, this may be cleared before the frame is complete;
+  // _payloadOffset counts all of the bytes of the frame's payload.
   std::vector<char> _payload;
-  uv_timer_t* _pPingTimer;
+  uint64_t _payloadOffset;
+  // The total payload size of the data message that is being received.
+  uint64_t _messageBytes;
+  // True while the current message is being streamed or spooled, because
+  // it is larger than ws_large_message_threshold.
+  bool _streaming;
+  FILE* _pSpoolFile;
+  std::string _spoolPath;
+  // Checks the payload of text messages as it arrives.
+  UTF8Validator _utf8;
+
+  // Keepalive pings are driven by the loop's TimerWheel.
+  TimerWheelTimer _pingTimer;
+  // Pongs are only tracked for RFC 6455 connections.
+  bool _trackPongs;
+  // Each ping carries a sequence number, so that its pong can be recognized.
+  uint64_t _pingSeq;
+  bool _pingOutstanding;
+  uint64_t _pingSentAt;
+  unsigned int _missedPongs;
+  // In seconds; NaN until the first pong is received. Written on the
+  // background thread and read on the main thread.
+  std::atomic<double> _roundTripTime;
 
 public:
   WebSocketConnection(
     uv_loop_t* pLoop,
-    std::shared_ptr<WebSocketConnectionCallbacks> callbacks)
-      : _pLoop(pLoop),
+    std::shared_ptr<WebSocketConnectionCallbacks> callbacks,
+    const ServerOptions& options,
+    ServerStats& stats)
+      : _id(nextId()),
+        _pLoop(pLoop),
         _connState(WS_OPEN),
         _pCallbacks(callbacks),
-        _pParser(NULL) {
+        _pOptions(&options),
+        _pStats(&stats),
+        _pParser(NULL),
+        _pDeflate(NULL),
+        _payloadOffset(0),
+        _messageBytes(0),
+        _streaming(false),
+        _pSpoolFile(NULL),
+        _trackPongs(false),
+        _pingSeq(0),
+        _pingOutstanding(false),
+        _pingSentAt(0),
+        _missedPongs(0),
+        _roundTripTime(std::numeric_limits<double>::quiet_NaN()) {
     ASSERT_BACKGROUND_THREAD()
     debug_log("WebSocketConnection::WebSocketConnection", LOG_DEBUG);
-
-    _pPingTimer = static_cast<uv_timer_t*>(malloc(sizeof(uv_timer_t)));
-    uv_timer_init(_pLoop, _pPingTimer);
-    _pPingTimer->data = this;
+    _pingTimer.setCallback(std::bind(&WebSocketConnection::onPingTimer, this));
   }
 
   virtual ~WebSocketConnection() {
     ASSERT_BACKGROUND_THREAD()
     debug_log("WebSocketConnection::~WebSocketConnection", LOG_DEBUG);
-    // calling uv_close() on a timer implicitly calls uv_timer_stop()
-    uv_close(toHandle(_pPingTimer), freeAfterClose);
     try {
       delete _pParser;
     } catch(...) {}
+    delete _pDeflate;
+    discardSpoolFile();
+  }
+
+  int id() const {
+    return _id;
   }
 
   bool accept(const RequestHeaders& requestHeaders, const char* pData, size_t len);
@@ -207,8 +169,16 @@ public:
                  std::vector<uint8_t>* pResponse);
 
   void sendWSMessage(Opcode opcode, const char* pData, size_t length);
+  size_t bufferedAmount() const;
+  // The round-trip time of the most recent ping, in seconds, or NaN if no
+  // pong has been received yet. Can be called from any thread.
+  double roundTripTime() const;
   void sendPing();
   void closeWS(uint16_t code = 1000, std::string reason = "");
+  // Send a Close frame (if one hasn't been sent already) and close the
+  // underlying socket without waiting for the client to respond. This is
+  // used when the client violates the protocol.
+  void failWS(uint16_t code, const std::string& reason = "");
   void read(const char* data, size_t len);
   void markClosed();
   void startPingTimer();
@@ -217,6 +187,18 @@ protected:
   void onHeaderComplete(const WSFrameHeaderInfo& header);
   void onPayload(const char* data, size_t len);
   void onFrameComplete();
+
+private:
+  static int nextId();
+  void onPingTimer();
+  void onPong(const std::vector<char>& payload);
+  bool isMessageFrame() const;
+  const WSFrameHeaderInfo& messageHeader() const;
+  bool validateText(const char* pData, size_t len, bool last);
+  void streamPayload(bool last);
+  void discardSpoolFile();
+  void deliverMessage(const WSFrameHeaderInfo& header,
+                      std::vector<char>& payload);
 };
 
 #endif // WEBSOCKETS_HPP
@@ -0,0 +1,94 @@
+#include "wsmessagebatch.h"
+#include "webapplication.h"
+#include "thread.h"
+#include "utils.h"
+#include "uvutil.h"
+#include "scheduler.h"
+#include "eventlog.h"
+
+WSMessageBatcher::WSMessageBatcher(uv_loop_t* pLoop,
+                                   std::shared_ptr<WebApplication> pWebApplication,
+                                   size_t maxMessages,
+                                   uint64_t maxDelayMs)
+  : _pWebApplication(pWebApplication),
+    _maxMessages(maxMessages),
+    _maxDelayMs(maxDelayMs),
+    _pLoop(pLoop),
+    _pBatch(std::make_shared<WSMessageBatch>()),
+    _timer(std::bind(&WSMessageBatcher::flush, this)),
+    _pShortTimer(NULL)
+{
+  ASSERT_BACKGROUND_THREAD()
+}
+
+WSMessageBatcher::~WSMessageBatcher() {
+  ASSERT_BACKGROUND_THREAD()
+  debug_log("WSMessageBatcher::~WSMessageBatcher", LOG_DEBUG);
+  closeShortTimer();
+}
+
+void WSMessageBatcher::closeShortTimer() {
+  if (_pShortTimer) {
+    // calling uv_close() on a timer implicitly calls uv_timer_stop()
+    uv_close(toHandle(_pShortTimer), freeAfterClose);
+    _pShortTimer = NULL;
+  }
+}
+
+void WSMessageBatcher::add(std::shared_ptr<WebSocketConnection> pConn,
+                           bool binary,
+                           std::shared_ptr<std::vector<char> > data,
+                           std::function<void(void)> error_callback)
+{
+  ASSERT_BACKGROUND_THREAD()
+  WSBatchedMessage msg;
+  msg.pConn = pConn;
+  msg.binary = binary;
+  msg.data = data;
+  msg.error_callback = error_callback;
+  _pBatch->push_back(msg);
+
+  if (_pBatch->size() >= _maxMessages) {
+    flush();
+  } else if (_pBatch->size() == 1) {
+    // First message of a new batch
+    TimerWheel* pWheel = TimerWheel::forLoop(_pLoop);
+    if (pWheel && _maxDelayMs >= pWheel->tickMs()) {
+      pWheel->start(&_timer, _maxDelayMs);
+    } else {
+      _pShortTimer = static_cast<uv_timer_t*>(malloc(sizeof(uv_timer_t)));
+      uv_timer_init(_pLoop, _pShortTimer);
+      _pShortTimer->data = this;
+      uv_timer_start(_pShortTimer, WSMessageBatcher_on_timer, _maxDelayMs, 0);
+    }
+  }
+}
+
+void WSMessageBatcher::flush() {
+  ASSERT_BACKGROUND_THREAD()
+  _timer.cancel();
+  closeShortTimer();
+  if (_pBatch->empty()) {
+    return;
+  }
+
+  log_event(LOG_DEBUG, EV_WS_BATCH_FLUSH, 0, _pBatch->size());
+
+  // Schedule:
+  // _pWebApplication->onWSMessageBatch(_pBatch)
+  invoke_main(this, PRIORITY_NORMAL,
+    std::bind(
+      &WebApplication::onWSMessageBatch,
+      _pWebApplication,
+      _pBatch
+    )
+  );
+
+  _pBatch = std::make_shared<WSMessageBatch>();
+}
+
+void WSMessageBatcher_on_timer(uv_timer_t* handle) {
+  ASSERT_BACKGROUND_THREAD()
+  WSMessageBatcher* pBatcher = reinterpret_cast<WSMessageBatcher*>(handle->data);
+  pBatcher->flush();
+}
@@ -0,0 +1,69 @@
+#ifndef WSMESSAGEBATCH_HPP
+#define WSMESSAGEBATCH_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <uv.h>
+
+#include "constants.h"
+#include "timerwheel.h"
+
+class WebApplication;
+class WebSocketConnection;
+
+// An incoming WebSocket message that is waiting to be passed to R.
+struct WSBatchedMessage {
+  std::shared_ptr<WebSocketConnection> pConn;
+  bool binary;
+  std::shared_ptr<std::vector<char> > data;
+  std::function<void(void)> error_callback;
+};
+
+typedef std::vector<WSBatchedMessage> WSMessageBatch;
+
+void WSMessageBatcher_on_timer(uv_timer_t* handle);
+
+// Collects incoming WebSocket messages on the background thread and passes
+// them to the WebApplication in batches, so that a burst of messages results
+// in one call into R instead of one call per message. A batch is delivered
+// when it reaches `maxMessages`, or `maxDelayMs` milliseconds after its first
+// message arrived, whichever comes first. With a delay of 0, that is the next
+// iteration of the background thread's event loop.
+//
+// Delays of at least one tick are timed by the loop's TimerWheel, and so are
+// rounded up to a whole number of ticks. Shorter delays use a one-shot
+// uv_timer_t that only exists while a batch is waiting, so that idle
+// batchers don't each hold a libuv timer.
+//
+// A batcher may be used by one connection or shared by all the connections
+// of a server.
+class WSMessageBatcher : NoCopy {
+  std::shared_ptr<WebApplication> _pWebApplication;
+  size_t _maxMessages;
+  uint64_t _maxDelayMs;
+  uv_loop_t* _pLoop;
+  std::shared_ptr<WSMessageBatch> _pBatch;
+  TimerWheelTimer _timer;
+  // Non-NULL while a batch is waiting on a delay shorter than one tick.
+  uv_timer_t* _pShortTimer;
+
+  void closeShortTimer();
+
+public:
+  WSMessageBatcher(uv_loop_t* pLoop,
+                   std::shared_ptr<WebApplication> pWebApplication,
+                   size_t maxMessages,
+                   uint64_t maxDelayMs);
+  ~WSMessageBatcher();
+
+  void add(std::shared_ptr<WebSocketConnection> pConn,
+           bool binary,
+           std::shared_ptr<std::vector<char> > data,
+           std::function<void(void)> error_callback);
+
+  // Schedule delivery of the pending messages, if there are any.
+  void flush();
+};
+
+#endif // WSMESSAGEBATCH_HPP
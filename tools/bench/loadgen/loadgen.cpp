@@ -0,0 +1,922 @@
+// A load generator for httpuv, built on the libuv and http-parser that are
+// vendored in src/. It drives one server on this machine over HTTP/1.1 or
+// WebSockets and reports throughput and latency quantiles. See README.md in
+// this directory.
+//
+// Everything runs on one libuv loop. Latency is measured from when a request
+// was meant to be sent: in closed-loop mode that is when the previous
+// response on its connection arrived, and with --rate it is the request's
+// slot in the arrival schedule, even if it had to wait for a free
+// connection. Measuring from the actual send time would hide the delays that
+// a slow server causes (coordinated omission).
+
+#include <uv.h>
+#include "http-parser/http_parser.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/resource.h>
+
+
+// ============================================================================
+// Options
+// ============================================================================
+
+enum Mode {
+  MODE_HTTP,
+  MODE_WS_ECHO,
+  MODE_WS_BROADCAST
+};
+
+struct Options {
+  Mode mode;
+  std::string host;
+  int port;
+  std::string path;
+  std::string method;
+  std::vector<std::string> headers;
+  size_t bodySize;
+  size_t messageSize;
+  int connections;
+  int pipeline;
+  // Requests or messages per second, across all connections; 0 for closed
+  // loop.
+  double rate;
+  double duration;
+  double warmup;
+  int connectConcurrency;
+  std::string label;
+  bool json;
+
+  Options()
+    : mode(MODE_HTTP), host("127.0.0.1"), port(0), path("/"), method("GET"),
+      bodySize(0), messageSize(64), connections(10), pipeline(1), rate(0),
+      duration(10), warmup(2), connectConcurrency(200), json(false) {}
+};
+
+static void usage() {
+  fprintf(stderr,
+    "Usage: loadgen --port=PORT [options]\n"
+    "\n"
+    "  --mode=MODE            http (default), ws-echo, or ws-broadcast\n"
+    "  --host=ADDR            IPv4 or IPv6 address of the server (127.0.0.1)\n"
+    "  --port=PORT            Port of the server\n"
+    "  --path=PATH            Request path (/)\n"
+    "  --method=METHOD        HTTP method (GET)\n"
+    "  --header='NAME: VALUE' Extra request header; may be repeated\n"
+    "  --body-size=BYTES      Send a request body of this size (0)\n"
+    "  --connections=N        Number of connections (10)\n"
+    "  --pipeline=N           Requests or messages in flight per connection,\n"
+    "                         in closed-loop mode (1)\n"
+    "  --rate=N               Open loop: requests or messages per second,\n"
+    "                         across all connections. 0 for closed loop (0)\n"
+    "  --duration=SECS        How long to measure (10)\n"
+    "  --warmup=SECS          How long to run before measuring (2)\n"
+    "  --message-size=BYTES   WebSocket message size, at least 16 (64)\n"
+    "  --connect-concurrency=N  Connections opened at once (200)\n"
+    "  --label=NAME           Name to put in the report\n"
+    "  --json                 Print the report as one line of JSON\n"
+    "\n"
+    "In ws-echo mode, the server should send each message back on the same\n"
+    "connection. In ws-broadcast mode, the first connection sends messages\n"
+    "and the server should send each one to every connection; latency is\n"
+    "measured for every delivery.\n");
+}
+
+static bool parse_option(Options* opt, const std::string& name, const std::string& value) {
+  if (name == "mode") {
+    if (value == "http") opt->mode = MODE_HTTP;
+    else if (value == "ws-echo") opt->mode = MODE_WS_ECHO;
+    else if (value == "ws-broadcast") opt->mode = MODE_WS_BROADCAST;
+    else return false;
+  } else if (name == "host") {
+    opt->host = value == "localhost" ? "127.0.0.1" : value;
+  } else if (name == "port") {
+    opt->port = atoi(value.c_str());
+  } else if (name == "path") {
+    opt->path = value;
+  } else if (name == "method") {
+    opt->method = value;
+  } else if (name == "header") {
+    opt->headers.push_back(value);
+  } else if (name == "body-size") {
+    opt->bodySize = strtoull(value.c_str(), NULL, 10);
+  } else if (name == "message-size") {
+    opt->messageSize = strtoull(value.c_str(), NULL, 10);
+  } else if (name == "connections") {
+    opt->connections = atoi(value.c_str());
+  } else if (name == "pipeline") {
+    opt->pipeline = atoi(value.c_str());
+  } else if (name == "rate") {
+    opt->rate = atof(value.c_str());
+  } else if (name == "duration") {
+    opt->duration = atof(value.c_str());
+  } else if (name == "warmup") {
+    opt->warmup = atof(value.c_str());
+  } else if (name == "connect-concurrency") {
+    opt->connectConcurrency = atoi(value.c_str());
+  } else if (name == "label") {
+    opt->label = value;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool parse_args(Options* opt, int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--help") {
+      return false;
+    }
+    if (arg == "--json") {
+      opt->json = true;
+      continue;
+    }
+    if (arg.compare(0, 2, "--") != 0) {
+      return false;
+    }
+    std::string name, value;
+    size_t eq = arg.find('=');
+    if (eq != std::string::npos) {
+      name = arg.substr(2, eq - 2);
+      value = arg.substr(eq + 1);
+    } else if (i + 1 < argc) {
+      name = arg.substr(2);
+      value = argv[++i];
+    } else {
+      return false;
+    }
+    if (!parse_option(opt, name, value)) {
+      fprintf(stderr, "Bad option: %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  return opt->port > 0 && opt->connections > 0 && opt->pipeline > 0 &&
+    opt->duration > 0 && opt->warmup >= 0 && opt->connectConcurrency > 0 &&
+    opt->rate >= 0 && opt->messageSize >= 16;
+}
+
+
+// ============================================================================
+// Latency histogram
+// ============================================================================
+
+// A log-linear histogram of nanosecond values. Values below 128 have their
+// own buckets; above that, each power of two is split into 64 buckets, so a
+// value is known to within 1.6%.
+class Histogram {
+  std::vector<uint64_t> _counts;
+  uint64_t _total;
+  uint64_t _max;
+  double _sum;
+
+  static size_t index(uint64_t value) {
+    if (value < 128) {
+      return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - 6;
+    return 128 + (shift - 1) * 64 + ((value >> shift) - 64);
+  }
+
+  // The middle of a bucket.
+  static uint64_t value(size_t index) {
+    if (index < 128) {
+      return index;
+    }
+    int shift = (index - 128) / 64 + 1;
+    uint64_t sub = (index - 128) % 64 + 64;
+    return (sub << shift) + ((uint64_t)1 << (shift - 1));
+  }
+
+public:
+  Histogram() : _counts(128 + 58 * 64), _total(0), _max(0), _sum(0) {}
+
+  void add(uint64_t ns) {
+    _counts[index(ns)]++;
+    _total++;
+    _max = std::max(_max, ns);
+    _sum += ns;
+  }
+
+  uint64_t count() const { return _total; }
+  uint64_t max() const { return _max; }
+  double mean() const { return _total == 0 ? 0 : _sum / _total; }
+
+  uint64_t quantile(double q) const {
+    if (_total == 0) {
+      return 0;
+    }
+    uint64_t rank = (uint64_t)(q * _total);
+    if (rank >= _total) {
+      rank = _total - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < _counts.size(); i++) {
+      seen += _counts[i];
+      if (seen > rank) {
+        return std::min(value(i), _max);
+      }
+    }
+    return _max;
+  }
+};
+
+
+// ============================================================================
+// State
+// ============================================================================
+
+struct Conn {
+  uv_tcp_t tcp;
+  uv_connect_t connectReq;
+  size_t index;
+  bool open;
+  bool ready;
+
+  // HTTP: when each request in flight was meant to be sent.
+  http_parser parser;
+  std::deque<uint64_t> inflight;
+  int status;
+
+  // WebSocket
+  std::string input;
+  bool upgraded;
+  int wsInflight;
+};
+
+struct Runner {
+  Options opt;
+  uv_loop_t* loop;
+  struct sockaddr_storage addr;
+  std::vector<Conn*> conns;
+  // One HTTP request, sent as many times as needed.
+  std::string request;
+
+  size_t nextToConnect;
+  int connecting;
+  int readyCount;
+
+  bool running;
+  uint64_t start;
+  uint64_t measureStart;
+  uint64_t measureEnd;
+  uv_timer_t tick;
+
+  // Open loop: the number of requests that are due so far, and the ones that
+  // are waiting for a connection to be free.
+  uint64_t issued;
+  std::deque<uint64_t> backlog;
+  size_t nextConn;
+
+  Histogram latency;
+  uint64_t completed;
+  uint64_t sent;
+  uint64_t errors;
+  uint64_t statusErrors;
+  uint64_t unfinished;
+  uint64_t bytesIn;
+};
+
+static Runner R;
+static http_parser_settings parser_settings;
+static char read_buffer[65536];
+
+static void fail(const char* what, int err) {
+  fprintf(stderr, "%s: %s\n", what, uv_strerror(err));
+  exit(1);
+}
+
+static bool in_window(uint64_t t) {
+  return t >= R.measureStart && t < R.measureEnd;
+}
+
+static void record(uint64_t intended, uint64_t now) {
+  if (in_window(now)) {
+    R.latency.add(now > intended ? now - intended : 0);
+    R.completed++;
+  }
+}
+
+static uint64_t due_time(uint64_t n) {
+  return R.start + (uint64_t)(n * 1e9 / R.opt.rate);
+}
+
+static void connect_next();
+static void start_run();
+static void reconnect(Conn* c);
+
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+struct WriteReq {
+  uv_write_t req;
+  std::string data;
+};
+
+// A write that fails isn't counted here. The connection's next read fails
+// too, and its requests are counted as errors when it is closed.
+static void on_write(uv_write_t* req, int /* status */) {
+  delete (WriteReq*)req->data;
+}
+
+static void write_data(Conn* c, std::string data) {
+  WriteReq* w = new WriteReq();
+  w->req.data = w;
+  w->data.swap(data);
+  uv_buf_t buf = uv_buf_init(&w->data[0], w->data.size());
+  if (uv_write(&w->req, (uv_stream_t*)&c->tcp, &buf, 1, on_write) != 0) {
+    delete w;
+  }
+}
+
+static void on_request_written(uv_write_t* req, int /* status */) {
+  free(req);
+}
+
+// Send n copies of the HTTP request. They all point at R.request, which
+// outlives the write.
+static void write_requests(Conn* c, int n) {
+  std::vector<uv_buf_t> bufs(n, uv_buf_init(&R.request[0], R.request.size()));
+  uv_write_t* req = (uv_write_t*)malloc(sizeof(uv_write_t));
+  if (uv_write(req, (uv_stream_t*)&c->tcp, &bufs[0], n, on_request_written) != 0) {
+    free(req);
+    return;
+  }
+  R.sent += n;
+}
+
+static std::string ws_frame(int opcode, const char* data, size_t len) {
+  std::string frame;
+  frame.reserve(len + 14);
+  frame.push_back((char)(0x80 | opcode));
+  if (len < 126) {
+    frame.push_back((char)(0x80 | len));
+  } else if (len < 65536) {
+    frame.push_back((char)(0x80 | 126));
+    frame.push_back((char)(len >> 8));
+    frame.push_back((char)(len & 0xff));
+  } else {
+    frame.push_back((char)(0x80 | 127));
+    for (int i = 7; i >= 0; i--) {
+      frame.push_back((char)((len >> (8 * i)) & 0xff));
+    }
+  }
+  unsigned char mask[4];
+  for (int i = 0; i < 4; i++) {
+    mask[i] = rand() & 0xff;
+    frame.push_back((char)mask[i]);
+  }
+  for (size_t i = 0; i < len; i++) {
+    frame.push_back((char)(data[i] ^ mask[i % 4]));
+  }
+  return frame;
+}
+
+// Send a binary message whose first 8 bytes are the time it was meant to be
+// sent.
+static void send_ws_message(Conn* c, uint64_t intended) {
+  std::string payload(R.opt.messageSize, 'x');
+  memcpy(&payload[0], &intended, sizeof(intended));
+  write_data(c, ws_frame(2, payload.data(), payload.size()));
+  c->wsInflight++;
+  R.sent++;
+}
+
+
+// ============================================================================
+// HTTP
+// ============================================================================
+
+// Hand waiting requests to connections that have room for them.
+static void dispatch() {
+  size_t n = R.conns.size();
+  for (size_t k = 0; k < n && !R.backlog.empty(); k++) {
+    Conn* c = R.conns[(R.nextConn + k) % n];
+    if (!c->open) {
+      continue;
+    }
+    int room = R.opt.pipeline - (int)c->inflight.size();
+    int count = 0;
+    while (count < room && !R.backlog.empty()) {
+      c->inflight.push_back(R.backlog.front());
+      R.backlog.pop_front();
+      count++;
+    }
+    if (count > 0) {
+      write_requests(c, count);
+    }
+  }
+  R.nextConn = (R.nextConn + 1) % n;
+}
+
+static int on_headers_complete(http_parser* parser) {
+  Conn* c = (Conn*)parser->data;
+  c->status = parser->status_code;
+  return 0;
+}
+
+static int on_message_complete(http_parser* parser) {
+  Conn* c = (Conn*)parser->data;
+  uint64_t now = uv_hrtime();
+  if (c->inflight.empty()) {
+    return 0;
+  }
+  uint64_t intended = c->inflight.front();
+  c->inflight.pop_front();
+  record(intended, now);
+  if (c->status >= 400 && in_window(now)) {
+    R.statusErrors++;
+  }
+
+  if (!R.running) {
+    return 0;
+  }
+  if (R.opt.rate == 0) {
+    c->inflight.push_back(now);
+    write_requests(c, 1);
+  } else {
+    dispatch();
+  }
+  return 0;
+}
+
+
+// ============================================================================
+// WebSockets
+// ============================================================================
+
+static void on_ws_message(Conn* c, const char* data, size_t len) {
+  uint64_t now = uv_hrtime();
+  if (len >= sizeof(uint64_t)) {
+    uint64_t intended;
+    memcpy(&intended, data, sizeof(intended));
+    record(intended, now);
+  }
+  if (c->wsInflight > 0) {
+    c->wsInflight--;
+  }
+
+  if (!R.running || R.opt.rate != 0) {
+    return;
+  }
+  // Closed loop: the echo, or the sender's own copy of the broadcast, frees
+  // a slot.
+  if (R.opt.mode == MODE_WS_ECHO || c->index == 0) {
+    send_ws_message(c, now);
+  }
+}
+
+// Handle the complete frames at the start of c->input.
+static void read_ws_frames(Conn* c) {
+  const unsigned char* p = (const unsigned char*)c->input.data();
+  size_t size = c->input.size();
+  size_t pos = 0;
+
+  while (size - pos >= 2) {
+    int opcode = p[pos] & 0x0f;
+    bool masked = (p[pos + 1] & 0x80) != 0;
+    uint64_t len = p[pos + 1] & 0x7f;
+    size_t header = 2;
+    if (len == 126) {
+      if (size - pos < 4) break;
+      len = ((uint64_t)p[pos + 2] << 8) | p[pos + 3];
+      header = 4;
+    } else if (len == 127) {
+      if (size - pos < 10) break;
+      len = 0;
+      for (int i = 0; i < 8; i++) {
+        len = (len << 8) | p[pos + 2 + i];
+      }
+      header = 10;
+    }
+    if (masked) {
+      header += 4;
+    }
+    if (size - pos < header + len) {
+      break;
+    }
+
+    const char* payload = (const char*)p + pos + header;
+    switch (opcode) {
+    case 0:
+    case 1:
+    case 2:
+      on_ws_message(c, payload, len);
+      break;
+    case 8:
+      // Close
+      if (R.running) {
+        R.errors++;
+      }
+      break;
+    case 9:
+      // Ping
+      write_data(c, ws_frame(10, payload, len));
+      break;
+    }
+    pos += header + len;
+  }
+  c->input.erase(0, pos);
+}
+
+static void on_ws_data(Conn* c, const char* data, size_t len) {
+  c->input.append(data, len);
+  if (!c->upgraded) {
+    size_t end = c->input.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      return;
+    }
+    if (c->input.compare(0, 12, "HTTP/1.1 101") != 0) {
+      fprintf(stderr, "WebSocket handshake failed: %s\n",
+        c->input.substr(0, c->input.find("\r\n")).c_str());
+      exit(1);
+    }
+    c->input.erase(0, end + 4);
+    c->upgraded = true;
+    c->ready = true;
+    R.readyCount++;
+    R.connecting--;
+    connect_next();
+    if (R.readyCount == (int)R.conns.size()) {
+      start_run();
+    }
+  }
+  read_ws_frames(c);
+}
+
+
+// ============================================================================
+// Connections
+// ============================================================================
+
+static void on_alloc(uv_handle_t*, size_t, uv_buf_t* buf) {
+  // Reads are handled before the next buffer is needed, so one will do.
+  *buf = uv_buf_init(read_buffer, sizeof(read_buffer));
+}
+
+static void on_close(uv_handle_t* handle) {
+  Conn* c = (Conn*)handle->data;
+  if (R.running) {
+    reconnect(c);
+  } else {
+    delete c;
+  }
+}
+
+static void close_conn(Conn* c) {
+  if (!c->open) {
+    return;
+  }
+  c->open = false;
+  if (R.running) {
+    // The requests in flight won't be answered.
+    R.errors += c->inflight.size() + c->wsInflight;
+  }
+  c->inflight.clear();
+  c->wsInflight = 0;
+  uv_close((uv_handle_t*)&c->tcp, on_close);
+}
+
+static void on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  Conn* c = (Conn*)stream->data;
+  if (nread < 0) {
+    if (!c->ready) {
+      fail("Connection closed before it was ready", (int)nread);
+    }
+    close_conn(c);
+    return;
+  }
+  if (nread == 0) {
+    return;
+  }
+  if (R.running && in_window(uv_hrtime())) {
+    R.bytesIn += nread;
+  }
+
+  if (R.opt.mode == MODE_HTTP) {
+    size_t parsed = http_parser_execute(&c->parser, &parser_settings, buf->base, nread);
+    if (parsed != (size_t)nread || HTTP_PARSER_ERRNO(&c->parser) != HPE_OK) {
+      fprintf(stderr, "Bad response: %s\n",
+        http_errno_description(HTTP_PARSER_ERRNO(&c->parser)));
+      if (R.running) {
+        R.errors++;
+      }
+      close_conn(c);
+    }
+  } else {
+    on_ws_data(c, buf->base, nread);
+  }
+}
+
+static std::string ws_handshake() {
+  std::string s = "GET " + R.opt.path + " HTTP/1.1\r\n"
+    "Host: " + R.opt.host + ":" + std::to_string(R.opt.port) + "\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n";
+  for (size_t i = 0; i < R.opt.headers.size(); i++) {
+    s += R.opt.headers[i] + "\r\n";
+  }
+  return s + "\r\n";
+}
+
+static void on_connect(uv_connect_t* req, int status) {
+  Conn* c = (Conn*)req->data;
+  if (c->ready && (status != 0 || !R.running)) {
+    // Reconnecting during the run failed, or the run is over; on_close()
+    // tries again if it should.
+    if (status != 0 && R.running) {
+      R.errors++;
+    }
+    uv_close((uv_handle_t*)&c->tcp, on_close);
+    return;
+  }
+  if (status != 0) {
+    fail("connect", status);
+  }
+  c->open = true;
+  int r = uv_read_start((uv_stream_t*)&c->tcp, on_alloc, on_read);
+  if (r != 0) {
+    fail("uv_read_start", r);
+  }
+
+  if (R.opt.mode != MODE_HTTP) {
+    if (c->upgraded) {
+      // Reconnecting during the run isn't done for WebSockets.
+      close_conn(c);
+      return;
+    }
+    write_data(c, ws_handshake());
+    return;
+  }
+
+  http_parser_init(&c->parser, HTTP_RESPONSE);
+  c->parser.data = c;
+  if (c->ready) {
+    // Reconnected during the run.
+    if (R.opt.rate == 0) {
+      for (int i = 0; i < R.opt.pipeline; i++) {
+        c->inflight.push_back(uv_hrtime());
+      }
+      write_requests(c, R.opt.pipeline);
+    } else {
+      dispatch();
+    }
+    return;
+  }
+  c->ready = true;
+  R.readyCount++;
+  R.connecting--;
+  connect_next();
+  if (R.readyCount == (int)R.conns.size()) {
+    start_run();
+  }
+}
+
+static void open_conn(Conn* c) {
+  uv_tcp_init(R.loop, &c->tcp);
+  c->tcp.data = c;
+  uv_tcp_nodelay(&c->tcp, 1);
+  c->connectReq.data = c;
+  int r = uv_tcp_connect(&c->connectReq, &c->tcp, (struct sockaddr*)&R.addr, on_connect);
+  if (r != 0) {
+    fail("uv_tcp_connect", r);
+  }
+}
+
+static void reconnect(Conn* c) {
+  if (R.opt.mode == MODE_HTTP) {
+    open_conn(c);
+  }
+}
+
+static void connect_next() {
+  while (R.connecting < R.opt.connectConcurrency &&
+         R.nextToConnect < R.conns.size())
+  {
+    R.connecting++;
+    open_conn(R.conns[R.nextToConnect++]);
+  }
+}
+
+
+// ============================================================================
+// Running
+// ============================================================================
+
+static void finish() {
+  uint64_t now = uv_hrtime();
+  R.running = false;
+  uv_timer_stop(&R.tick);
+  uv_close((uv_handle_t*)&R.tick, NULL);
+
+  // With an arrival schedule, requests that are still waiting have taken at
+  // least this long; leaving them out would make an overloaded server look
+  // better than it is.
+  if (R.opt.rate != 0 && R.opt.mode == MODE_HTTP) {
+    for (size_t i = 0; i < R.conns.size(); i++) {
+      R.backlog.insert(R.backlog.end(),
+        R.conns[i]->inflight.begin(), R.conns[i]->inflight.end());
+    }
+    for (size_t i = 0; i < R.backlog.size(); i++) {
+      if (R.backlog[i] >= R.measureStart) {
+        R.latency.add(now - R.backlog[i]);
+        R.unfinished++;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < R.conns.size(); i++) {
+    Conn* c = R.conns[i];
+    if (c->open) {
+      c->open = false;
+      uv_read_stop((uv_stream_t*)&c->tcp);
+      uv_close((uv_handle_t*)&c->tcp, on_close);
+    }
+  }
+}
+
+static void on_tick(uv_timer_t*) {
+  uint64_t now = uv_hrtime();
+  if (now >= R.measureEnd) {
+    finish();
+    return;
+  }
+  if (R.opt.rate == 0) {
+    return;
+  }
+
+  uint64_t due = (uint64_t)((now - R.start) / 1e9 * R.opt.rate);
+  if (R.opt.mode == MODE_HTTP) {
+    for (; R.issued < due; R.issued++) {
+      R.backlog.push_back(due_time(R.issued));
+    }
+    dispatch();
+  } else if (R.opt.mode == MODE_WS_ECHO) {
+    for (; R.issued < due; R.issued++) {
+      Conn* c = R.conns[R.issued % R.conns.size()];
+      if (c->open) {
+        send_ws_message(c, due_time(R.issued));
+      }
+    }
+  } else {
+    for (; R.issued < due; R.issued++) {
+      if (R.conns[0]->open) {
+        send_ws_message(R.conns[0], due_time(R.issued));
+      }
+    }
+  }
+}
+
+static void start_run() {
+  R.running = true;
+  R.start = uv_hrtime();
+  R.measureStart = R.start + (uint64_t)(R.opt.warmup * 1e9);
+  R.measureEnd = R.measureStart + (uint64_t)(R.opt.duration * 1e9);
+
+  uv_timer_init(R.loop, &R.tick);
+  uv_timer_start(&R.tick, on_tick, 1, 1);
+
+  if (R.opt.rate != 0) {
+    return;
+  }
+  for (size_t i = 0; i < R.conns.size(); i++) {
+    Conn* c = R.conns[i];
+    if (R.opt.mode == MODE_HTTP) {
+      for (int j = 0; j < R.opt.pipeline; j++) {
+        c->inflight.push_back(R.start);
+      }
+      write_requests(c, R.opt.pipeline);
+    } else if (R.opt.mode == MODE_WS_ECHO || i == 0) {
+      for (int j = 0; j < R.opt.pipeline; j++) {
+        send_ws_message(c, R.start);
+      }
+    }
+  }
+}
+
+static std::string build_request() {
+  std::string s = R.opt.method + " " + R.opt.path + " HTTP/1.1\r\n"
+    "Host: " + R.opt.host + ":" + std::to_string(R.opt.port) + "\r\n";
+  for (size_t i = 0; i < R.opt.headers.size(); i++) {
+    s += R.opt.headers[i] + "\r\n";
+  }
+  if (R.opt.bodySize > 0) {
+    s += "Content-Type: application/octet-stream\r\n"
+      "Content-Length: " + std::to_string(R.opt.bodySize) + "\r\n";
+  }
+  s += "\r\n";
+  s.append(R.opt.bodySize, 'x');
+  return s;
+}
+
+// Each connection needs a file descriptor.
+static void raise_fd_limit() {
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+}
+
+static const char* mode_name(Mode mode) {
+  switch (mode) {
+    case MODE_WS_ECHO:      return "ws-echo";
+    case MODE_WS_BROADCAST: return "ws-broadcast";
+    default:                return "http";
+  }
+}
+
+static void report() {
+  double ms = 1e6;
+  const Histogram& h = R.latency;
+  double rps = R.completed / R.opt.duration;
+
+  if (R.opt.json) {
+    printf("{\"label\":\"%s\",\"mode\":\"%s\",\"connections\":%d,\"pipeline\":%d,"
+      "\"rate\":%g,\"duration\":%g,\"sent\":%llu,\"completed\":%llu,"
+      "\"per_second\":%.1f,\"errors\":%llu,\"status_errors\":%llu,"
+      "\"unfinished\":%llu,\"bytes_in\":%llu,"
+      "\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,"
+      "\"max\":%.3f,\"mean\":%.3f}}\n",
+      R.opt.label.c_str(), mode_name(R.opt.mode), R.opt.connections,
+      R.opt.pipeline, R.opt.rate, R.opt.duration,
+      (unsigned long long)R.sent, (unsigned long long)R.completed, rps,
+      (unsigned long long)R.errors, (unsigned long long)R.statusErrors,
+      (unsigned long long)R.unfinished, (unsigned long long)R.bytesIn,
+      h.quantile(0.5) / ms, h.quantile(0.9) / ms, h.quantile(0.99) / ms,
+      h.quantile(0.999) / ms, h.max() / ms, h.mean() / ms);
+    return;
+  }
+
+  if (!R.opt.label.empty()) {
+    printf("%s\n", R.opt.label.c_str());
+  }
+  printf("  %s, %d connections, %s\n", mode_name(R.opt.mode), R.opt.connections,
+    R.opt.rate == 0 ? "closed loop" : (std::to_string((long long)R.opt.rate) + "/s open loop").c_str());
+  printf("  %llu completed in %gs: %.1f/s, %.2f MB/s read\n",
+    (unsigned long long)R.completed, R.opt.duration, rps,
+    R.bytesIn / R.opt.duration / 1e6);
+  printf("  latency (ms): p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+    h.quantile(0.5) / ms, h.quantile(0.9) / ms, h.quantile(0.99) / ms,
+    h.quantile(0.999) / ms, h.max() / ms);
+  if (R.errors || R.statusErrors || R.unfinished) {
+    printf("  errors %llu, HTTP errors %llu, unfinished %llu\n",
+      (unsigned long long)R.errors, (unsigned long long)R.statusErrors,
+      (unsigned long long)R.unfinished);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (!parse_args(&R.opt, argc, argv)) {
+    usage();
+    return 2;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  raise_fd_limit();
+
+  int r;
+  if (R.opt.host.find(':') != std::string::npos) {
+    r = uv_ip6_addr(R.opt.host.c_str(), R.opt.port, (struct sockaddr_in6*)&R.addr);
+  } else {
+    r = uv_ip4_addr(R.opt.host.c_str(), R.opt.port, (struct sockaddr_in*)&R.addr);
+  }
+  if (r != 0) {
+    fail("Bad address", r);
+  }
+
+  parser_settings.on_headers_complete = on_headers_complete;
+  parser_settings.on_message_complete = on_message_complete;
+
+  R.loop = uv_default_loop();
+  R.request = build_request();
+  for (int i = 0; i < R.opt.connections; i++) {
+    Conn* c = new Conn();
+    c->index = i;
+    c->open = false;
+    c->ready = false;
+    c->status = 0;
+    c->upgraded = false;
+    c->wsInflight = 0;
+    R.conns.push_back(c);
+  }
+
+  connect_next();
+  uv_run(R.loop, UV_RUN_DEFAULT);
+  report();
+  return R.errors == 0 ? 0 : 1;
+}
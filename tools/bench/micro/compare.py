@@ -0,0 +1,38 @@
+# Compare two runs of the microbenchmarks.
+#
+# Usage: python3 compare.py <before.json> <after.json>
+#
+# Each file is the output of `micro --json`. For each benchmark in both, this
+# prints the median time per operation in each run and the change.
+
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                r = json.loads(line)
+                results[r["name"]] = r
+    return results
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("Usage: python3 compare.py <before.json> <after.json>")
+    before = load(sys.argv[1])
+    after = load(sys.argv[2])
+
+    print("%-32s %14s %14s %9s" % ("benchmark", "before ns/op", "after ns/op", "change"))
+    for name in before:
+        if name not in after:
+            continue
+        old = before[name]["ns_per_op"]
+        new = after[name]["ns_per_op"]
+        print("%-32s %14.1f %14.1f %+8.1f%%" % (name, old, new, (new / old - 1) * 100))
+
+
+main()
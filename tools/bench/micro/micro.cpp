@@ -0,0 +1,628 @@
+// Microbenchmarks for the parts of httpuv's C++ code that run for every
+// request, response, or WebSocket message. They are built from the sources
+// in src/, without R: the few Rcpp types those sources mention come from
+// shim/. See README.md in this directory.
+//
+// Each benchmark runs an operation in batches. The batch size is doubled
+// until a batch takes long enough to time, then --repeat batches are timed
+// and the median time per operation is reported, along with the fastest.
+
+#include <uv.h>
+#include "http-parser/http_parser.h"
+#include "headercollector.h"
+#include "websockets-parser.h"
+#include "websockets-ietf.h"
+#include "gzipdatasource.h"
+#include "staticpath.h"
+#include "base64/base64.hpp"
+#include "mime.h"
+#include "uri.h"
+#include "utils.h"
+#include "eventlog.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+struct Options {
+  std::string filter;
+  double minTime;
+  int repeat;
+  bool json;
+  bool list;
+
+  Options() : minTime(0.5), repeat(5), json(false), list(false) {}
+};
+
+struct Benchmark {
+  std::string name;
+  // Bytes processed by one operation, for reporting throughput; 0 if that
+  // doesn't mean anything for this benchmark.
+  size_t bytes;
+  // Runs the operation n times.
+  std::function<void(uint64_t n)> run;
+};
+
+struct Result {
+  uint64_t iterations;
+  double nsPerOp;
+  double minNsPerOp;
+};
+
+// Keeps the compiler from optimizing away the computation of `value`.
+template <typename T>
+static inline void keep(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static const T* volatile sink;
+  sink = &value;
+#endif
+}
+
+static double time_batch(const Benchmark& b, uint64_t n) {
+  uint64_t start = uv_hrtime();
+  b.run(n);
+  return (double)(uv_hrtime() - start);
+}
+
+static Result measure(const Benchmark& b, const Options& opt) {
+  double batchNs = opt.minTime * 1e9 / opt.repeat;
+
+  // Also warms up caches and the allocator.
+  uint64_t n = 1;
+  double ns = time_batch(b, n);
+  while (ns < batchNs / 10 && n < (1ULL << 40)) {
+    n *= 2;
+    ns = time_batch(b, n);
+  }
+  n = std::max<uint64_t>(1, (uint64_t)(n * batchNs / std::max(ns, 1.0)));
+
+  std::vector<double> perOp;
+  for (int i = 0; i < opt.repeat; i++) {
+    perOp.push_back(time_batch(b, n) / n);
+  }
+  std::sort(perOp.begin(), perOp.end());
+
+  Result r;
+  r.iterations = n * opt.repeat;
+  r.nsPerOp = perOp[perOp.size() / 2];
+  r.minNsPerOp = perOp[0];
+  return r;
+}
+
+static void report(const Benchmark& b, const Result& r, const Options& opt) {
+  double mbPerSec = b.bytes > 0 ? b.bytes / r.nsPerOp * 1e3 : 0;
+  if (opt.json) {
+    printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,"
+      "\"min_ns_per_op\":%.2f,\"bytes_per_op\":%llu,\"mb_per_s\":%.1f}\n",
+      b.name.c_str(), (unsigned long long)r.iterations, r.nsPerOp,
+      r.minNsPerOp, (unsigned long long)b.bytes, mbPerSec);
+  } else if (b.bytes > 0) {
+    printf("%-32s %12.1f ns/op %10.1f MB/s\n", b.name.c_str(), r.nsPerOp, mbPerSec);
+  } else {
+    printf("%-32s %12.1f ns/op\n", b.name.c_str(), r.nsPerOp);
+  }
+  fflush(stdout);
+}
+
+static void usage() {
+  fprintf(stderr,
+    "Usage: micro [options]\n"
+    "\n"
+    "  --filter=TEXT     Only run benchmarks whose names contain TEXT\n"
+    "  --min-time=SECS   Time to spend measuring each benchmark (0.5)\n"
+    "  --repeat=N        Number of timed batches per benchmark (5)\n"
+    "  --json            Print one line of JSON per benchmark\n"
+    "  --list            List the benchmarks and exit\n");
+}
+
+static bool parse_args(Options* opt, int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--json") {
+      opt->json = true;
+    } else if (arg == "--list") {
+      opt->list = true;
+    } else if (arg.compare(0, 9, "--filter=") == 0) {
+      opt->filter = arg.substr(9);
+    } else if (arg.compare(0, 11, "--min-time=") == 0) {
+      opt->minTime = atof(arg.c_str() + 11);
+    } else if (arg.compare(0, 9, "--repeat=") == 0) {
+      opt->repeat = atoi(arg.c_str() + 9);
+    } else {
+      return false;
+    }
+  }
+  return opt->minTime > 0 && opt->repeat > 0;
+}
+
+
+// ============================================================================
+// Inputs
+// ============================================================================
+
+// A request like the ones browsers send.
+static const std::string http_request =
+  "GET /api/v1/items?limit=50&offset=100 HTTP/1.1\r\n"
+  "Host: localhost:8080\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Accept-Language: en-US,en;q=0.9\r\n"
+  "Cache-Control: no-cache\r\n"
+  "Connection: keep-alive\r\n"
+  "Cookie: session=4f9d2a7c1e8b6d3f0a5c9e2b7d4f1a8c; theme=dark\r\n"
+  "Referer: http://localhost:8080/app/\r\n"
+  "Sec-Fetch-Mode: cors\r\n"
+  "\r\n";
+
+// About 100 KB of JSON that compresses like typical API responses; the same
+// as the static-gzip scenario in tools/bench/scenarios.R.
+static std::string make_json() {
+  uint32_t seed = 1;
+  std::string json = "[";
+  char row[200];
+  for (int i = 1; i <= 1300; i++) {
+    seed = seed * 1103515245 + 12345;
+    double price = 1 + (seed >> 8) % 99900 / 100.0;
+    snprintf(row, sizeof(row),
+      "%s{\"id\":%d,\"name\":\"item %d\",\"price\":%.2f,\"tags\":[\"a\",\"b\",\"c\"],\"active\":%s}",
+      i > 1 ? "," : "", i, i, price, i % 2 == 0 ? "true" : "false");
+    json += row;
+  }
+  json += "]\n";
+  return json;
+}
+
+// Masked binary frames, as a client sends them, one after another.
+static std::vector<char> make_ws_frames(size_t payloadSize, size_t count) {
+  WebSocketProto_IETF proto;
+  std::vector<char> frames;
+  for (size_t i = 0; i < count; i++) {
+    char header[MAX_HEADER_BYTES];
+    size_t headerLen;
+    proto.createFrameHeader(Binary, true, false, payloadSize, 0x1a2b3c4d,
+                            header, &headerLen);
+    frames.insert(frames.end(), header, header + headerLen);
+
+    std::vector<char> payload(payloadSize);
+    for (size_t j = 0; j < payloadSize; j++) {
+      payload[j] = (char)('a' + j % 26);
+    }
+    applyMask(&payload[0], payloadSize, (const uint8_t*)header + headerLen - 4, 0);
+    frames.insert(frames.end(), payload.begin(), payload.end());
+  }
+  return frames;
+}
+
+
+// ============================================================================
+// HTTP parsing
+// ============================================================================
+
+// What HttpRequest keeps while parsing a request.
+struct ParsedRequest {
+  http_parser parser;
+  std::string url;
+  RequestHeaders headers;
+  HeaderCollector collector;
+};
+
+static int on_url(http_parser* p, const char* at, size_t length) {
+  ((ParsedRequest*)p->data)->url = std::string(at, length);
+  return 0;
+}
+
+static int on_header_field(http_parser* p, const char* at, size_t length) {
+  ((ParsedRequest*)p->data)->collector.onField(at, length);
+  return 0;
+}
+
+static int on_header_value(http_parser* p, const char* at, size_t length) {
+  ParsedRequest* req = (ParsedRequest*)p->data;
+  req->collector.onValue(req->headers, at, length);
+  return 0;
+}
+
+static void parse_request(ParsedRequest* req, const http_parser_settings& settings,
+                          const std::string& data, size_t readSize) {
+  http_parser_init(&req->parser, HTTP_REQUEST);
+  req->parser.data = req;
+  req->headers.clear();
+  req->collector.reset();
+
+  for (size_t pos = 0; pos < data.size(); pos += readSize) {
+    size_t len = std::min(readSize, data.size() - pos);
+    size_t parsed = http_parser_execute(&req->parser, &settings, data.data() + pos, len);
+    if (parsed != len) {
+      fprintf(stderr, "Parse error: %s\n",
+        http_errno_description(HTTP_PARSER_ERRNO(&req->parser)));
+      exit(1);
+    }
+  }
+  keep(req->headers);
+}
+
+static void add_http_benchmarks(std::vector<Benchmark>* out) {
+  static http_parser_settings bare;
+  static http_parser_settings full;
+  memset(&bare, 0, sizeof(bare));
+  memset(&full, 0, sizeof(full));
+  full.on_url = on_url;
+  full.on_header_field = on_header_field;
+  full.on_header_value = on_header_value;
+
+  // The parser on its own, then with the callbacks that HttpRequest uses to
+  // collect the URL and headers.
+  Benchmark b;
+  b.name = "http_parse/parser_only";
+  b.bytes = http_request.size();
+  b.run = [](uint64_t n) {
+    ParsedRequest req;
+    for (uint64_t i = 0; i < n; i++) {
+      parse_request(&req, bare, http_request, http_request.size());
+    }
+  };
+  out->push_back(b);
+
+  b.name = "http_parse/headers";
+  b.run = [](uint64_t n) {
+    ParsedRequest req;
+    for (uint64_t i = 0; i < n; i++) {
+      parse_request(&req, full, http_request, http_request.size());
+    }
+  };
+  out->push_back(b);
+
+  // Arriving 64 bytes at a time, so that fields and values are split.
+  b.name = "http_parse/headers_split";
+  b.run = [](uint64_t n) {
+    ParsedRequest req;
+    for (uint64_t i = 0; i < n; i++) {
+      parse_request(&req, full, http_request, 64);
+    }
+  };
+  out->push_back(b);
+}
+
+
+// ============================================================================
+// WebSocket frames
+// ============================================================================
+
+// Does with each frame what WebSocketConnection does: unmasks the payload
+// into a buffer.
+class FrameReader : public WSParserCallbacks {
+  WSFrameHeaderInfo _header;
+  std::vector<char> _payload;
+  uint64_t _payloadOffset;
+
+public:
+  FrameReader() : _payloadOffset(0) {}
+
+  void onHeaderComplete(const WSFrameHeaderInfo& header) {
+    _header = header;
+    _payloadOffset = 0;
+  }
+  void onPayload(const char* data, size_t len) {
+    size_t origSize = _payload.size();
+    _payload.insert(_payload.end(), data, data + len);
+    if (_header.masked && len > 0) {
+      applyMask(&_payload[origSize], len, _header.maskingKey, _payloadOffset);
+    }
+    _payloadOffset += len;
+  }
+  void onFrameComplete() {
+    keep(_payload[0]);
+    _payload.clear();
+  }
+};
+
+static void add_ws_read_benchmark(std::vector<Benchmark>* out, const std::string& name,
+                                  size_t payloadSize, size_t count) {
+  std::shared_ptr<std::vector<char> > frames =
+    std::make_shared<std::vector<char> >(make_ws_frames(payloadSize, count));
+
+  Benchmark b;
+  b.name = name;
+  b.bytes = frames->size();
+  b.run = [frames](uint64_t n) {
+    FrameReader reader;
+    WSHyBiParser parser(&reader, new WebSocketProto_IETF());
+    for (uint64_t i = 0; i < n; i++) {
+      parser.read(&(*frames)[0], frames->size());
+    }
+  };
+  out->push_back(b);
+}
+
+static void add_ws_benchmarks(std::vector<Benchmark>* out) {
+  // Reading frames includes unmasking them.
+  add_ws_read_benchmark(out, "ws_read/64x125B", 125, 64);
+  add_ws_read_benchmark(out, "ws_read/64KiB", 65536, 1);
+
+  Benchmark b;
+  b.name = "ws_unmask/64KiB";
+  b.bytes = 65536;
+  b.run = [](uint64_t n) {
+    std::vector<char> payload(65536, 'x');
+    const uint8_t key[4] = { 0x1a, 0x2b, 0x3c, 0x4d };
+    for (uint64_t i = 0; i < n; i++) {
+      applyMask(&payload[0], payload.size(), key, i);
+      keep(payload[0]);
+    }
+  };
+  out->push_back(b);
+}
+
+
+// ============================================================================
+// gzip
+// ============================================================================
+
+// Hands out a buffer in pieces without copying it.
+class BufferDataSource : public DataSource {
+  std::shared_ptr<const std::string> _pData;
+  size_t _pos;
+
+public:
+  BufferDataSource(std::shared_ptr<const std::string> pData)
+    : _pData(pData), _pos(0) {}
+
+  uint64_t size() const {
+    return _pData->size();
+  }
+  uv_buf_t getData(size_t bytesDesired) {
+    size_t len = std::min(bytesDesired, _pData->size() - _pos);
+    uv_buf_t buf = uv_buf_init((char*)_pData->data() + _pos, (unsigned int)len);
+    _pos += len;
+    return buf;
+  }
+  void freeData(uv_buf_t /* buffer */) {
+  }
+  void close() {
+  }
+};
+
+static void add_gzip_benchmarks(std::vector<Benchmark>* out) {
+  std::shared_ptr<const std::string> json = std::make_shared<const std::string>(make_json());
+
+  // Compressing a whole response body, in the 64 KiB reads that
+  // ExtendedWrite makes.
+  Benchmark b;
+  b.name = "gzip/json";
+  b.bytes = json->size();
+  b.run = [json](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      GZipDataSource gzip(std::make_shared<BufferDataSource>(json));
+      while (true) {
+        uv_buf_t buf = gzip.getData(65536);
+        gzip.freeData(buf);
+        if (buf.len == 0) {
+          break;
+        }
+      }
+      keep(gzip);
+    }
+  };
+  out->push_back(b);
+}
+
+
+// ============================================================================
+// Strings
+// ============================================================================
+
+// Benchmark a function of one string, with the given input.
+static void add_string_benchmark(std::vector<Benchmark>* out, const std::string& name,
+                                 std::function<std::string(const std::string&)> fn,
+                                 const std::string& input) {
+  Benchmark b;
+  b.name = name;
+  b.bytes = input.size();
+  b.run = [fn, input](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      std::string result = fn(input);
+      keep(result);
+    }
+  };
+  out->push_back(b);
+}
+
+static void add_string_benchmarks(std::vector<Benchmark>* out) {
+  const std::string path = "/files/r\xc3\xa9sum\xc3\xa9 2024/report (final).pdf";
+  const std::string query = "q=caf\xc3\xa9 au lait&sort=price,desc&page=2";
+  const std::string encoded = "/static/some%20dir/caf%C3%A9/file%2B1.txt?q=a%26b%3Dc";
+
+  add_string_benchmark(out, "uri/encode",
+    [](const std::string& s) { return doEncodeURI(s, false); }, path);
+  add_string_benchmark(out, "uri/encode_component",
+    [](const std::string& s) { return doEncodeURI(s, true); }, query);
+  add_string_benchmark(out, "uri/decode",
+    [](const std::string& s) { return doDecodeURI(s, false); }, encoded);
+  add_string_benchmark(out, "uri/decode_component",
+    [](const std::string& s) { return doDecodeURI(s, true); }, encoded);
+
+  // The size of a SHA-1 digest, which is what the WebSocket handshake
+  // encodes.
+  add_string_benchmark(out, "base64/20B",
+    [](const std::string& s) { return b64encode(s.begin(), s.end()); },
+    std::string(20, '\x9c'));
+  add_string_benchmark(out, "base64/1KiB",
+    [](const std::string& s) { return b64encode(s.begin(), s.end()); },
+    std::string(1024, '\x9c'));
+
+  Benchmark b;
+  b.name = "http_date/format";
+  b.bytes = 0;
+  b.run = [](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      std::string date = http_date_string((time_t)(1700000000 + i));
+      keep(date);
+    }
+  };
+  out->push_back(b);
+
+  b.name = "http_date/parse";
+  b.run = [](uint64_t n) {
+    const std::string date = "Tue, 14 Nov 2023 22:13:20 GMT";
+    for (uint64_t i = 0; i < n; i++) {
+      time_t t = parse_http_date_string(date);
+      keep(t);
+    }
+  };
+  out->push_back(b);
+
+  // The extensions of a typical page's files, and one that isn't known.
+  b.name = "mime/lookup";
+  b.run = [](uint64_t n) {
+    static const char* exts[] = {
+      "html", "js", "css", "json", "png", "svg", "woff2", "unknownext"
+    };
+    std::vector<std::string> extensions(exts, exts + 8);
+    for (uint64_t i = 0; i < n; i++) {
+      std::string type = find_mime_type(extensions[i % extensions.size()]);
+      keep(type);
+    }
+  };
+  out->push_back(b);
+}
+
+
+// ============================================================================
+// Static paths
+// ============================================================================
+
+static void add_static_path_benchmarks(std::vector<Benchmark>* out) {
+  std::shared_ptr<StaticPathManager> manager = std::make_shared<StaticPathManager>();
+  const char* paths[] = {
+    "/static", "/assets", "/docs", "/lib/js", "/lib/css", "/shared",
+    "/images", "/fonts", "/downloads", "/vendor/htmlwidgets"
+  };
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+    manager->set(paths[i], StaticPath(std::string("/srv/www") + paths[i], StaticPathOptions()));
+  }
+
+  Benchmark b;
+  b.name = "static_path/match";
+  b.bytes = 0;
+  b.run = [manager](uint64_t n) {
+    const std::string url = "/assets/img/icons/logo.png";
+    for (uint64_t i = 0; i < n; i++) {
+      keep(manager->matchStaticPath(url));
+    }
+  };
+  out->push_back(b);
+
+  // Requests for the application's R handler go through every prefix of the
+  // path first.
+  b.name = "static_path/miss";
+  b.run = [manager](uint64_t n) {
+    const std::string url = "/api/v1/items/123/reviews";
+    for (uint64_t i = 0; i < n; i++) {
+      keep(manager->matchStaticPath(url));
+    }
+  };
+  out->push_back(b);
+}
+
+
+// ============================================================================
+// Logging
+// ============================================================================
+
+// Runs fn n times at the given log level, then restores the level. Each
+// operation includes the call to fn, which is the same for all of them.
+static void run_at_level(LogLevel level, uint64_t n,
+                         const std::function<void(uint64_t)>& fn) {
+  LogLevel old = log_level_;
+  log_level_ = level;
+  for (uint64_t i = 0; i < n; i++) {
+    fn(i);
+  }
+  log_level_ = old;
+}
+
+static void add_log_benchmarks(std::vector<Benchmark>* out) {
+  // How messages used to be logged on the background thread: the message is
+  // built before debug_log() checks the level.
+  Benchmark b;
+  b.name = "log/debug_log_literal_off";
+  b.bytes = 0;
+  b.run = [](uint64_t n) {
+    run_at_level(LOG_OFF, n, [](uint64_t) {
+      debug_log(std::string("HttpRequest::_on_headers_complete"), LOG_DEBUG);
+    });
+  };
+  out->push_back(b);
+
+  b.name = "log/debug_log_concat_off";
+  b.run = [](uint64_t n) {
+    run_at_level(LOG_OFF, n, [](uint64_t i) {
+      debug_log(std::string("HttpRequest::on_request_read error: ") +
+        uv_strerror(-(int)(i % 100) - 1), LOG_INFO);
+    });
+  };
+  out->push_back(b);
+
+  // The same messages as events.
+  b.name = "log/log_event_off";
+  b.run = [](uint64_t n) {
+    run_at_level(LOG_OFF, n, [](uint64_t i) {
+      log_event(LOG_DEBUG, EV_BODY, i, 4096);
+    });
+  };
+  out->push_back(b);
+
+  // Recorded in the ring buffer, but not printed, since it's a DEBUG event.
+  b.name = "log/log_event_debug";
+  b.run = [](uint64_t n) {
+    run_at_level(LOG_DEBUG, n, [](uint64_t i) {
+      log_event(LOG_DEBUG, EV_BODY, i, 4096);
+    });
+  };
+  out->push_back(b);
+}
+
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parse_args(&opt, argc, argv)) {
+    usage();
+    return 2;
+  }
+
+  std::vector<Benchmark> benchmarks;
+  add_http_benchmarks(&benchmarks);
+  add_ws_benchmarks(&benchmarks);
+  add_gzip_benchmarks(&benchmarks);
+  add_string_benchmarks(&benchmarks);
+  add_static_path_benchmarks(&benchmarks);
+  add_log_benchmarks(&benchmarks);
+
+  for (size_t i = 0; i < benchmarks.size(); i++) {
+    const Benchmark& b = benchmarks[i];
+    if (b.name.find(opt.filter) == std::string::npos) {
+      continue;
+    }
+    if (opt.list) {
+      printf("%s\n", b.name.c_str());
+    } else {
+      report(b, measure(b, opt), opt);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,9 @@
+/* For src/sha1/sha1.c, which gets WORDS_BIGENDIAN from R's Rconfig.h. */
+#ifndef MICRO_SHIM_RCONFIG_H
+#define MICRO_SHIM_RCONFIG_H
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WORDS_BIGENDIAN 1
+#endif
+
+#endif
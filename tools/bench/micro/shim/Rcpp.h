@@ -0,0 +1,90 @@
+// Just enough of Rcpp's interface for the httpuv sources that the
+// microbenchmarks compile, so that they can be built without R. Those
+// sources also have functions that convert to and from R objects; they have
+// to compile and link, but the benchmarks never call them, and if they were
+// called they would abort.
+#ifndef MICRO_SHIM_RCPP_H
+#define MICRO_SHIM_RCPP_H
+
+#include <Rinternals.h>
+// Rcpp.h brings in much of the standard library, and the httpuv sources
+// count on that.
+#include <algorithm>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Rcpp {
+
+class exception : public std::exception {
+  std::string _message;
+public:
+  explicit exception(const char* message) : _message(message) {}
+  const char* what() const noexcept { return _message.c_str(); }
+};
+
+[[noreturn]] inline void stop(const std::string&) { shim_unreachable(); }
+
+// Stands in for any R value: it can be converted to or assigned from
+// anything.
+class Proxy {
+public:
+  Proxy() {}
+  template <typename T> Proxy(const T&) {}
+  template <typename T> operator T() const { shim_unreachable(); }
+  template <typename T> Proxy& operator=(const T&) { shim_unreachable(); }
+  template <typename T> bool operator==(const T&) const { shim_unreachable(); }
+  template <typename T> bool operator!=(const T&) const { shim_unreachable(); }
+};
+
+class RObject {
+public:
+  RObject() {}
+  template <typename T> RObject(const T&) {}
+  template <typename T> RObject& operator=(const T&) { shim_unreachable(); }
+  operator SEXP() const { shim_unreachable(); }
+  bool isNULL() const { shim_unreachable(); }
+  Proxy attr(const std::string&) const { shim_unreachable(); }
+};
+
+template <int RTYPE, typename Elem = Proxy>
+class Vector : public RObject {
+public:
+  Vector() {}
+  template <typename T> Vector(const T&) {}
+  template <typename T, typename U> Vector(const T&, const U&) {}
+  template <typename T> Vector& operator=(const T&) { shim_unreachable(); }
+  R_xlen_t size() const { shim_unreachable(); }
+  Elem& operator[](R_xlen_t) const { shim_unreachable(); }
+  Proxy operator[](const std::string&) const { shim_unreachable(); }
+  Elem* begin() const { shim_unreachable(); }
+  Elem* end() const { shim_unreachable(); }
+  Proxy names() const { shim_unreachable(); }
+  bool containsElementNamed(const char*) const { shim_unreachable(); }
+
+  template <typename... Args>
+  static Vector create(const Args&...) { shim_unreachable(); }
+};
+
+typedef Vector<VECSXP> List;
+typedef Vector<STRSXP> CharacterVector;
+typedef Vector<RAWSXP, Rbyte> RawVector;
+
+struct ArgumentFactory {
+  Proxy operator[](const std::string&) const { shim_unreachable(); }
+};
+// const, so that sources that don't use it don't get a warning.
+static const ArgumentFactory _ = ArgumentFactory();
+
+template <typename T> T as(SEXP) { shim_unreachable(); }
+template <typename T, typename U> T as(const U&) { shim_unreachable(); }
+template <typename T> SEXP wrap(const T&) { shim_unreachable(); }
+
+} // namespace Rcpp
+
+#endif
@@ -0,0 +1,27 @@
+// Just enough of R's C API for the httpuv sources that the microbenchmarks
+// compile. None of it is ever called; see Rcpp.h.
+#ifndef MICRO_SHIM_RINTERNALS_H
+#define MICRO_SHIM_RINTERNALS_H
+
+#include <cstddef>
+#include <cstdlib>
+
+typedef struct SEXPREC* SEXP;
+typedef std::ptrdiff_t R_xlen_t;
+typedef unsigned char Rbyte;
+
+enum { NILSXP = 0, LGLSXP = 10, INTSXP = 13, REALSXP = 14, STRSXP = 16,
+       VECSXP = 19, RAWSXP = 24 };
+typedef enum { CE_NATIVE = 0, CE_UTF8 = 1 } cetype_t;
+
+#define R_NilValue ((SEXP)0)
+#define NA_STRING ((SEXP)0)
+
+[[noreturn]] inline void shim_unreachable() {
+  std::abort();
+}
+
+inline const char* Rf_translateCharUTF8(SEXP) { shim_unreachable(); }
+inline SEXP Rf_mkCharCE(const char*, cetype_t) { shim_unreachable(); }
+
+#endif
@@ -0,0 +1,45 @@
+# Open many idle WebSocket connections, for tools/bench/ws_idle_memory.R.
+#
+# Usage: python3 ws_clients.py <connections> <port> [<port> ...]
+#
+# Connections are spread over the given ports. Once they are all open, this
+# prints "opened <n>" and keeps them open until it is killed.
+
+import asyncio
+import sys
+
+HANDSHAKE = (
+    b"GET / HTTP/1.1\r\n"
+    b"Host: 127.0.0.1\r\n"
+    b"Upgrade: websocket\r\n"
+    b"Connection: Upgrade\r\n"
+    b"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    b"Sec-WebSocket-Version: 13\r\n"
+    b"\r\n"
+)
+
+
+async def connect(port, limit):
+    async with limit:
+        reader, writer = await asyncio.open_connection("127.0.0.1", port)
+        writer.write(HANDSHAKE)
+        await writer.drain()
+        status = await reader.readuntil(b"\r\n\r\n")
+        if not status.startswith(b"HTTP/1.1 101"):
+            raise RuntimeError("handshake failed: " + status.decode(errors="replace"))
+        return reader, writer
+
+
+async def main():
+    n = int(sys.argv[1])
+    ports = [int(port) for port in sys.argv[2:]]
+    # Don't have too many handshakes in flight at once.
+    limit = asyncio.Semaphore(500)
+    connections = await asyncio.gather(
+        *(connect(ports[i % len(ports)], limit) for i in range(n))
+    )
+    print("opened", len(connections), flush=True)
+    await asyncio.Event().wait()
+
+
+asyncio.run(main())
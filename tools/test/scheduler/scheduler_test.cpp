@@ -0,0 +1,274 @@
+// Tests for MainThreadScheduler: the order that it runs items from several
+// owners and priorities in, and how it hands the main thread back to later.
+// They are built from the sources in src/, without R; later() comes from
+// shim/, which records the callbacks so that the tests can run them. See
+// CMakeLists.txt for how to build and run them.
+
+#include "scheduler.h"
+#include "thread.h"
+#include <later_api.h>
+
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+static int failures = 0;
+
+#define EXPECT_EQ(expected, actual) \
+  expect_eq((expected), (actual), #actual, __FILE__, __LINE__)
+
+template <typename T>
+static void expect_eq(const T& expected, const T& actual,
+                      const char* expr, const char* file, int line) {
+  if (!(expected == actual)) {
+    fprintf(stderr, "%s:%d: %s was not what was expected\n", file, line, expr);
+    failures++;
+  }
+}
+
+static std::string join(const std::vector<std::string>& v) {
+  std::string out;
+  for (size_t i = 0; i < v.size(); i++) {
+    if (i > 0) out += " ";
+    out += v[i];
+  }
+  return out;
+}
+
+// Records the order that items run in.
+struct Log {
+  std::vector<std::string> ran;
+
+  std::function<void(void)> item(const std::string& name) {
+    std::vector<std::string>* pRan = &ran;
+    return [pRan, name]() { pRan->push_back(name); };
+  }
+
+  std::string str() const { return join(ran); }
+};
+
+static void check_result(const char* name, int failuresBefore) {
+  printf("%s %s\n", failures == failuresBefore ? "ok  " : "FAIL", name);
+}
+
+#define TEST(name) \
+  static void test_##name(); \
+  static void run_##name() { \
+    int before = failures; \
+    later::pending().clear(); \
+    test_##name(); \
+    check_result(#name, before); \
+  } \
+  static void test_##name()
+
+// Owners are only compared, so any distinct addresses will do.
+static const char owners[8] = { 0 };
+static const void* const A = &owners[0];
+static const void* const B = &owners[1];
+static const void* const C = &owners[2];
+
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+TEST(owner_items_run_in_order) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_NORMAL, log.item("a1"));
+  s.push(A, PRIORITY_NORMAL, log.item("a2"));
+  s.push(A, PRIORITY_NORMAL, log.item("a3"));
+  run_later();
+  EXPECT_EQ(std::string("a1 a2 a3"), log.str());
+  EXPECT_EQ((size_t)0, s.size());
+}
+
+TEST(owners_take_turns) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_NORMAL, log.item("a1"));
+  s.push(A, PRIORITY_NORMAL, log.item("a2"));
+  s.push(A, PRIORITY_NORMAL, log.item("a3"));
+  s.push(B, PRIORITY_NORMAL, log.item("b1"));
+  s.push(B, PRIORITY_NORMAL, log.item("b2"));
+  s.push(C, PRIORITY_NORMAL, log.item("c1"));
+  run_later();
+  EXPECT_EQ(std::string("a1 b1 c1 a2 b2 a3"), log.str());
+}
+
+TEST(higher_priorities_run_first) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_BULK, log.item("bulk"));
+  s.push(B, PRIORITY_NORMAL, log.item("normal"));
+  s.push(C, PRIORITY_CONTROL, log.item("control"));
+  run_later();
+  EXPECT_EQ(std::string("control normal bulk"), log.str());
+}
+
+// An owner's items stay in order even when a later one has a higher
+// priority; the owner waits in line for the priority of its next item.
+TEST(priority_does_not_reorder_an_owner) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_BULK, log.item("a_bulk"));
+  s.push(A, PRIORITY_CONTROL, log.item("a_control"));
+  s.push(B, PRIORITY_NORMAL, log.item("b_normal"));
+  s.push(C, PRIORITY_CONTROL, log.item("c_control"));
+  run_later();
+  EXPECT_EQ(std::string("c_control b_normal a_bulk a_control"), log.str());
+}
+
+// With a steady supply of higher-priority work, a waiting BULK item runs
+// after MAX_PRIORITY_SKIPS items have gone ahead of it.
+TEST(bulk_runs_after_max_skips) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_BULK, log.item("bulk"));
+  for (int i = 0; i < 40; i++) {
+    s.push(B, PRIORITY_NORMAL, log.item("normal"));
+  }
+  run_later();
+  std::vector<std::string> expected(41, "normal");
+  expected[MainThreadScheduler::MAX_PRIORITY_SKIPS] = "bulk";
+  EXPECT_EQ(join(expected), log.str());
+}
+
+// An owner with a lot of BULK work keeps getting one item in every
+// MAX_PRIORITY_SKIPS + 1, however much CONTROL and NORMAL work there is.
+TEST(bulk_keeps_making_progress) {
+  MainThreadScheduler s;
+  Log log;
+  for (int i = 0; i < 10; i++) {
+    s.push(A, PRIORITY_BULK, log.item("bulk"));
+  }
+  for (int i = 0; i < 200; i++) {
+    s.push(B, PRIORITY_NORMAL, log.item("normal"));
+    s.push(C, PRIORITY_CONTROL, log.item("control"));
+  }
+  while (run_later() > 0) {}
+
+  const size_t period = MainThreadScheduler::MAX_PRIORITY_SKIPS + 1;
+  EXPECT_EQ((size_t)410, log.ran.size());
+  for (size_t i = 0; i < 10 * period; i++) {
+    bool isBulk = log.ran[i] == "bulk";
+    EXPECT_EQ(i % period == period - 1, isBulk);
+  }
+}
+
+// Once no BULK item is waiting, NORMAL work waiting behind CONTROL work is
+// the lowest class, and it's the one that gets a turn.
+TEST(normal_runs_after_max_skips) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_NORMAL, log.item("normal"));
+  for (int i = 0; i < 20; i++) {
+    s.push(B, PRIORITY_CONTROL, log.item("control"));
+  }
+  run_later();
+  std::vector<std::string> expected(21, "control");
+  expected[MainThreadScheduler::MAX_PRIORITY_SKIPS] = "normal";
+  EXPECT_EQ(join(expected), log.str());
+}
+
+// Each call from later runs at most SLICE_SIZE items, and schedules another
+// call if there are more.
+TEST(run_is_limited_to_a_slice) {
+  MainThreadScheduler s;
+  Log log;
+  const size_t n = MainThreadScheduler::SLICE_SIZE + 36;
+  for (size_t i = 0; i < n; i++) {
+    s.push(i % 2 ? A : B, PRIORITY_NORMAL, log.item("x"));
+  }
+  // However many items were pushed, there's one call waiting.
+  EXPECT_EQ((size_t)1, later::pending().size());
+
+  EXPECT_EQ((size_t)1, run_later());
+  EXPECT_EQ((size_t)MainThreadScheduler::SLICE_SIZE, log.ran.size());
+  EXPECT_EQ((size_t)36, s.size());
+  EXPECT_EQ((size_t)1, later::pending().size());
+
+  EXPECT_EQ((size_t)1, run_later());
+  EXPECT_EQ(n, log.ran.size());
+  EXPECT_EQ((size_t)0, s.size());
+  // Nothing is left, so there's no need to be called again...
+  EXPECT_EQ((size_t)0, later::pending().size());
+
+  // ...until there's a new item.
+  s.push(A, PRIORITY_NORMAL, log.item("y"));
+  EXPECT_EQ((size_t)1, later::pending().size());
+  run_later();
+  EXPECT_EQ(n + 1, log.ran.size());
+}
+
+// An item that's pushed while the scheduler is running goes to the back of
+// the line, and runs in the same slice.
+TEST(items_pushed_while_running) {
+  MainThreadScheduler s;
+  Log log;
+  MainThreadScheduler* pS = &s;
+  Log* pLog = &log;
+  s.push(A, PRIORITY_NORMAL, [pS, pLog]() {
+    pLog->ran.push_back("a1");
+    pS->push(A, PRIORITY_NORMAL, pLog->item("a2"));
+  });
+  s.push(B, PRIORITY_NORMAL, log.item("b1"));
+  run_later();
+  EXPECT_EQ(std::string("a1 b1 a2"), log.str());
+  EXPECT_EQ((size_t)0, later::pending().size());
+}
+
+// If an item throws, the items after it still get run.
+TEST(throwing_item_does_not_strand_the_rest) {
+  MainThreadScheduler s;
+  Log log;
+  s.push(A, PRIORITY_NORMAL, []() { throw std::runtime_error("boom"); });
+  s.push(A, PRIORITY_NORMAL, log.item("a2"));
+  bool threw = false;
+  try {
+    run_later();
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  EXPECT_EQ(true, threw);
+  EXPECT_EQ((size_t)1, later::pending().size());
+  run_later();
+  EXPECT_EQ(std::string("a2"), log.str());
+}
+
+TEST(queue_delay_is_zero_when_empty) {
+  MainThreadScheduler s;
+  EXPECT_EQ((uint64_t)0, s.queueDelayMs());
+  s.push(A, PRIORITY_NORMAL, []() {});
+  run_later();
+  EXPECT_EQ((uint64_t)0, s.queueDelayMs());
+}
+
+
+int main() {
+  register_main_thread();
+
+  run_owner_items_run_in_order();
+  run_owners_take_turns();
+  run_higher_priorities_run_first();
+  run_priority_does_not_reorder_an_owner();
+  run_bulk_runs_after_max_skips();
+  run_bulk_keeps_making_progress();
+  run_normal_runs_after_max_skips();
+  run_run_is_limited_to_a_slice();
+  run_items_pushed_while_running();
+  run_throwing_item_does_not_strand_the_rest();
+  run_queue_delay_is_zero_when_empty();
+
+  if (failures > 0) {
+    printf("%d failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
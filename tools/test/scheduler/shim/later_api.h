@@ -0,0 +1,35 @@
+// Stands in for later's header. Instead of running callbacks from R's event
+// loop, later() records them, and the tests run them with run_later().
+#ifndef LATER_API_H
+#define LATER_API_H
+
+#include <utility>
+#include <vector>
+
+namespace later {
+
+typedef std::pair<void (*)(void*), void*> Callback;
+
+inline std::vector<Callback>& pending() {
+  static std::vector<Callback> callbacks;
+  return callbacks;
+}
+
+inline void later(void (*func)(void*), void* data, double /* secs */) {
+  pending().push_back(Callback(func, data));
+}
+
+} // namespace later
+
+// Run the callbacks that were waiting when this was called, and return how
+// many there were.
+inline size_t run_later() {
+  std::vector<later::Callback> callbacks;
+  callbacks.swap(later::pending());
+  for (size_t i = 0; i < callbacks.size(); i++) {
+    callbacks[i].first(callbacks[i].second);
+  }
+  return callbacks.size();
+}
+
+#endif